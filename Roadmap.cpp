@@ -3,9 +3,15 @@
 #include <QtCore>
 #include <QDate>
 #include "Utility.hpp"
+#include "RoadmapFormat.hpp"
+#include "RoadmapJournal.hpp"
 
 void RoadmapProject::clearReferenceToElement(RoadmapProjectElement* element)
 {
+    // I link spariscono insieme all'elemento, il journal registra solo l'eliminazione
+    RoadmapJournal* journal = rmap->Journal;
+    rmap->Journal = nullptr;
+
     /*
      * Per ogni progetto presente nella roadmap
      */
@@ -23,6 +29,8 @@ void RoadmapProject::clearReferenceToElement(RoadmapProjectElement* element)
          */
         project->Elements.removeOne(element);
     }
+
+    rmap->Journal = journal;
 }
 
 /*
@@ -40,10 +48,12 @@ RoadmapProject::RoadmapProject(Roadmap* parent) : RoadmapElement(PROJECT), rmap(
 RoadmapProject::~RoadmapProject()
 {
     /*
-     * Sgancio le referenze
+     * Sgancio le referenze e tolgo gli elementi dall'indice temporale
      */
-    for (RoadmapProjectElement* element : Elements)
+    for (RoadmapProjectElement* element : Elements) {
         clearReferenceToElement(element);
+        rmap->Timeline.remove(element);
+    }
 
     /*
      * Se avessi eliminato subito gli ogetti, la clearreference
@@ -70,6 +80,8 @@ Roadmap* RoadmapProject::roadmap() const
 
 RoadmapTask* RoadmapProject::addTask()
 {
+    load(); // Il nuovo elemento va in coda a quelli del file
+
     /*
      * Alloco un oggetto task nello heap, generando un nuovo id
      * univoco
@@ -78,8 +90,13 @@ RoadmapTask* RoadmapProject::addTask()
 
     /*
      * Lo aggiungo agli elementi del progetto corrente
+     * e all'indice temporale della Roadmap
      */
     Elements.append(task);
+    rmap->Timeline.insert(task);
+
+    if (rmap->Journal != nullptr)
+        rmap->Journal->elementAdded(position(), PROJECT_TASK, task->id());
 
     /*
      * Lo restituisco al chiamante
@@ -89,12 +106,18 @@ RoadmapTask* RoadmapProject::addTask()
 
 RoadmapMilestone* RoadmapProject::addMilestone()
 {
+    load();
+
     /*
      * Alloco un oggetto milestone nello heap, generando un nuovo id
      * univoco, lo aggiungo all'istanza corrente e lo ritorno.
      */
     RoadmapMilestone* mile = new RoadmapMilestone(this, rmap->nextId());
     Elements.append(mile);
+    rmap->Timeline.insert(mile);
+
+    if (rmap->Journal != nullptr)
+        rmap->Journal->elementAdded(position(), PROJECT_MILESTONE, mile->id());
     return mile;
 }
 
@@ -117,15 +140,19 @@ void RoadmapProject::delElement(RoadmapProjectElement* element)
     if (!Elements.contains(element))
         return;
 
+    if (rmap->Journal != nullptr)
+        rmap->Journal->elementRemoved(element->id());
+
     /*
      * Pulisco ogni referenza all'elemento
      */
     clearReferenceToElement(element);
 
     /*
-     * Lo rimuovo dalla lista
+     * Lo rimuovo dalla lista e dall'indice temporale
      */
     Elements.removeOne(element);
+    rmap->Timeline.remove(element);
 
     delete element;
 }
@@ -135,6 +162,23 @@ QList<RoadmapProjectElement*> RoadmapProject::elements() const
     return Elements; // Ritorno la lista di elementi
 }
 
+bool RoadmapProject::isLoaded() const
+{
+    return Record < 0;
+}
+
+void RoadmapProject::load()
+{
+    if (!isLoaded())
+        rmap->Lazy->load(*rmap, this); // Crea gli elementi leggendo i record dal file mappato
+}
+
+int RoadmapProject::elementCount() const
+{
+    // Prima del caricamento il numero di elementi è nell'indice del file
+    return isLoaded() ? Elements.count() : int(rmap->Lazy->record(this).ElementCount);
+}
+
 QString RoadmapProject::name() const
 {
     return Name; // Ritorno il nome del progetto
@@ -143,6 +187,9 @@ QString RoadmapProject::name() const
 void RoadmapProject::setName(const QString name)
 {
     Name = name; // Imposto il nuovo nome del progetto
+
+    if (rmap->Journal != nullptr)
+        rmap->Journal->projectName(position(), name);
 }
 
 QColor RoadmapProject::color() const
@@ -153,6 +200,9 @@ QColor RoadmapProject::color() const
 void RoadmapProject::setColor(const QColor color)
 {
     Color = color; // Imposto il nuovo colore del progetto
+
+    if (rmap->Journal != nullptr)
+        rmap->Journal->projectColor(position(), color);
 }
 
 void RoadmapProject::movNext(RoadmapProjectElement* element)
@@ -175,6 +225,9 @@ void RoadmapProject::movNext(RoadmapProjectElement* element)
 
     Elements.removeAt(ei); // Sgancio l'elemento momentaneamente
     Elements.insert(ei + 1, element); // Lo reinserisco Element Index + 1
+
+    if (rmap->Journal != nullptr)
+        rmap->Journal->elementMoved(element->id(), +1);
 }
 
 void RoadmapProject::movPrev(RoadmapProjectElement* element)
@@ -193,10 +246,17 @@ void RoadmapProject::movPrev(RoadmapProjectElement* element)
     if (ei < 0 || ei < 1)  return;
     Elements.removeAt(ei);
     Elements.insert(ei - 1, element);
+
+    if (rmap->Journal != nullptr)
+        rmap->Journal->elementMoved(element->id(), -1);
 }
 
 QDate RoadmapProject::startDate() const
 {
+    // Se gli elementi non sono ancora caricati la data è nell'indice del file
+    if (!isLoaded())
+        return QDate::fromJulianDay(rmap->Lazy->record(this).StartDay);
+
     /*
      * Per calcolare la data di inizio vado a cercare l'elemento
      * che inizia alla data più piccola
@@ -235,6 +295,9 @@ QDate RoadmapProject::startDate() const
 
 QDate RoadmapProject::endDate() const
 {
+    if (!isLoaded())
+        return QDate::fromJulianDay(rmap->Lazy->record(this).EndDay);
+
     /*
      * Stesso discorso di start date, ovviamente al contrario cercando la data più grande
      * in questo caso prendo in considerazione solo gli elementi di tipo task
@@ -311,6 +374,11 @@ RoadmapProjectElement::~RoadmapProjectElement()
      * e sganciare il progetto padre dall'istanza corrente
      */
     childs().clear();
+
+    // Gli elementi creati dal file vanno dimenticati, i link caricati dopo non devono puntarli
+    if (Project != nullptr && Project->roadmap()->Lazy != nullptr)
+        Project->roadmap()->Lazy->forget(this);
+
     Project = nullptr;
 }
 
@@ -331,7 +399,21 @@ QDate RoadmapProjectElement::date() const
 
 void RoadmapProjectElement::setDate(const QDate& date)
 {
+    /*
+     * L'indice temporale è ordinato per data di partenza:
+     * tolgo l'elemento con lo span vecchio e lo reinserisco con quello nuovo
+     */
+    RoadmapTimeline* index = timeline();
+    if (index != nullptr)
+        index->remove(this);
+
     Date = date; // Imposto la data di riferimento dell'elemento
+
+    if (index != nullptr)
+        index->insert(this);
+
+    if (RoadmapJournal* log = journal())
+        log->elementDate(Id, date);
 }
 
 QString RoadmapProjectElement::name() const
@@ -342,6 +424,9 @@ QString RoadmapProjectElement::name() const
 void RoadmapProjectElement::setName(const QString name)
 {
     Name = name; // Reimposto il nome
+
+    if (RoadmapJournal* log = journal())
+        log->elementName(Id, name);
 }
 
 void RoadmapProjectElement::addChild(RoadmapProjectElement* element)
@@ -356,6 +441,9 @@ void RoadmapProjectElement::addChild(RoadmapProjectElement* element)
 
     // Aggancio il child
     Childs.append(element);
+
+    if (RoadmapJournal* log = journal())
+        log->linkAdded(Id, element->id());
 }
 
 void RoadmapProjectElement::remChild(RoadmapProjectElement* element)
@@ -366,6 +454,9 @@ void RoadmapProjectElement::remChild(RoadmapProjectElement* element)
 
     // Rimuovo la prima corrispondenza nella lista dei child
     Childs.removeOne(element);
+
+    if (RoadmapJournal* log = journal())
+        log->linkRemoved(Id, element->id());
 }
 
 int RoadmapProjectElement::position()
@@ -382,6 +473,22 @@ QList<RoadmapProjectElement*> RoadmapProjectElement::childs() const
     return Childs; // Ritorno la lista dei childs
 }
 
+RoadmapTimeline* RoadmapProjectElement::timeline() const
+{
+    if (Project == nullptr || Project->roadmap() == nullptr)
+        return nullptr;
+
+    return &Project->roadmap()->Timeline;
+}
+
+RoadmapJournal* RoadmapProjectElement::journal() const
+{
+    if (Project == nullptr || Project->roadmap() == nullptr)
+        return nullptr;
+
+    return Project->roadmap()->Journal;
+}
+
 /*
  * Inizializzo tutti i fields della classe
  * Un ProjectTask ha:
@@ -404,7 +511,18 @@ int RoadmapTask::days() const
 
 void RoadmapTask::setDays(const int days)
 {
+    // Cambia la fine dello span, come per setDate tolgo e reinserisco l'elemento nell'indice
+    RoadmapTimeline* index = timeline();
+    if (index != nullptr)
+        index->remove(this);
+
     Days = days; // Imposto la durata in giorni
+
+    if (index != nullptr)
+        index->insert(this);
+
+    if (RoadmapJournal* log = journal())
+        log->taskDays(id(), days);
 }
 
 QDate RoadmapTask::endDate() const
@@ -440,6 +558,9 @@ bool RoadmapMilestone::delivered() const
 void RoadmapMilestone::setDelivered(const bool delivered)
 {
     Delivered = delivered; // Imposto lo stato
+
+    if (RoadmapJournal* log = journal())
+        log->milestoneDelivered(id(), delivered);
 }
 
 int Roadmap::nextId() const
@@ -464,6 +585,10 @@ int Roadmap::nextId() const
         }
     }
 
+    // Gli elementi non ancora caricati hanno comunque un id, l'indice del file conosce il più grande
+    if (Lazy != nullptr && Lazy->MaxId > maxId)
+        maxId = Lazy->MaxId;
+
     /*
      * Ritorno l'id più grande + 1
      */
@@ -476,6 +601,16 @@ Roadmap::Roadmap(QObject* parent) : QObject(parent), Projects()
 
 Roadmap::~Roadmap()
 {
+    /*
+     * Svuoto l'indice temporale in un colpo solo,
+     * così i progetti non devono rimuovere i loro elementi uno per uno
+     */
+    Timeline.clear();
+
+    // I progetti non ancora caricati non servono più, gli elementi non devono avvisare l'indice
+    delete Lazy;
+    Lazy = nullptr;
+
     /*
      * Elimino ogni progetto all'interno della Roadmap
      */
@@ -484,6 +619,9 @@ Roadmap::~Roadmap()
         Projects.removeOne(project);
         delete project;
     }
+
+    // Solo ora che i nomi non esistono più rilascio il file mappato
+    delete Mapping;
 }
 
 QList<RoadmapProject*> Roadmap::projects() const
@@ -501,6 +639,9 @@ RoadmapProject* Roadmap::addProject()
      */
     RoadmapProject* project = new RoadmapProject(this);
     Projects.append(project);
+
+    if (Journal != nullptr)
+        Journal->projectAdded();
     return  project;
 }
 
@@ -512,6 +653,10 @@ void Roadmap::delProject(RoadmapProject* project)
      * Significa che era un progetto effettivamente contenuto nella lista dei progetti
      * Nel caso removeOne ritorni true elimino il progetto dall'heap
      */
+    const int position = Projects.indexOf(project);
+    if (position >= 0 && Journal != nullptr)
+        Journal->projectRemoved(position);
+
     if (Projects.removeOne(project))
         delete project;
 }
@@ -528,6 +673,9 @@ void Roadmap::movNextPosition(RoadmapProject* project)
 
     Projects.removeAt(pi); // Lo rimuovo dalla lista
     Projects.insert(pi + 1, project); // Lo inseriesco una posizione più avanti
+
+    if (Journal != nullptr)
+        Journal->projectMoved(pi, +1);
 }
 
 void Roadmap::movPrevPosition(RoadmapProject* project)
@@ -541,6 +689,9 @@ void Roadmap::movPrevPosition(RoadmapProject* project)
 
     Projects.removeAt(pi); // Lo rimuovo dalla lista
     Projects.insert(pi - 1, project); // Lo inseriesco una posizione più indietro
+
+    if (Journal != nullptr)
+        Journal->projectMoved(pi, -1);
 }
 
 RoadmapProjectElement* Roadmap::findElementById(int id) const
@@ -559,99 +710,165 @@ RoadmapProjectElement* Roadmap::findElementById(int id) const
     return nullptr; // L'elemento non è stato trovato
 }
 
-QDataStream& operator<<(QDataStream& out, Roadmap& rmap)
+QList<RoadmapProjectElement*> Roadmap::elementsBetween(const QDate& from, const QDate& to) const
 {
-    /*
-     * Ogni call a << scrive nello stream,
-     * è importante l'ordine con cui vengono fatte
-     * le scritture, questo stabilisce il binary format
-     * del file di salvataggio
-     *
-     * Serializzo qusta stringa come "magic string"
-     */
-    out << "RoadmapPlanet01";
+    return Timeline.overlapping(from, to);
+}
 
-    /*
-     * Serializzo il numero di progetti
-     */
-    out << rmap.Projects.count();
+QList<RoadmapProjectElement*> Roadmap::elementsAt(const QDate& date) const
+{
+    return Timeline.at(date);
+}
 
-    /*
-     * Inizializzo un hash map per memorizzare
-     * i link tra gli elementi (1 a N)
-     */
-    QMap<int, QList<int>> links;
+QDate Roadmap::firstDate() const
+{
+    QDate first = Timeline.firstDate();
+
+    // I progetti non caricati non sono nell'indice temporale, uso le date dell'indice del file
+    if (Lazy != nullptr) {
+        for (RoadmapProject* pro : Projects) {
+            const QDate start = pro->isLoaded() ? QDate() : pro->startDate();
+            if (start.isValid() && (!first.isValid() || start < first))
+                first = start;
+        }
+    }
+
+    return first;
+}
+
+QDate Roadmap::lastDate() const
+{
+    QDate last = Timeline.lastDate();
+
+    if (Lazy != nullptr) {
+        for (RoadmapProject* pro : Projects) {
+            const QDate end = pro->isLoaded() ? QDate() : QDate::fromJulianDay(Lazy->record(pro).LastDay);
+            if (end.isValid() && (!last.isValid() || end > last))
+                last = end;
+        }
+    }
+
+    return last;
+}
+
+void Roadmap::loadAll()
+{
+    if (Lazy == nullptr)
+        return;
+
+    for (RoadmapProject* pro : Projects)
+        pro->load();
+
+    // Caricato tutto: l'indice non serve più
+    delete Lazy;
+    Lazy = nullptr;
+}
+
+bool Roadmap::isDamaged() const
+{
+    return Damaged;
+}
+
+void Roadmap::acceptDamage()
+{
+    Damaged = false;
+}
+
+bool Roadmap::isCompressed() const
+{
+    return Compressed;
+}
+
+void Roadmap::setJournal(RoadmapJournal* journal)
+{
+    Journal = journal;
+}
+
+RoadmapJournal* Roadmap::journal() const
+{
+    return Journal;
+}
+
+void Roadmap::unmap()
+{
+    if (!isMapped())
+        return;
+
+    loadAll(); // Gli elementi non caricati leggono ancora dal file
 
     /*
-     * Per ogni progetto
+     * QString(const QChar*, int) copia sempre i caratteri,
+     * al contrario dell'assegnamento che condividerebbe la vista
      */
-    for (RoadmapProject* pro : rmap.Projects)
-    {
-        out << pro->Name; // Serializzo il nome
-        out << pro->Color; // Serializzo il Colore
+    for (RoadmapProject* pro : Projects) {
+        pro->Name = QString(pro->Name.constData(), pro->Name.length());
+        for (RoadmapProjectElement* element : pro->Elements)
+            element->Name = QString(element->Name.constData(), element->Name.length());
+    }
 
-        out << pro->Elements.count(); // Serializzo il numero di elementi
+    delete Mapping;
+    Mapping = nullptr;
+    Mapped.clear();
+}
 
+bool Roadmap::isMapped() const
+{
+    return Mapping != nullptr || !Mapped.isNull();
+}
 
-        /*
-         * Per ogni elemento negli elementi
-         */
-        for (RoadmapProjectElement* element : pro->Elements)
-        {
-            /*
-             * A seconda del tipo
-             */
-            switch (RoadmapElementType(element->Type))
-            {
-            case PROJECT_TASK:
-            {
-                /* Recupero il task */
-                RoadmapTask* task = static_cast<RoadmapTask*>(element);
-                out << task->Id; // Serializzo l'id
-                out << static_cast<int>(task->Type); // Serializzo il tipo
-                out << task->Date; // Serializzo la data
-                out << task->Name; // Serializzo il nome
-                out << task->Days; // Serializzo la durata
-                break;
-            }
-            case PROJECT_MILESTONE:
-            {
-                /* Recupero la Milestone */
-                RoadmapMilestone* mile = static_cast<RoadmapMilestone*>(element);
-                out << mile->Id; // Serializzo l'id
-                out << static_cast<int>(mile->Type); // Serializzo il tipo
-                out << mile->Date; // Serializzo la data
-                out << mile->Name; // Serializzo il nome
-                out << mile->Delivered; // Serializzo il flag Delivered
-                break;
-            }
-            }
+bool Roadmap::isMappedFrom(const QString& path) const
+{
+    return Mapping != nullptr && QFileInfo(Mapping->fileName()) == QFileInfo(path);
+}
 
-            //Instanzio la lista degli id figli
-            QList<int> cIds;
+void Roadmap::detachMapping(const QByteArray& copy)
+{
+    if (Mapping == nullptr || Mapped.isNull() || copy.size() != Mapped.size())
+        return;
 
-            /*
-             * Per ogni figlio
-             */
-            for (RoadmapProjectElement* lElement : element->Childs)
-            {
-                /* Aggiungo l'id dell'elemento alla lista */
-                cIds.append(lElement->Id);
-            }
+    const char* from = Mapped.constData();
+    const qptrdiff delta = copy.constData() - from;
 
-            /*
-             * Aggiungo la lista degli id all'elemento del progetto
-             */
-            links.insert(element->Id, cIds);
-        }
+    // Le viste nel file diventano viste nella copia, le altre stringhe sono già copie
+    auto moved = [&](const QString& name) -> QString
+    {
+        const char* data = reinterpret_cast<const char*>(name.constData());
+        if (data < from || data >= from + Mapped.size())
+            return name;
 
+        return QString::fromRawData(reinterpret_cast<const QChar*>(data + delta), name.length());
+    };
 
+    for (RoadmapProject* pro : Projects) {
+        pro->Name = moved(pro->Name);
+        for (RoadmapProjectElement* element : pro->Elements)
+            element->Name = moved(element->Name);
     }
 
+    if (Lazy != nullptr)
+        Lazy->View.move(delta);
+
+    Mapped = copy;
+    delete Mapping;
+    Mapping = nullptr;
+}
+
+QDataStream& operator<<(QDataStream& out, Roadmap& rmap)
+{
+    /*
+     * Serializzo la magic string come nella v1, così il lettore
+     * riconosce la versione prima di leggere il resto del file
+     */
+    out << FormatMagicV2;
+
+    rmap.loadAll(); // L'indice del file va ricalcolato, servono tutti gli elementi
+
     /*
-     * Serializzo la mappa dei links
+     * Il resto del file sono le tabelle piatte del formato v2
+     * (Vedi RoadmapFormat), scritte in blocco
      */
-    out << links;
+    if (!RoadmapTables::build(rmap).write(out))
+        throw std::exception();
 
     // Ritorno lo stream
     return out;
@@ -659,10 +876,29 @@ QDataStream& operator<<(QDataStream& out, Roadmap& rmap)
 
 QDataStream& operator >> (QDataStream& in, Roadmap& rmap)
 {
-    QString versionName;
-
+    /*
+     * La magic string è scritta da QDataStream come array di byte
+     * (terminato da \0), la leggo allo stesso modo
+     */
+    QByteArray versionName;
     in >> versionName; // Deserializzo la stringa di versione
 
+    if (qstrcmp(versionName.constData(), FormatMagicV2) == 0)
+    {
+        // Formato v2: leggo le tabelle in blocco e ricreo gli oggetti
+        RoadmapTables tables;
+        if (!tables.read(in))
+            throw std::exception();
+
+        tables.restore(rmap);
+        rmap.Compressed = tables.Compressed;
+        return in;
+    }
+
+    // Altrimenti deve essere un file v1, con i record annidati
+    if (qstrcmp(versionName.constData(), FormatMagicV1) != 0)
+        throw std::exception();
+
     int pCount;
     in >> pCount; // Ottengo il numero dei progetti
 
@@ -721,8 +957,9 @@ QDataStream& operator >> (QDataStream& in, Roadmap& rmap)
             element->Name = name; // Imposto il nome
             element->Date = date; // Imposto la data
 
-            // Lo aggiungo al progetto
+            // Lo aggiungo al progetto e all'indice temporale
             pro->Elements.append(element);
+            rmap.Timeline.insert(element);
         }
     }
 
@@ -33,11 +33,19 @@
  *
  * NB: Tutti gli elementi della Roadmap ereditano RoadampElement,
  *     Esempio: RoadampMilestone -> RoadmapProjectElement -> RoadmapElement
+ *
+ * La Roadmap mantiene inoltre un indice temporale (RoadmapTimeline) di tutti i
+ * project element, aggiornato da setDate() e setDays(), che permette di sapere
+ * quali elementi sono attivi in un intervallo di date senza scorrere tutta la struttura
  */
 #include <QObject>
 #include <QDate>
 #include <QColor>
+#include "RoadmapTimeline.hpp"
 
+class QFile;
+struct RoadmapLazyTables;
+class RoadmapJournal;
 class Roadmap;
 class RoadmapProjectElement;
 class RoadmapTask;
@@ -84,6 +92,9 @@ public:
      */
     friend QDataStream& operator << (QDataStream &out, Roadmap &project);
     friend QDataStream& operator >> (QDataStream &in, Roadmap &project);
+    friend struct RoadmapTables;
+    friend struct RoadmapTableView;
+    friend struct RoadmapLazyTables;
 };
 
 class RoadmapProject : public RoadmapElement
@@ -92,6 +103,7 @@ class RoadmapProject : public RoadmapElement
     QString Name; // Nome del progetto
     QColor Color; // Colore del progetto
     QList<RoadmapProjectElement*> Elements; // Lista degli elementi figli
+    int Record = -1; // Record nell'indice del file finché gli elementi non sono caricati (Vedi RoadmapLazyTables)
 
     /*
      * Questo metodo serve a liberare tutte le referenze di un ProjectElement
@@ -134,12 +146,23 @@ public:
 	void delElement(RoadmapProjectElement* element);
 
     /*
-     * Get degli elementi figli del progetto
+     * Get degli elementi figli del progetto,
+     * vuota finché il progetto non è stato caricato
      */
 	QList<RoadmapProjectElement*> elements() const;
 
     /*
-     * Get\Set del nome
+     * Caricamento pigro: un progetto aperto da un file mappato conosce solo
+     * l'indice dei suoi elementi, load() li crea (non fa nulla se sono già caricati).
+     * elementCount() ritorna il numero di elementi anche prima del caricamento
+     */
+	bool isLoaded() const;
+	void load();
+	int elementCount() const;
+
+    /*
+     * Get\Set del nome, finché la Roadmap è mappata il nome è una vista nel file
+     * (Vedi Roadmap::isMapped): chi lo conserva oltre unmap() deve copiarlo (detachedString)
      */
 	QString name() const;
 	void setName(const QString name);
@@ -164,6 +187,9 @@ public:
 
     friend QDataStream& operator << (QDataStream &out, Roadmap &project);
     friend QDataStream& operator >> (QDataStream &in, Roadmap &project);
+    friend struct RoadmapTables;
+    friend struct RoadmapTableView;
+    friend struct RoadmapLazyTables;
 };
 
 class RoadmapProjectElement : public RoadmapElement
@@ -174,9 +200,10 @@ class RoadmapProjectElement : public RoadmapElement
      * L'id del ProjectElement è univoco per tutta la Roadmap
      * e permette ai ProjectElement di poter serializzare i link in fase di
      * salvataggio e caricamento.
-     * I link nel file di salvataggio vengono salvati come:
+     * Nei file v1 i link vengono salvati come:
      *   Id Roadmap padre => lista di id degli elementi figli
      *   Es: Element(12) => Element(13), Element(08), Element(09)
+     * Nei file v2 i link sono indici nella tabella degli elementi (Vedi RoadmapFormat)
      */
     int Id;
 
@@ -195,6 +222,17 @@ class RoadmapProjectElement : public RoadmapElement
      */
 	QList<RoadmapProjectElement*> Childs;
 
+    /*
+     * Ottiene l'indice temporale della Roadmap di cui fa parte l'elemento,
+     * nullptr se l'elemento è stato sganciato
+     */
+	RoadmapTimeline* timeline() const;
+
+    /*
+     * Ottiene il journal delle modifiche della Roadmap, nullptr se non impostato
+     */
+	RoadmapJournal* journal() const;
+
 protected:
     /*
      * Il Costruttore di un ProjectElement ha bisogno di
@@ -220,7 +258,7 @@ public:
 	void setDate(const QDate& date);
 
     /*
-     * Get\Set nome
+     * Get\Set nome, come RoadmapProject::name() può essere una vista nel file mappato
      */
 	QString name() const;
 	void setName(const QString name);
@@ -246,8 +284,14 @@ public:
      */
 	QList<RoadmapProjectElement*> childs() const;
 
+    friend class RoadmapTask;
+    friend class RoadmapMilestone;
+    friend class RoadmapJournal;
     friend QDataStream& operator << (QDataStream &out, Roadmap &project);
     friend QDataStream& operator >> (QDataStream &in, Roadmap &project);
+    friend struct RoadmapTables;
+    friend struct RoadmapTableView;
+    friend struct RoadmapLazyTables;
 };
 
 /*
@@ -283,6 +327,9 @@ public:
 
     friend QDataStream& operator << (QDataStream &out, Roadmap &project);
     friend QDataStream& operator >> (QDataStream &in, Roadmap &project);
+    friend struct RoadmapTables;
+    friend struct RoadmapTableView;
+    friend struct RoadmapLazyTables;
 };
 
 /*
@@ -308,6 +355,9 @@ public:
 
     friend QDataStream& operator << (QDataStream &out, Roadmap &project);
     friend QDataStream& operator >> (QDataStream &in, Roadmap &project);
+    friend struct RoadmapTables;
+    friend struct RoadmapTableView;
+    friend struct RoadmapLazyTables;
 };
 
 /*
@@ -327,6 +377,43 @@ class Roadmap : QObject
      */
     QList<RoadmapProject*> Projects;
 
+    /*
+     * Indice temporale di tutti i project element della Roadmap
+     */
+    RoadmapTimeline Timeline;
+
+    /*
+     * File mappato in memoria da cui puntano i nomi caricati
+     * (Vedi RoadmapTables::load), nullptr se i nomi sono copie
+     */
+    QFile* Mapping = nullptr;
+
+    /*
+     * Contenuto del file mappato in cui puntano i nomi e le tabelle del caricamento pigro:
+     * una vista sulla mappatura, o una sua copia in memoria dopo detachMapping()
+     */
+    QByteArray Mapped;
+
+    /*
+     * Indice dei progetti non ancora caricati, nullptr se è tutto caricato
+     */
+    RoadmapLazyTables* Lazy = nullptr;
+
+    /*
+     * Il caricamento pigro ha trovato record non validi nel file (Vedi RoadmapLazyTables::load)
+     */
+    bool Damaged = false;
+
+    /*
+     * Il file da cui è stata caricata la Roadmap aveva le tabelle compresse
+     */
+    bool Compressed = false;
+
+    /*
+     * Journal che registra le modifiche (Vedi RoadmapJournal), non posseduto
+     */
+    RoadmapJournal* Journal = nullptr;
+
 public:
     /*
      * Il parent dell'oggetto per assicurare il destroy
@@ -370,12 +457,83 @@ public:
 	void movPrevPosition(RoadmapProject* project);
 
     /*
-     * Trova un project element a partire dal suo Id
+     * Trova un project element a partire dal suo Id (tra quelli caricati)
      */
 	RoadmapProjectElement* findElementById(int id) const;
 
+    /*
+     * Interrogazioni sull'indice temporale:
+     *  - elementsBetween ritorna gli elementi attivi tra from e to (estremi inclusi)
+     *  - elementsAt ritorna gli elementi attivi in un certo giorno
+     * I risultati sono ordinati per data di partenza
+     */
+	QList<RoadmapProjectElement*> elementsBetween(const QDate& from, const QDate& to) const;
+	QList<RoadmapProjectElement*> elementsAt(const QDate& date) const;
+
+    /*
+     * Primo e ultimo giorno occupati da un elemento della Roadmap
+     */
+	QDate firstDate() const;
+	QDate lastDate() const;
+
+    /*
+     * Copia i nomi che puntano nel file mappato e rilascia il file, va chiamata prima
+     * di sovrascriverlo con operator << (carica anche tutti i progetti).
+     * RoadmapSaver non ne ha bisogno (Vedi detachMapping)
+     */
+	void unmap();
+
+    /*
+     * Indica se i nomi puntano ancora nel file mappato (o nella sua copia, Vedi detachMapping)
+     */
+	bool isMapped() const;
+
+    /*
+     * Indica se il file path è quello mappato, che quindi non può essere sostituito
+     * su tutti i sistemi (Vedi RoadmapSaver)
+     */
+	bool isMappedFrom(const QString& path) const;
+
+    /*
+     * Sposta i nomi e le tabelle del caricamento pigro in copy, una copia del contenuto
+     * del file mappato, e rilascia il file. Costa quanto i progetti e gli elementi caricati,
+     * non quanto il file: la copia la fa chi chiama, anche su un altro thread
+     */
+	void detachMapping(const QByteArray& copy);
+
+    /*
+     * Carica gli elementi di tutti i progetti non ancora caricati
+     */
+	void loadAll();
+
+    /*
+     * Indica se caricando sono stati trovati record non validi: sono diventati task senza nome
+     * e i link non validi sono stati scartati, salvare li sostituisce nel file.
+     * acceptDamage() toglie il segno quando l'utente ha accettato di salvare così
+     */
+	bool isDamaged() const;
+	void acceptDamage();
+
+    /*
+     * Indica se il file letto aveva le tabelle compresse (RoadmapFileHeader::Compressed),
+     * la finestra ne riprende l'impostazione per i salvataggi successivi
+     */
+	bool isCompressed() const;
+
+    /*
+     * Imposta il journal a cui ogni metodo che modifica la Roadmap segnala la modifica,
+     * nullptr per non registrare (ad esempio durante il caricamento)
+     */
+	void setJournal(RoadmapJournal* journal);
+	RoadmapJournal* journal() const;
+
+    friend class RoadmapProject;
+    friend class RoadmapProjectElement;
 	friend QDataStream& operator << (QDataStream &out, Roadmap &project);
 	friend QDataStream& operator >> (QDataStream &in, Roadmap &project);
+    friend struct RoadmapTables;
+    friend struct RoadmapTableView;
+    friend struct RoadmapLazyTables;
 };
 
 /*
@@ -0,0 +1,189 @@
+/*
+ * Renderer a riga di comando: carica un file .ropl e lo esporta in PNG, SVG o PDF
+ * senza finestra principale, toolbar o display (piattaforma offscreen di Qt).
+ *
+ *   RoadmapPlanetCli [--from yyyy-MM-dd] [--to yyyy-MM-dd] [--zoom px] [--dpi dpi] <input.ropl> <output>
+ *
+ * Il Gantt viene costruito come in RoadmapMainWnd::setupGantt (stessa view, delegate e grid)
+ * ed esportato con RoadmapPrinter: PNG e SVG su una sola pagina grande quanto la finestra
+ * di date richiesta (il PNG viene scritto a fasce), PDF su più pagine A4 orizzontali.
+ */
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QPainter>
+#include <QPrinter>
+#include <QSvgGenerator>
+#include <QTreeView>
+#include <QGraphicsScene>
+#include <KDGantt>
+#include <KDGanttGlobal>
+#include "Roadmap.hpp"
+#include "RoadmapModel.hpp"
+#include "RoadmapView.hpp"
+#include "RoadmapGrid.hpp"
+#include "RoadmapItemDelegate.hpp"
+#include "RoadmapPrinter.hpp"
+#include "RoadmapJournal.hpp"
+
+#define ScreenDpi 96 // Risoluzione delle misure della chart
+#define RenderWidth 1280 // Dimensione della finestra offscreen, non limita l'area esportata
+#define RenderHeight 800
+
+static int fail(const QString& message)
+{
+	QTextStream(stderr) << message << endl;
+	return 1;
+}
+
+static bool renderSvg(RoadmapPrinter& exporter, const QString& path)
+{
+	const RoadmapPageLayout layout = exporter.fit(ScreenDpi);
+	if (layout.pages() == 0)
+		return false;
+
+	const QSizeF size(layout.LabelWidth + layout.PageWidth, layout.HeaderHeight + layout.PageHeight + layout.FooterHeight);
+
+	QSvgGenerator svg;
+	svg.setFileName(path);
+	svg.setResolution(ScreenDpi);
+	svg.setSize(size.toSize());
+	svg.setViewBox(QRectF(QPointF(), size));
+	svg.setTitle(QFileInfo(path).completeBaseName());
+
+	QPainter painter;
+	if (!painter.begin(&svg))
+		return false;
+
+	exporter.paintPage(&painter, layout, 0);
+	return painter.end();
+}
+
+static bool renderPdf(RoadmapPrinter& exporter, const QString& path)
+{
+    // Stesse impostazioni dell'esportazione dalla finestra principale
+	QPrinter printer(QPrinter::HighResolution);
+	printer.setOrientation(QPrinter::Landscape);
+	printer.setColorMode(QPrinter::Color);
+	printer.setPageMargins(0.2, 0.2, 0.2, 0.2, QPrinter::Point);
+	printer.setOutputFormat(QPrinter::PdfFormat);
+	printer.setOutputFileName(path);
+
+	return exporter.print(&printer);
+}
+
+int main(int argc, char *argv[])
+{
+    // Senza display uso la piattaforma offscreen, a meno che non ne sia stata scelta un'altra
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv); // KDGantt è fatto di widget, serve comunque una QApplication
+	QApplication::setApplicationName("RoadmapPlanetCli");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Renders a Roadmap Planet file to PNG, SVG or PDF.");
+	parser.addHelpOption();
+	parser.addPositionalArgument("input", "Roadmap file (.ropl).");
+	parser.addPositionalArgument("output", "Destination file (.png, .svg or .pdf).");
+
+	const QCommandLineOption fromOption("from", "First date to render (yyyy-MM-dd), defaults to the start of the roadmap.", "date");
+	const QCommandLineOption toOption("to", "Last date to render (yyyy-MM-dd), defaults to the end of the roadmap.", "date");
+	const QCommandLineOption zoomOption("zoom", "Zoom in pixels per day.", "pixels", "20");
+	const QCommandLineOption dpiOption("dpi", "Resolution of PNG output.", "dpi", QString::number(ScreenDpi));
+	const QCommandLineOption formatOption("format", "Output format (png, svg or pdf), defaults to the output extension.", "format");
+	parser.addOptions({ fromOption, toOption, zoomOption, dpiOption, formatOption });
+	parser.process(app);
+
+	const QStringList args = parser.positionalArguments();
+	if (args.count() != 2)
+		parser.showHelp(1);
+
+	const QString format = parser.isSet(formatOption) ? parser.value(formatOption).toLower() : QFileInfo(args.at(1)).suffix().toLower();
+	if (format != "png" && format != "svg" && format != "pdf")
+		return fail(QString("Unknown output format '%1'.").arg(format));
+
+	bool ok = false;
+	const qreal zoom = parser.value(zoomOption).toDouble(&ok);
+	if (!ok || zoom <= 0.)
+		return fail("Invalid zoom.");
+
+	const int dpi = parser.value(dpiOption).toInt(&ok);
+	if (!ok || dpi <= 0)
+		return fail("Invalid resolution.");
+
+	const QDate from = QDate::fromString(parser.value(fromOption), Qt::ISODate);
+	const QDate to = QDate::fromString(parser.value(toOption), Qt::ISODate);
+	if ((parser.isSet(fromOption) && !from.isValid()) || (parser.isSet(toOption) && !to.isValid()))
+		return fail("Invalid date, expected yyyy-MM-dd.");
+
+    /*
+     * Carico la Roadmap prima di costruire il modello, i file v2 vengono mappati in memoria.
+     * Il journal va riapplicato come nella finestra principale, altrimenti le modifiche
+     * dei salvataggi incrementali non finirebbero nell'esportazione
+     */
+	Roadmap rmap;
+	try {
+		if (!RoadmapJournal::load(args.at(0), rmap))
+			return fail(QString("Cannot open '%1'.").arg(args.at(0)));
+	}
+	catch (std::exception&)
+	{
+		return fail(QString("An error occured loading '%1'.").arg(args.at(0)));
+	}
+	rmap.loadAll(); // L'esportazione mostra tutte le righe, il caricamento pigro non serve
+	if (rmap.isDamaged())
+		QTextStream(stderr) << QString("Some elements of '%1' could not be read.").arg(args.at(0)) << endl;
+
+    /*
+     * Costruisco il Gantt come RoadmapMainWnd::setupGantt, il widget non viene mai
+     * mostrato su un display ma va comunque impaginato perché il row controller
+     * ricava la geometria delle righe dalla treeview
+     */
+	RoadmapModel model(&rmap);
+	KDGantt::View gantt;
+	auto view = new RoadmapView();
+	gantt.setGraphicsView(view);
+	gantt.setItemDelegate(new RoadmapItemDelegate(&gantt));
+
+	RoadmapGrid* grid = new RoadmapGrid(&gantt);
+	grid->setFreeDays(QSet<Qt::DayOfWeek>() << Qt::Saturday << Qt::Sunday);
+	gantt.setGrid(grid);
+
+	gantt.setModel(&model);
+	gantt.setConstraintModel(model.constraintModel());
+	reinterpret_cast<QTreeView*>(gantt.leftView())->expandAll();
+
+	grid->zoomTo(zoom);
+	gantt.resize(RenderWidth, RenderHeight);
+	gantt.show();
+	model.emitChanged();
+	QApplication::processEvents();
+
+	RoadmapPrinter exporter(view);
+
+    // La finestra di date diventa un intervallo della chart, l'ultimo giorno è incluso
+	if (from.isValid() || to.isValid()) {
+		const QRectF scene = view->scene()->sceneRect();
+		const qreal left = from.isValid() ? grid->mapToChart(QDateTime(from)) : scene.left();
+		const qreal right = to.isValid() ? grid->mapToChart(QDateTime(to.addDays(1))) : scene.right();
+		if (right <= left)
+			return fail("The date window is empty.");
+
+		exporter.setRange(left, right);
+	}
+
+	bool done = false;
+	if (format == "png")
+		done = exporter.exportStream(args.at(1), dpi); // A fasce, la memoria non dipende dall'altezza dell'immagine
+	else if (format == "svg")
+		done = renderSvg(exporter, args.at(1));
+	else
+		done = renderPdf(exporter, args.at(1));
+
+	if (!done)
+		return fail(QString("An error occured rendering '%1'.").arg(args.at(1)));
+
+	return 0;
+}
@@ -0,0 +1,964 @@
+#include "RoadmapFormat.hpp"
+#include "Roadmap.hpp"
+#include <QDataStream>
+#include <QIODevice>
+#include <QHash>
+#include <QFile>
+#include <QScopedPointer>
+#include <QtEndian>
+#include <QtConcurrent>
+#include "Utility.hpp"
+#include <cstring>
+#include <cstddef>
+#include <limits>
+
+Q_STATIC_ASSERT(sizeof(RoadmapFileHeader) == 44);
+Q_STATIC_ASSERT(sizeof(RoadmapProjectRecord) == 64);
+Q_STATIC_ASSERT(sizeof(RoadmapElementRecord) == 32);
+Q_STATIC_ASSERT(sizeof(RoadmapBlockHeader) == 8);
+
+#define WriteChunk (1024 * 1024) // Byte scritti tra due notifiche di avanzamento
+#define CompressBlock (1024 * 1024) // Byte delle tabelle in un blocco compresso
+#define CompressLevel 1 // Livello zlib: il più veloce, la decompressione costa uguale
+
+/*
+ * Su disco i record sono little endian, sugli host big endian li giro campo per campo
+ * (la stessa funzione serve in scrittura e in lettura), sugli altri non fanno nulla
+ */
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+static void swap(RoadmapFileHeader& h)
+{
+	quint32* fields = reinterpret_cast<quint32*>(&h);
+	for (size_t i = 0; i < sizeof(h) / sizeof(quint32); i++)
+		fields[i] = qbswap(fields[i]);
+}
+
+static void swap(RoadmapProjectRecord& r)
+{
+	quint32* fields = reinterpret_cast<quint32*>(&r);
+	for (size_t i = 0; i < offsetof(RoadmapProjectRecord, ElementOffset) / sizeof(quint32); i++)
+		fields[i] = qbswap(fields[i]);
+
+	r.ElementOffset = qbswap(r.ElementOffset);
+	r.StartDay = qbswap(r.StartDay);
+	r.EndDay = qbswap(r.EndDay);
+	r.LastDay = qbswap(r.LastDay);
+	r.MaxId = qbswap(r.MaxId);
+	r.Reserved = qbswap(r.Reserved);
+}
+
+static void swap(RoadmapElementRecord& r)
+{
+	r.JulianDay = qbswap(r.JulianDay);
+	r.Id = qbswap(r.Id);
+	r.Type = qbswap(r.Type);
+	r.Days = qbswap(r.Days);
+	r.Flags = qbswap(r.Flags);
+	r.NameOffset = qbswap(r.NameOffset);
+	r.NameLength = qbswap(r.NameLength);
+}
+
+static void swap(quint32& v)
+{
+	v = qbswap(v);
+}
+
+static void swap(ushort& v)
+{
+	v = qbswap(v);
+}
+
+template<typename T>
+static QVector<T> swapped(QVector<T> values)
+{
+	for (T& v : values)
+		swap(v);
+	return values;
+}
+#endif
+
+/*
+ * Scrive una tabella in blocco, a pezzi di WriteChunk byte se c'è da riportare l'avanzamento
+ */
+template<typename T>
+static bool writeTable(QDataStream& out, const QVector<T>& table, const RoadmapTables::Progress& progress, qint64& written, qint64 total)
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	const QVector<T> data = swapped(table);
+#else
+	const QVector<T>& data = table;
+#endif
+	const char* bytes = reinterpret_cast<const char*>(data.constData());
+	const qint64 size = qint64(data.count()) * qint64(sizeof(T));
+	const qint64 step = progress ? qint64(WriteChunk) : size;
+
+	for (qint64 offset = 0; offset < size; offset += step)
+	{
+		const int chunk = int(qMin(step, size - offset));
+		if (out.writeRawData(bytes + offset, chunk) != chunk)
+			return false;
+
+		written += chunk;
+		if (progress)
+			progress(written, total);
+	}
+
+	return true;
+}
+
+static QByteArray packBlock(const QByteArray& block)
+{
+	return qCompress(block, CompressLevel);
+}
+
+static QByteArray unpackBlock(const QByteArray& block)
+{
+	return qUncompress(block);
+}
+
+/*
+ * Scrive le tabelle (già serializzate in raw) a blocchi compressi: i blocchi vengono
+ * compressi in parallelo e scritti in ordine appena sono pronti
+ */
+static bool writeBlocks(QDataStream& out, const QByteArray& raw, const RoadmapTables::Progress& progress)
+{
+	QVector<QByteArray> blocks;
+	for (int offset = 0; offset < raw.size(); offset += CompressBlock)
+		blocks.append(QByteArray::fromRawData(raw.constData() + offset, qMin(CompressBlock, raw.size() - offset)));
+
+	QFuture<QByteArray> packed = QtConcurrent::mapped(blocks, packBlock);
+
+	qint64 written = 0;
+	for (int i = 0; i < blocks.count(); i++)
+	{
+		const QByteArray block = packed.resultAt(i);
+
+		RoadmapBlockHeader header;
+		header.RawSize = qToLittleEndian(quint32(blocks[i].size()));
+		header.PackedSize = qToLittleEndian(quint32(block.size()));
+
+		if (out.writeRawData(reinterpret_cast<const char*>(&header), sizeof(header)) != int(sizeof(header))
+			|| out.writeRawData(block.constData(), block.size()) != block.size())
+		{
+			packed.cancel();
+			packed.waitForFinished(); // I blocchi puntano in raw
+			return false;
+		}
+
+		written += blocks[i].size();
+		if (progress)
+			progress(written, raw.size());
+	}
+
+	return true;
+}
+
+/*
+ * Legge i blocchi compressi fino ad avere size byte di tabelle: ogni blocco letto
+ * viene decompresso sul pool mentre si legge il successivo, così la lettura dal
+ * disco (o dalla rete) e la decompressione si sovrappongono
+ */
+static bool readBlocks(QDataStream& in, qint64 size, QByteArray* raw)
+{
+	QVector<QFuture<QByteArray>> blocks;
+	QVector<quint32> sizes;
+	qint64 expected = 0;
+	bool ok = true;
+
+	while (expected < size)
+	{
+		RoadmapBlockHeader header;
+		if (in.readRawData(reinterpret_cast<char*>(&header), sizeof(header)) != int(sizeof(header))) {
+			ok = false;
+			break;
+		}
+
+		const quint32 rawSize = qFromLittleEndian(header.RawSize);
+		const quint32 packedSize = qFromLittleEndian(header.PackedSize);
+		if (rawSize == 0 || rawSize > size - expected || packedSize < sizeof(quint32) || packedSize > quint32(std::numeric_limits<int>::max())
+			|| (in.device() != nullptr && !in.device()->isSequential() && packedSize > in.device()->bytesAvailable())) {
+			ok = false;
+			break;
+		}
+
+		QByteArray packed(int(packedSize), Qt::Uninitialized);
+		if (in.readRawData(packed.data(), packed.size()) != packed.size()
+			|| qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(packed.constData())) != rawSize) {
+			ok = false;
+			break;
+		}
+
+		blocks.append(QtConcurrent::run(unpackBlock, packed));
+		sizes.append(rawSize);
+		expected += rawSize;
+	}
+
+	raw->reserve(int(expected));
+	for (int i = 0; i < blocks.count(); i++) // Aspetto comunque tutti i blocchi avviati
+	{
+		const QByteArray block = blocks[i].result();
+		if (block.size() != int(sizes[i]))
+			ok = false;
+		else if (ok)
+			raw->append(block);
+	}
+
+	return ok;
+}
+
+/*
+ * Legge count record di stride byte, con una sola lettura se lo stride coincide
+ * con il record conosciuto, altrimenti copiando la parte nota di ogni record
+ */
+template<typename T>
+static bool readTable(QDataStream& in, QVector<T>& table, quint32 count, quint32 stride)
+{
+	table.resize(int(count));
+	if (count == 0)
+		return true;
+
+	if (stride == sizeof(T)) {
+		const int bytes = int(count * sizeof(T));
+		if (in.readRawData(reinterpret_cast<char*>(table.data()), bytes) != bytes)
+			return false;
+	}
+	else {
+		QByteArray raw(int(count * stride), Qt::Uninitialized);
+		if (in.readRawData(raw.data(), raw.size()) != raw.size())
+			return false;
+
+		memset(table.data(), 0, count * sizeof(T)); // I campi che il file non ha restano a 0
+		for (quint32 i = 0; i < count; i++)
+			memcpy(&table[int(i)], raw.constData() + i * stride, qMin<size_t>(stride, sizeof(T)));
+	}
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	for (T& v : table)
+		swap(v);
+#endif
+	return true;
+}
+
+RoadmapTables RoadmapTables::build(const Roadmap& rmap)
+{
+	return build(capture(rmap));
+}
+
+RoadmapCapture RoadmapTables::capture(const Roadmap& rmap)
+{
+	RoadmapCapture capture;
+
+	if (rmap.Lazy != nullptr) {
+		capture.View = rmap.Lazy->View;
+		capture.Loaded = rmap.Lazy->Elements; // Condivisa finché il caricamento pigro non la modifica
+	}
+	capture.Mapped = rmap.Mapped;
+
+	const QList<RoadmapProject*> projects = rmap.projects();
+	capture.Projects.reserve(projects.count());
+	for (RoadmapProject* pro : projects)
+	{
+		RoadmapCapture::Project p;
+		p.Name = pro->Name;
+		p.Color = pro->Color;
+
+		if (!pro->isLoaded()) {
+			p.Record = pro->Record; // Gli elementi li legge build() dal file
+			capture.Projects.append(p);
+			continue;
+		}
+
+		p.Elements.reserve(pro->Elements.count());
+		for (RoadmapProjectElement* element : pro->Elements)
+		{
+			RoadmapCapture::Element e;
+			e.Key = element;
+			e.Date = element->Date;
+			e.Id = element->Id;
+			e.Type = quint32(element->type());
+			e.Days = element->type() == PROJECT_TASK ? static_cast<RoadmapTask*>(element)->Days : 0;
+			e.Delivered = element->type() == PROJECT_MILESTONE && static_cast<RoadmapMilestone*>(element)->Delivered;
+			e.Name = element->Name;
+			e.Childs = element->Childs;
+			p.Elements.append(e);
+		}
+
+		capture.Projects.append(p);
+	}
+
+	return capture;
+}
+
+RoadmapTables RoadmapTables::build(const RoadmapCapture& capture)
+{
+	RoadmapTables tables;
+	const RoadmapTableView& view = capture.View;
+
+	QHash<const RoadmapProjectElement*, quint32> indexes; // Indice nella tabella degli elementi fotografati
+	QVector<qint64> moved(int(view.ElementCount), -1); // Indice dei record dei progetti non caricati
+
+	tables.Projects.reserve(capture.Projects.count());
+	for (const RoadmapCapture::Project& pro : capture.Projects)
+	{
+		RoadmapProjectRecord p;
+		memset(&p, 0, sizeof(p));
+		p.NameOffset = tables.addString(pro.Name, &p.NameLength);
+		p.Color = pro.Color.rgba();
+		p.FirstElement = quint32(tables.Elements.count());
+		p.Flags = pro.Color.isValid() ? RoadmapProjectRecord::ColorValid : 0;
+
+		if (pro.Record >= 0)
+		{
+            /*
+             * Progetto non caricato: i record passano dal file così come sono, anche l'indice
+             * (date e id) non cambia. I record non validi vengono corretti come in RoadmapTableView::create
+             */
+			const RoadmapProjectRecord& source = view.project(quint32(pro.Record));
+			p.ElementCount = source.ElementCount;
+			p.StartDay = source.StartDay;
+			p.EndDay = source.EndDay;
+			p.LastDay = source.LastDay;
+			p.MaxId = source.MaxId;
+			tables.Projects.append(p);
+
+			for (quint32 i = source.FirstElement; i < source.FirstElement + source.ElementCount; i++)
+			{
+				RoadmapElementRecord e = view.element(i);
+				const QString name = quint64(e.NameOffset) + e.NameLength <= view.StringLength ? view.string(e.NameOffset, e.NameLength) : QString();
+				e.Type = e.Type == PROJECT_MILESTONE ? quint32(PROJECT_MILESTONE) : quint32(PROJECT_TASK);
+				e.NameOffset = tables.addString(name, &e.NameLength);
+
+				moved[int(i)] = tables.Elements.count();
+				tables.Elements.append(e);
+			}
+			continue;
+		}
+
+        // Date dell'indice calcolate come RoadmapProject::startDate, endDate e come RoadmapTimeline::endOf
+		p.ElementCount = quint32(pro.Elements.count());
+		QDate start = QDate::fromJulianDay(maxJd()), end = QDate::fromJulianDay(minJd()), last;
+		bool started = false, ended = false;
+		for (const RoadmapCapture::Element& element : pro.Elements)
+		{
+			const QDate finish = element.Type == PROJECT_TASK ? element.Date.addDays(element.Days) : element.Date;
+			if (element.Date < start) {
+				start = element.Date;
+				started = true;
+			}
+			if (element.Type == PROJECT_TASK && finish > end) {
+				end = finish;
+				ended = true;
+			}
+			if (element.Date.isValid() && (!last.isValid() || finish > last))
+				last = finish;
+			p.MaxId = qMax(p.MaxId, element.Id);
+		}
+		p.StartDay = (started ? start : QDate()).toJulianDay();
+		p.EndDay = (ended ? end : QDate()).toJulianDay();
+		p.LastDay = last.toJulianDay();
+		tables.Projects.append(p);
+
+		for (const RoadmapCapture::Element& element : pro.Elements)
+		{
+			RoadmapElementRecord e;
+			e.JulianDay = element.Date.toJulianDay();
+			e.Id = element.Id;
+			e.Type = element.Type;
+			e.Days = element.Days;
+			e.Flags = element.Delivered ? RoadmapElementRecord::Delivered : 0;
+			e.NameOffset = tables.addString(element.Name, &e.NameLength);
+
+			indexes.insert(element.Key, quint32(tables.Elements.count()));
+			tables.Elements.append(e);
+		}
+	}
+
+    // Offset in byte degli elementi di ogni progetto, con gli stride che userà write()
+	const quint64 elements = sizeof(RoadmapFileHeader) + quint64(tables.Projects.count()) * sizeof(RoadmapProjectRecord);
+	for (RoadmapProjectRecord& p : tables.Projects)
+		p.ElementOffset = elements + quint64(p.FirstElement) * sizeof(RoadmapElementRecord);
+
+    // Record da cui sono stati creati gli elementi caricati, per i loro link verso i progetti non caricati
+	QHash<const RoadmapProjectElement*, quint32> records;
+	for (int i = 0; i < capture.Loaded.count(); i++)
+	{
+		if (capture.Loaded.at(i) != nullptr)
+			records.insert(capture.Loaded.at(i), quint32(i));
+	}
+
+    /*
+     * Link: per ogni elemento la sua fetta di target, in ordine. Un record del file punta
+     * ad un record non caricato (spostato) o ad un elemento caricato, se esiste ancora
+     */
+	auto target = [&](quint32 record) -> qint64
+	{
+		if (moved.at(int(record)) >= 0)
+			return moved.at(int(record));
+
+		auto it = indexes.constFind(capture.Loaded.at(int(record)));
+		return it != indexes.constEnd() ? qint64(it.value()) : -1;
+	};
+
+	tables.LinkOffsets.reserve(tables.Elements.count() + 1);
+	for (const RoadmapCapture::Project& pro : capture.Projects)
+	{
+		if (pro.Record >= 0)
+		{
+			const RoadmapProjectRecord& source = view.project(quint32(pro.Record));
+			for (quint32 i = source.FirstElement; i < source.FirstElement + source.ElementCount; i++)
+			{
+				tables.LinkOffsets.append(quint32(tables.LinkTargets.count()));
+				if (!view.isValidLinks(i))
+					continue;
+
+				for (quint32 l = view.LinkOffsets[i]; l < view.LinkOffsets[i + 1]; l++)
+				{
+					const qint64 child = view.LinkTargets[l] != i ? target(view.LinkTargets[l]) : -1;
+					if (child >= 0)
+						tables.LinkTargets.append(quint32(child));
+				}
+			}
+			continue;
+		}
+
+		for (const RoadmapCapture::Element& element : pro.Elements)
+		{
+			tables.LinkOffsets.append(quint32(tables.LinkTargets.count()));
+			for (RoadmapProjectElement* child : element.Childs)
+			{
+				auto it = indexes.constFind(child);
+				if (it != indexes.constEnd())
+					tables.LinkTargets.append(it.value());
+			}
+
+            // I link del file verso i progetti non caricati non sono ancora agganciati (Vedi RoadmapLazyTables::load)
+			auto record = records.constFind(element.Key);
+			if (record == records.constEnd() || !view.isValidLinks(record.value()))
+				continue;
+
+			for (quint32 l = view.LinkOffsets[record.value()]; l < view.LinkOffsets[record.value() + 1]; l++)
+			{
+				const qint64 child = moved.at(int(view.LinkTargets[l]));
+				if (child >= 0)
+					tables.LinkTargets.append(quint32(child));
+			}
+		}
+	}
+	tables.LinkOffsets.append(quint32(tables.LinkTargets.count()));
+
+	return tables;
+}
+
+void RoadmapTables::restore(Roadmap& rmap) const
+{
+	view().restore(rmap);
+}
+
+RoadmapTableView RoadmapTables::view() const
+{
+	RoadmapTableView view;
+	view.Projects = reinterpret_cast<const uchar*>(Projects.constData());
+	view.ProjectCount = quint32(Projects.count());
+	view.ProjectStride = sizeof(RoadmapProjectRecord);
+	view.Elements = reinterpret_cast<const uchar*>(Elements.constData());
+	view.ElementCount = quint32(Elements.count());
+	view.ElementStride = sizeof(RoadmapElementRecord);
+	view.LinkOffsets = LinkOffsets.constData();
+	view.LinkTargets = LinkTargets.constData();
+	view.LinkCount = quint32(LinkTargets.count());
+	view.Strings = Strings.constData();
+	view.StringLength = quint32(Strings.length());
+	return view;
+}
+
+bool RoadmapTables::load(const QString& path, Roadmap& rmap)
+{
+	QScopedPointer<QFile> file(new QFile(path));
+	if (!file->open(QIODevice::ReadOnly))
+		return false;
+
+    // La magic string come la scrive QDataStream: lunghezza big endian (\0 incluso) e byte
+	const QByteArray magic = QByteArray("\0\0\0\x10", 4) + QByteArray(FormatMagicV2, 16);
+	const qint64 size = file->size();
+
+	uchar* data = size > magic.size() ? file->map(0, size) : nullptr;
+	if (data != nullptr)
+	{
+		RoadmapTableView view;
+		if (memcmp(data, magic.constData(), size_t(magic.size())) == 0 && view.parse(data + magic.size(), size - magic.size()))
+		{
+			view.Shared = true;
+
+			/*
+			 * Creo subito solo i progetti, gli elementi verranno creati
+			 * quando servono (Vedi RoadmapLazyTables)
+			 */
+			RoadmapLazyTables* lazy = new RoadmapLazyTables();
+			lazy->View = view;
+			lazy->Elements.fill(nullptr, int(view.ElementCount));
+
+			for (quint32 pi = 0; pi < view.ProjectCount; pi++)
+			{
+				const RoadmapProjectRecord& p = view.project(pi);
+
+				RoadmapProject* pro = rmap.addProject();
+				pro->Name = view.string(p.NameOffset, p.NameLength);
+				pro->Color = p.Flags & RoadmapProjectRecord::ColorValid ? QColor::fromRgba(p.Color) : QColor();
+				pro->Record = p.ElementCount > 0 ? int(pi) : -1; // Senza elementi il progetto è già caricato
+				lazy->MaxId = qMax(lazy->MaxId, p.MaxId);
+			}
+
+			delete rmap.Lazy;
+			rmap.Lazy = lazy;
+
+			delete rmap.Mapping;
+			rmap.Mapping = file.take(); // I nomi puntano nel file, resta mappato finché vive la Roadmap
+			rmap.Mapped = size <= std::numeric_limits<int>::max() // Oltre QByteArray non arriva (Vedi RoadmapSaver)
+				? QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(size)) : QByteArray();
+			return true;
+		}
+
+		file->unmap(data);
+	}
+
+    // File v1, compresso, host big endian o file non mappabile: lettura a flusso
+	file->seek(0);
+	QDataStream stream(file.data());
+	stream >> rmap;
+	return true;
+}
+
+const RoadmapProjectRecord& RoadmapTableView::project(quint32 index) const
+{
+	return *reinterpret_cast<const RoadmapProjectRecord*>(Projects + quint64(index) * ProjectStride);
+}
+
+const RoadmapElementRecord& RoadmapTableView::element(quint32 index) const
+{
+	return *reinterpret_cast<const RoadmapElementRecord*>(Elements + quint64(index) * ElementStride);
+}
+
+QString RoadmapTableView::string(quint32 offset, quint32 length) const
+{
+	if (Shared)
+		return QString::fromRawData(Strings + offset, int(length));
+
+	return QString(Strings + offset, int(length));
+}
+
+bool RoadmapTableView::parse(const uchar* data, qint64 size)
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	Q_UNUSED(data);
+	Q_UNUSED(size);
+	return false; // I record vanno girati, la vista non può leggerli sul posto
+#else
+	RoadmapFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(&header, data, size_t(qMin<qint64>(size, sizeof(header))));
+
+	if (header.HeaderSize < sizeof(quint32) * 8 || header.HeaderSize > size)
+		return false;
+
+	if (header.Flags & RoadmapFileHeader::Compressed)
+		return false; // I blocchi vanno decompressi, non si possono leggere sul posto
+
+	if (header.ProjectStride < sizeof(RoadmapProjectRecord) || header.ElementStride < sizeof(RoadmapElementRecord)
+		|| header.ProjectStride % Q_ALIGNOF(RoadmapProjectRecord) != 0 || header.ElementStride % Q_ALIGNOF(RoadmapElementRecord) != 0)
+		return false;
+
+	const qint64 projects = qint64(header.ProjectCount) * header.ProjectStride;
+	const qint64 elements = qint64(header.ElementCount) * header.ElementStride;
+	const qint64 links = (qint64(header.ElementCount) + 1 + header.LinkCount) * qint64(sizeof(quint32));
+	const qint64 strings = qint64(header.StringLength) * qint64(sizeof(QChar));
+	if (header.HeaderSize + projects + elements + links + strings > size)
+		return false;
+
+	const uchar* p = data + header.HeaderSize;
+	Projects = p;
+	ProjectCount = header.ProjectCount;
+	ProjectStride = header.ProjectStride;
+	p += projects;
+
+	Elements = p;
+	ElementCount = header.ElementCount;
+	ElementStride = header.ElementStride;
+	p += elements;
+
+	LinkOffsets = reinterpret_cast<const quint32*>(p);
+	LinkTargets = LinkOffsets + header.ElementCount + 1;
+	LinkCount = header.LinkCount;
+	p += links;
+
+	Strings = reinterpret_cast<const QChar*>(p);
+	StringLength = header.StringLength;
+
+    // I record vengono letti sul posto, devono essere allineati
+	if (quintptr(Projects) % Q_ALIGNOF(RoadmapProjectRecord) != 0 || quintptr(Elements) % Q_ALIGNOF(RoadmapElementRecord) != 0
+		|| quintptr(LinkOffsets) % Q_ALIGNOF(quint32) != 0 || quintptr(Strings) % Q_ALIGNOF(QChar) != 0)
+		return false;
+
+	return isValidIndex(); // Gli elementi e i link vengono verificati quando un progetto viene caricato
+#endif
+}
+
+void RoadmapTableView::move(qptrdiff delta)
+{
+	Projects += delta;
+	Elements += delta;
+	LinkOffsets = reinterpret_cast<const quint32*>(reinterpret_cast<const uchar*>(LinkOffsets) + delta);
+	LinkTargets = reinterpret_cast<const quint32*>(reinterpret_cast<const uchar*>(LinkTargets) + delta);
+	Strings = reinterpret_cast<const QChar*>(reinterpret_cast<const uchar*>(Strings) + delta);
+}
+
+RoadmapProjectElement* RoadmapTableView::create(RoadmapProject* project, quint32 index) const
+{
+	const RoadmapElementRecord& e = element(index);
+	RoadmapProjectElement* created = nullptr;
+
+	if (e.Type == PROJECT_MILESTONE)
+	{
+		RoadmapMilestone* mile = new RoadmapMilestone(project, e.Id);
+		mile->Delivered = (e.Flags & RoadmapElementRecord::Delivered) != 0;
+		created = mile;
+	}
+	else
+	{
+		RoadmapTask* task = new RoadmapTask(project, e.Id);
+		task->Days = e.Days;
+		created = task;
+	}
+
+	created->Name = quint64(e.NameOffset) + e.NameLength <= StringLength ? string(e.NameOffset, e.NameLength) : QString();
+	created->Date = QDate::fromJulianDay(e.JulianDay);
+	return created;
+}
+
+void RoadmapTableView::restore(Roadmap& rmap) const
+{
+	QVector<RoadmapProjectElement*> elements(int(ElementCount)); // Elementi creati, per indice
+
+	for (quint32 pi = 0; pi < ProjectCount; pi++)
+	{
+		const RoadmapProjectRecord& p = project(pi);
+
+		RoadmapProject* pro = rmap.addProject();
+		pro->Name = string(p.NameOffset, p.NameLength);
+		pro->Color = p.Flags & RoadmapProjectRecord::ColorValid ? QColor::fromRgba(p.Color) : QColor();
+		pro->Elements.reserve(int(p.ElementCount));
+
+		for (quint32 i = p.FirstElement; i < p.FirstElement + p.ElementCount; i++)
+		{
+			RoadmapProjectElement* created = create(pro, i);
+			pro->Elements.append(created);
+			rmap.Timeline.insert(created);
+			elements[int(i)] = created;
+		}
+	}
+
+    // I link sono già indici: nessuna ricerca per id
+	for (quint32 i = 0; i < ElementCount; i++)
+	{
+		RoadmapProjectElement* parent = elements.at(int(i));
+		parent->Childs.reserve(int(LinkOffsets[i + 1] - LinkOffsets[i]));
+		for (quint32 l = LinkOffsets[i]; l < LinkOffsets[i + 1]; l++)
+		{
+			RoadmapProjectElement* child = elements.at(int(LinkTargets[l]));
+			if (child != parent)
+				parent->Childs.append(child);
+		}
+	}
+}
+
+void RoadmapLazyTables::load(Roadmap& rmap, RoadmapProject* project)
+{
+	const RoadmapProjectRecord& p = record(project);
+	const quint32 first = p.FirstElement;
+	const quint32 last = p.FirstElement + p.ElementCount; // Escluso
+
+	/*
+	 * All'apertura sono stati verificati solo l'intestazione e l'indice dei progetti,
+	 * i record del progetto vengono verificati adesso: un record non valido diventa
+	 * un task senza nome (create() non esce dal pool), i link non validi vengono scartati.
+	 * Il modello ha già annunciato le righe, quindi il progetto viene caricato comunque
+	 * e la Roadmap viene segnata come danneggiata (Vedi Roadmap::isDamaged)
+	 */
+	if (!View.isValidElements(first, last))
+		rmap.Damaged = true;
+
+	project->Elements.reserve(int(p.ElementCount));
+	for (quint32 i = first; i < last; i++)
+	{
+		RoadmapProjectElement* created = View.create(project, i);
+		project->Elements.append(created);
+		rmap.Timeline.insert(created);
+		Elements[int(i)] = created;
+		Records.insert(created, i);
+	}
+	project->Record = -1;
+
+    // Link dagli elementi appena creati verso quelli che esistono già (o appena creati)
+	for (quint32 i = first; i < last; i++)
+	{
+		if (!View.isValidLinks(i))
+			continue; // Già segnalato da isValidElements
+
+		RoadmapProjectElement* parent = Elements.at(int(i));
+		for (quint32 l = View.LinkOffsets[i]; l < View.LinkOffsets[i + 1]; l++)
+		{
+			RoadmapProjectElement* child = Elements.at(int(View.LinkTargets[l]));
+			if (child != nullptr && child != parent && !parent->Childs.contains(child))
+				parent->Childs.append(child); // Non con addChild: caricare non è una modifica
+		}
+	}
+
+    /*
+     * Link dagli elementi caricati prima verso quelli appena creati: l'indice inverso dà
+     * direttamente chi punta ogni nuovo elemento, senza scorrere tutti gli elementi caricati
+     */
+	if (!buildIncoming())
+		rmap.Damaged = true;
+
+	for (quint32 i = first; i < last; i++)
+	{
+		RoadmapProjectElement* child = Elements.at(int(i));
+		for (quint32 l = IncomingOffsets[int(i)]; l < IncomingOffsets[int(i) + 1]; l++)
+		{
+			const quint32 source = IncomingSources[int(l)];
+			if (source >= first && source < last)
+				continue; // Già agganciato sopra
+
+			RoadmapProjectElement* parent = Elements.at(int(source));
+			if (parent != nullptr && parent != child && !parent->Childs.contains(child))
+				parent->Childs.append(child);
+		}
+	}
+}
+
+bool RoadmapLazyTables::buildIncoming()
+{
+	if (!IncomingOffsets.isEmpty())
+		return IncomingValid;
+
+    // Conto i link entranti di ogni elemento, poi li trasformo in offset (gli elementi con link non validi non ne hanno)
+	IncomingValid = true;
+	IncomingOffsets.fill(0, int(View.ElementCount) + 1);
+	for (quint32 i = 0; i < View.ElementCount; i++)
+	{
+		if (!View.isValidLinks(i)) {
+			IncomingValid = false;
+			continue;
+		}
+
+		for (quint32 l = View.LinkOffsets[i]; l < View.LinkOffsets[i + 1]; l++)
+			IncomingOffsets[int(View.LinkTargets[l]) + 1]++;
+	}
+
+	for (int i = 1; i < IncomingOffsets.count(); i++)
+		IncomingOffsets[i] += IncomingOffsets[i - 1];
+
+    // Distribuisco le sorgenti, in ordine di elemento come la tabella dei link
+	QVector<quint32> next = IncomingOffsets;
+	IncomingSources.resize(int(IncomingOffsets.last()));
+	for (quint32 i = 0; i < View.ElementCount; i++)
+	{
+		if (!View.isValidLinks(i))
+			continue;
+
+		for (quint32 l = View.LinkOffsets[i]; l < View.LinkOffsets[i + 1]; l++)
+			IncomingSources[int(next[int(View.LinkTargets[l])]++)] = i;
+	}
+
+	return IncomingValid;
+}
+
+void RoadmapLazyTables::forget(const RoadmapProjectElement* element)
+{
+	auto it = Records.find(element);
+	if (it == Records.end())
+		return;
+
+	Elements[int(it.value())] = nullptr;
+	Records.erase(it);
+}
+
+const RoadmapProjectRecord& RoadmapLazyTables::record(const RoadmapProject* project) const
+{
+	return View.project(quint32(project->Record));
+}
+
+bool RoadmapTables::write(QDataStream& out, const Progress& progress, bool compressed) const
+{
+	RoadmapFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.HeaderSize = sizeof(RoadmapFileHeader);
+	header.ProjectCount = quint32(Projects.count());
+	header.ProjectStride = sizeof(RoadmapProjectRecord);
+	header.ElementCount = quint32(Elements.count());
+	header.ElementStride = sizeof(RoadmapElementRecord);
+	header.LinkCount = quint32(LinkTargets.count());
+	header.StringLength = quint32(Strings.length());
+	header.Flags = compressed ? RoadmapFileHeader::Compressed : 0;
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	swap(header);
+#endif
+	if (out.writeRawData(reinterpret_cast<const char*>(&header), sizeof(header)) != int(sizeof(header)))
+		return false;
+
+	QVector<ushort> strings(Strings.length());
+	memcpy(strings.data(), Strings.utf16(), Strings.length() * sizeof(ushort));
+
+	const qint64 total = qint64(Projects.count()) * qint64(sizeof(RoadmapProjectRecord))
+		+ qint64(Elements.count()) * qint64(sizeof(RoadmapElementRecord))
+		+ qint64(LinkOffsets.count() + LinkTargets.count()) * qint64(sizeof(quint32))
+		+ qint64(strings.count()) * qint64(sizeof(ushort));
+	qint64 written = 0;
+
+	if (!compressed)
+		return writeTable(out, Projects, progress, written, total)
+			&& writeTable(out, Elements, progress, written, total)
+			&& writeTable(out, LinkOffsets, progress, written, total)
+			&& writeTable(out, LinkTargets, progress, written, total)
+			&& writeTable(out, strings, progress, written, total);
+
+    // Compresso: serializzo le tabelle in memoria e le scrivo a blocchi (l'avanzamento è quello dei blocchi)
+	if (total > std::numeric_limits<int>::max())
+		return false;
+
+	QByteArray raw;
+	raw.reserve(int(total));
+	QDataStream buffer(&raw, QIODevice::WriteOnly);
+
+	return writeTable(buffer, Projects, Progress(), written, total)
+		&& writeTable(buffer, Elements, Progress(), written, total)
+		&& writeTable(buffer, LinkOffsets, Progress(), written, total)
+		&& writeTable(buffer, LinkTargets, Progress(), written, total)
+		&& writeTable(buffer, strings, Progress(), written, total)
+		&& writeBlocks(out, raw, progress);
+}
+
+bool RoadmapTables::read(QDataStream& in)
+{
+	RoadmapFileHeader header;
+	memset(&header, 0, sizeof(header));
+
+    // L'intestazione può essere più lunga di quella conosciuta, salto il resto
+	quint32 size = 0;
+	if (in.readRawData(reinterpret_cast<char*>(&size), sizeof(size)) != int(sizeof(size)))
+		return false;
+	size = qFromLittleEndian(size);
+	if (size < sizeof(quint32) * 8)
+		return false;
+
+	QByteArray raw(int(size - sizeof(quint32)), Qt::Uninitialized);
+	if (in.readRawData(raw.data(), raw.size()) != raw.size())
+		return false;
+
+	header.HeaderSize = size;
+	memcpy(reinterpret_cast<char*>(&header) + sizeof(quint32), raw.constData(), qMin<size_t>(raw.size(), sizeof(header) - sizeof(quint32)));
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	swap(header);
+	header.HeaderSize = size;
+#endif
+
+    // I record dei progetti senza indice (più corti) sono ammessi, l'indice resta a 0
+	if (header.ProjectStride < offsetof(RoadmapProjectRecord, ElementOffset) || header.ElementStride < sizeof(RoadmapElementRecord))
+		return false;
+
+    // Su un file non compresso controllo che le tabelle ci stiano prima di allocarle
+	const bool compressed = (header.Flags & RoadmapFileHeader::Compressed) != 0;
+	Compressed = compressed;
+	const qint64 needed = qint64(header.ProjectCount) * header.ProjectStride
+		+ qint64(header.ElementCount) * header.ElementStride
+		+ (qint64(header.ElementCount) + 1 + header.LinkCount) * sizeof(quint32)
+		+ qint64(header.StringLength) * sizeof(ushort);
+	if (!compressed && in.device() != nullptr && !in.device()->isSequential() && needed > in.device()->bytesAvailable())
+		return false;
+	if (needed > std::numeric_limits<int>::max())
+		return false;
+
+    // Le tabelle compresse vengono prima decompresse in memoria, poi lette come le altre
+	QByteArray unpacked;
+	if (compressed && !readBlocks(in, needed, &unpacked))
+		return false;
+
+	QDataStream blocks(unpacked);
+	QDataStream& tables = compressed ? blocks : in;
+
+	QVector<ushort> strings;
+	if (!readTable(tables, Projects, header.ProjectCount, header.ProjectStride)
+		|| !readTable(tables, Elements, header.ElementCount, header.ElementStride)
+		|| !readTable(tables, LinkOffsets, header.ElementCount + 1, sizeof(quint32))
+		|| !readTable(tables, LinkTargets, header.LinkCount, sizeof(quint32))
+		|| !readTable(tables, strings, header.StringLength, sizeof(ushort)))
+		return false;
+
+	Strings = QString(reinterpret_cast<const QChar*>(strings.constData()), strings.count());
+	return isValid();
+}
+
+bool RoadmapTables::isValid() const
+{
+	return LinkOffsets.count() == Elements.count() + 1 && view().isValid();
+}
+
+bool RoadmapTableView::isValid() const
+{
+	return isValidIndex() && isValidElements(0, ElementCount);
+}
+
+bool RoadmapTableView::isValidIndex() const
+{
+	if (LinkOffsets[0] != 0 || LinkOffsets[ElementCount] != LinkCount)
+		return false;
+
+	quint64 next = 0; // Gli elementi dei progetti devono essere contigui e coprire tutta la tabella
+	for (quint32 i = 0; i < ProjectCount; i++)
+	{
+		const RoadmapProjectRecord& p = project(i);
+		if (p.FirstElement != next || quint64(p.NameOffset) + p.NameLength > StringLength)
+			return false;
+
+		next += p.ElementCount;
+	}
+
+	return next == ElementCount;
+}
+
+bool RoadmapTableView::isValidElements(quint32 first, quint32 last) const
+{
+	for (quint32 i = first; i < last; i++)
+	{
+		const RoadmapElementRecord& e = element(i);
+		if (quint64(e.NameOffset) + e.NameLength > StringLength || (e.Type != PROJECT_TASK && e.Type != PROJECT_MILESTONE))
+			return false;
+
+		if (!isValidLinks(i))
+			return false;
+	}
+
+	return true;
+}
+
+bool RoadmapTableView::isValidLinks(quint32 index) const
+{
+	if (LinkOffsets[index + 1] < LinkOffsets[index] || LinkOffsets[index + 1] > LinkCount)
+		return false;
+
+	for (quint32 l = LinkOffsets[index]; l < LinkOffsets[index + 1]; l++)
+	{
+		if (LinkTargets[l] >= ElementCount)
+			return false;
+	}
+
+	return true;
+}
+
+quint32 RoadmapTables::addString(const QString& value, quint32* length)
+{
+	const quint32 offset = quint32(Strings.length());
+	Strings.append(value);
+	*length = quint32(value.length());
+	return offset;
+}
@@ -0,0 +1,330 @@
+#pragma once
+/*
+ * Questo file contiene la definizione del formato binario v2 dei file .ropl
+ *
+ * Il file inizia sempre con la magic string serializzata da QDataStream (come nella v1),
+ * così operator >> può riconoscere la versione prima di decidere come leggere il resto:
+ *  - "RoadmapPlanet01": record annidati per progetto e mappa dei link (QDataStream)
+ *  - "RoadmapPlanet02": tabelle piatte little endian, descritte qui sotto
+ *
+ * Dopo la magic string la v2 contiene, nell'ordine:
+ *  - RoadmapFileHeader: numero e dimensione (stride) dei record di ogni tabella
+ *  - Tabella dei progetti: un RoadmapProjectRecord per progetto, gli elementi di un
+ *    progetto sono contigui nella tabella degli elementi. La tabella fa da indice (TOC):
+ *    per ogni progetto l'offset in byte e il numero dei suoi elementi, le date occupate
+ *    e l'id più grande, abbastanza per mostrare il progetto senza leggerne gli elementi
+ *  - Tabella degli elementi: un RoadmapElementRecord a larghezza fissa per elemento
+ *  - Link in formato CSR: ElementCount + 1 offset, i figli dell'elemento i sono
+ *    gli indici in [offset[i], offset[i + 1]) della tabella dei target
+ *  - Pool delle stringhe: tutti i nomi concatenati in UTF-16, i record ne contengono
+ *    offset e lunghezza
+ *
+ * Le tabelle si leggono in blocco (una lettura per tabella, nessuna decodifica campo
+ * per campo sugli host little endian) e i link si risolvono per indice, senza cercare
+ * gli elementi per id. Gli stride permettono a versioni future di allungare i record:
+ * un lettore usa solo i campi che conosce e salta il resto.
+ *
+ * Caricamento mappato (RoadmapTables::load): il file viene mappato in memoria e gli
+ * elementi vengono creati leggendo i record sul posto, i nomi sono viste nel pool delle
+ * stringhe (QString::fromRawData) e non copie. Il file resta mappato finché vive la
+ * Roadmap, Roadmap::unmap() copia i nomi e lo rilascia. Il salvataggio in background non lo
+ * rilascia: copia i progetti non caricati direttamente dal file (Vedi RoadmapTables::capture).
+ * All'apertura vengono verificati solo l'intestazione e l'indice dei progetti, così il file
+ * non viene letto tutto: i record di un progetto vengono verificati quando viene caricato.
+ * name() ritorna la vista senza copiarla (il rendering legge i nomi ad ogni paint),
+ * la copia (detachedString) la fa solo chi conserva il nome oltre unmap(): lo snapshot
+ * dei thread di rendering, l'EditRole letto dagli editor e la cache delle larghezze dei testi.
+ *
+ * Compressione (opzionale, RoadmapFileHeader::Compressed): l'intestazione resta in chiaro,
+ * le tabelle che la seguono vengono divise in blocchi compressi con zlib, ognuno preceduto
+ * da un RoadmapBlockHeader. I blocchi sono indipendenti: in scrittura vengono compressi
+ * in parallelo, in lettura ogni blocco viene decompresso sul pool mentre si legge il
+ * successivo. Serve per i file su disco di rete, dove la lettura è limitata dalla banda.
+ * Un file compresso non può essere mappato e viene letto sempre a flusso.
+ *
+ * Caricamento pigro: con il file mappato vengono creati subito solo i progetti,
+ * gli elementi di un progetto vengono creati quando serve (RoadmapLazyTables::load,
+ * chiamata dal modello con fetchMore quando il progetto viene espanso o mostrato).
+ * I link vengono agganciati man mano che entrambi gli estremi esistono: quelli uscenti
+ * dalla fetta CSR del progetto, quelli entranti da un indice inverso (sempre CSR) costruito
+ * una volta al primo caricamento, così caricare un progetto costa quanto i suoi elementi
+ * e i suoi link e caricarli tutti (Roadmap::loadAll) resta lineare nel file.
+ */
+#include <QVector>
+#include <QString>
+#include <QHash>
+#include <QDate>
+#include <QColor>
+#include <functional>
+
+class QDataStream;
+class Roadmap;
+class RoadmapProject;
+class RoadmapProjectElement;
+
+#define FormatMagicV1 "RoadmapPlanet01" // Record annidati (QDataStream)
+#define FormatMagicV2 "RoadmapPlanet02" // Tabelle piatte
+
+/*
+ * Intestazione delle tabelle, i campi sono little endian su disco
+ */
+struct RoadmapFileHeader
+{
+    enum
+    {
+        Compressed = 1 << 0 // Le tabelle sono divise in blocchi compressi
+    };
+
+    quint32 HeaderSize; // Dimensione dell'intestazione, per allungarla in futuro
+    quint32 Flags;
+    quint32 ProjectCount;
+    quint32 ProjectStride; // Byte di un record di progetto
+    quint32 ElementCount;
+    quint32 ElementStride; // Byte di un record di elemento
+    quint32 LinkCount; // Numero totale di link
+    quint32 StringLength; // Caratteri UTF-16 nel pool delle stringhe
+    quint32 Reserved[3]; // Porta i record degli elementi ad un offset multiplo di 8 nel file
+};
+
+/*
+ * Intestazione di un blocco compresso, little endian su disco.
+ * I dati sono quelli di qCompress (dimensione big endian e stream zlib)
+ */
+struct RoadmapBlockHeader
+{
+    quint32 RawSize; // Byte delle tabelle contenuti nel blocco
+    quint32 PackedSize; // Byte compressi che seguono
+};
+
+struct RoadmapProjectRecord
+{
+    enum
+    {
+        ColorValid = 1 << 0 // Il progetto ha un colore
+    };
+
+    quint32 NameOffset; // Nome nel pool delle stringhe
+    quint32 NameLength;
+    quint32 Color; // ARGB
+    quint32 FirstElement; // Primo elemento nella tabella degli elementi
+    quint32 ElementCount;
+    quint32 Flags;
+
+    /*
+     * Indice del progetto, assente (a 0) nei record più corti scritti prima della sua introduzione
+     */
+    quint64 ElementOffset; // Byte del primo elemento dall'inizio dell'intestazione
+    qint64 StartDay; // Julian day di startDate() del progetto
+    qint64 EndDay; // Julian day di endDate() del progetto (solo task)
+    qint64 LastDay; // Ultimo giorno occupato da un elemento (milestone comprese)
+    qint32 MaxId; // Id più grande tra gli elementi
+    quint32 Reserved;
+};
+
+struct RoadmapElementRecord
+{
+    enum
+    {
+        Delivered = 1 << 0 // Milestone consegnata
+    };
+
+    qint64 JulianDay; // Data di partenza
+    qint32 Id;
+    quint32 Type; // RoadmapElementType
+    qint32 Days; // Durata dei task, 0 per le milestone
+    quint32 Flags;
+    quint32 NameOffset; // Nome nel pool delle stringhe
+    quint32 NameLength;
+};
+
+/*
+ * Vista in sola lettura sulle tabelle v2: punta ai vettori di RoadmapTables
+ * oppure direttamente dentro un file mappato in memoria.
+ * I record vengono letti sul posto, per questo la vista su un file è possibile
+ * solo sugli host little endian e con i record allineati
+ */
+struct RoadmapTableView
+{
+    const uchar* Projects = nullptr; // Record dei progetti, uno ogni ProjectStride byte
+    quint32 ProjectCount = 0;
+    quint32 ProjectStride = 0;
+    const uchar* Elements = nullptr; // Record degli elementi, uno ogni ElementStride byte
+    quint32 ElementCount = 0;
+    quint32 ElementStride = 0;
+    const quint32* LinkOffsets = nullptr; // ElementCount + 1 offset
+    const quint32* LinkTargets = nullptr;
+    quint32 LinkCount = 0;
+    const QChar* Strings = nullptr; // Pool dei nomi
+    quint32 StringLength = 0;
+    bool Shared = false; // I nomi restano viste nel pool invece di essere copiati
+
+    const RoadmapProjectRecord& project(quint32 index) const;
+    const RoadmapElementRecord& element(quint32 index) const;
+    QString string(quint32 offset, quint32 length) const;
+
+    /*
+     * Interpreta le tabelle in un blocco di memoria che inizia dopo la magic string,
+     * fallisce se il blocco è troncato, non allineato, se l'intestazione o l'indice dei progetti
+     * non sono coerenti o se l'host è big endian. I record degli elementi e i link non vengono
+     * letti (su un file mappato vorrebbe dire leggerlo tutto), vanno verificati con isValidElements
+     */
+    bool parse(const uchar* data, qint64 size);
+
+    /*
+     * Verifica che offset, indici e stringhe siano dentro le tabelle:
+     *  - isValid: tutte le tabelle
+     *  - isValidIndex: solo l'indice dei progetti e gli estremi dei link
+     *  - isValidElements: i record degli elementi in [first, last) e i loro link
+     *  - isValidLinks: la fetta di link di un elemento
+     */
+    bool isValid() const;
+    bool isValidIndex() const;
+    bool isValidElements(quint32 first, quint32 last) const;
+    bool isValidLinks(quint32 index) const;
+
+    /*
+     * Ricrea progetti, elementi e link nella Roadmap (che deve essere vuota)
+     */
+    void restore(Roadmap& rmap) const;
+
+    /*
+     * Sposta la vista di delta byte: le tabelle sono state copiate altrove (Vedi Roadmap::detachMapping)
+     */
+    void move(qptrdiff delta);
+
+    /*
+     * Crea l'elemento index nel progetto, senza agganciarlo al progetto né alla timeline.
+     * Un nome fuori dal pool diventa vuoto e un tipo sconosciuto un task
+     */
+    RoadmapProjectElement* create(RoadmapProject* project, quint32 index) const;
+};
+
+/*
+ * Stato del caricamento pigro di una Roadmap, posseduto dalla Roadmap
+ * finché tutti i progetti non sono stati caricati o il file non viene rilasciato
+ */
+struct RoadmapLazyTables
+{
+    RoadmapTableView View; // Tabelle nel file mappato
+    QVector<RoadmapProjectElement*> Elements; // Elementi creati, per indice (nullptr se non caricati o eliminati)
+    QHash<const RoadmapProjectElement*, quint32> Records; // Indice del record di ogni elemento creato
+    QVector<quint32> IncomingOffsets; // ElementCount + 1 offset in IncomingSources, vuoto finché non serve
+    QVector<quint32> IncomingSources; // Per ogni elemento gli indici degli elementi che lo hanno come figlio
+    bool IncomingValid = true; // Tutti i link erano validi quando è stato costruito l'indice inverso
+    int MaxId = 0; // Id più grande di tutto il file
+
+    /*
+     * Crea gli elementi del progetto e i link verso e da gli elementi già creati,
+     * verificandone i record (Vedi RoadmapTableView::parse)
+     */
+    void load(Roadmap& rmap, RoadmapProject* project);
+
+    /*
+     * Un elemento creato dal file è stato eliminato
+     */
+    void forget(const RoadmapProjectElement* element);
+
+    /*
+     * Costruisce l'indice inverso dei link (IncomingOffsets, IncomingSources) se manca,
+     * ritorna false se qualche link del file non era valido (ed è stato scartato)
+     */
+    bool buildIncoming();
+
+    /*
+     * Record dell'indice di un progetto non ancora caricato
+     */
+    const RoadmapProjectRecord& record(const RoadmapProject* project) const;
+};
+
+/*
+ * Fotografia di una Roadmap da cui costruire le tabelle su un altro thread (Vedi RoadmapSaver).
+ * Costa quanto i progetti e gli elementi già caricati e nessuna copia profonda: nomi e liste
+ * dei figli sono condivisi implicitamente con la Roadmap e vengono copiati solo se modificati.
+ * I progetti non ancora caricati restano riferimenti ai loro record nel file mappato,
+ * che il thread di lavoro legge direttamente
+ */
+struct RoadmapCapture
+{
+    struct Element
+    {
+        const RoadmapProjectElement* Key; // Identità dell'elemento, solo per risolvere i link
+        QDate Date;
+        qint32 Id;
+        quint32 Type; // RoadmapElementType
+        qint32 Days; // Solo task
+        bool Delivered; // Solo milestone
+        QString Name; // Può essere una vista nel file mappato
+        QList<RoadmapProjectElement*> Childs;
+    };
+
+    struct Project
+    {
+        QString Name;
+        QColor Color;
+        int Record = -1; // Record nell'indice del file se gli elementi non sono caricati
+        QVector<Element> Elements; // Vuota se il progetto non è caricato
+    };
+
+    QVector<Project> Projects;
+    RoadmapTableView View; // Tabelle del file mappato, per i progetti non caricati
+    QVector<RoadmapProjectElement*> Loaded; // Elementi creati dal file, per record (Vedi RoadmapLazyTables)
+    QByteArray Mapped; // Contenuto del file mappato, vuoto se non c'è (Vedi Roadmap::detachMapping)
+};
+
+/*
+ * Le tabelle del formato v2 in memoria, nell'ordine dei byte dell'host
+ */
+struct RoadmapTables
+{
+    QVector<RoadmapProjectRecord> Projects;
+    QVector<RoadmapElementRecord> Elements; // Nell'ordine dei progetti
+    QVector<quint32> LinkOffsets; // Elements.count() + 1 offset in LinkTargets
+    QVector<quint32> LinkTargets; // Indici degli elementi figli
+    QString Strings; // Pool dei nomi
+    bool Compressed = false; // Le tabelle lette da read() erano compresse
+
+    /*
+     * Avanzamento della scrittura: byte delle tabelle scritti e totale
+     */
+    typedef std::function<void(qint64 written, qint64 total)> Progress;
+
+    /*
+     * Costruisce le tabelle a partire dalla Roadmap, oppure da una sua fotografia:
+     * capture() va chiamata sul thread della Roadmap, build() della fotografia su qualsiasi
+     * thread, finché il file mappato resta aperto. I progetti non caricati vengono copiati
+     * dai record del file, con i link verso e da gli elementi già caricati (come RoadmapLazyTables::load)
+     */
+    static RoadmapTables build(const Roadmap& rmap);
+    static RoadmapCapture capture(const Roadmap& rmap);
+    static RoadmapTables build(const RoadmapCapture& capture);
+
+    /*
+     * Ricrea progetti, elementi e link nella Roadmap (che deve essere vuota)
+     */
+    void restore(Roadmap& rmap) const;
+
+    /*
+     * Carica un file nella Roadmap (vuota): i file v2 vengono mappati in memoria,
+     * gli altri (o se la mappatura non è possibile) vengono letti con operator >>.
+     * Ritorna false se il file non si apre, lancia std::exception come operator >>
+     * se il contenuto non è valido
+     */
+    static bool load(const QString& path, Roadmap& rmap);
+
+    /*
+     * Scrive e legge le tabelle (senza la magic string), compresse a blocchi se richiesto.
+     * read riconosce da sola i file compressi e fallisce se il file è troncato
+     * o se gli indici non sono coerenti
+     */
+    bool write(QDataStream& out, const Progress& progress = Progress(), bool compressed = false) const;
+    bool read(QDataStream& in);
+
+    bool isValid() const;
+
+    /*
+     * Vista sulle tabelle, valida finché le tabelle non vengono modificate
+     */
+    RoadmapTableView view() const;
+
+    quint32 addString(const QString& value, quint32* length);
+};
@@ -2,25 +2,340 @@
 #include <QBrush>
 #include <QStyleOptionHeader>
 #include <QApplication>
+#include <QPainter>
+#include <QPixmapCache>
+#include <QtMath>
+#include <KDGanttAbstractRowController>
+
+/*
+ * Limiti dello zoom in pixel per giorno:
+ *  - tra DayZoom e MaxZoom lo zoom procede a passi di ZoomStep pixel
+ *  - sotto DayZoom lo zoom dimezza\raddoppia fino a MinZoom
+ */
+#define MaxZoom 100.
+#define DayZoom 20.
+#define MinZoom 0.15
+#define ZoomStep 10.
+
+RoadmapPeriodFormatter::RoadmapPeriodFormatter(int months)
+	: DateTimeScaleFormatter(months >= 12 ? Year : Month, QString("'P%1'").arg(months)), m_months(months)
+{
+    // Il formato non viene usato per il testo ma distingue i formatter nella cache delle strisce
+}
+
+QDateTime RoadmapPeriodFormatter::currentRangeBegin(const QDateTime& datetime) const
+{
+    /*
+     * Conto i mesi dall'anno 0 e li arrotondo per difetto al multiplo del periodo
+     */
+	const QDate date = datetime.date();
+	int index = date.year() * 12 + date.month() - 1;
+	index -= index % m_months;
+
+	return QDateTime(QDate(index / 12, index % 12 + 1, 1), QTime(0, 0), datetime.timeSpec());
+}
+
+QDateTime RoadmapPeriodFormatter::nextRangeBegin(const QDateTime& datetime) const
+{
+	return currentRangeBegin(datetime).addMonths(m_months);
+}
+
+QString RoadmapPeriodFormatter::text(const QDateTime& datetime) const
+{
+	const QDate begin = currentRangeBegin(datetime).date();
+
+	if (m_months < 12)
+		return QString("Q%1 %2").arg((begin.month() - 1) / m_months + 1).arg(begin.toString("yy"));
+
+	if (m_months == 12)
+		return QString::number(begin.year());
+
+	return QString("%1 - %2").arg(begin.year()).arg(begin.year() + m_months / 12 - 1);
+}
 
 RoadmapGrid::RoadmapGrid(QObject * parent) : DateTimeGrid() {
     setParent(parent);
+    m_dayupper = new KDGantt::DateTimeScaleFormatter(*userDefinedUpperScale()); // Mi salvo l'header superiore di KDGantt per la scala dei giorni
 	this->setUserDefinedLowerScale(new KDGantt::DateTimeScaleFormatter(KDGantt::DateTimeScaleFormatter::Day, QString::fromLatin1("ddd dd")));
 	this->setScale(KDGantt::DateTimeGrid::ScaleUserDefined);
 }
 
 RoadmapGrid::~RoadmapGrid() {
-	
+	delete m_dayupper;
+}
+
+void RoadmapGrid::zoomTo(qreal dayWidth)
+{
+	dayWidth = qBound(MinZoom, dayWidth, MaxZoom);
+
+	applyScale(scaleForDayWidth(dayWidth), dayWidth);
+	setDayWidth(dayWidth);
+}
+
+void RoadmapGrid::zoomIn()
+{
+    // Sopra DayZoom a passi fissi, sotto raddoppiando
+	const qreal dw = dayWidth();
+	zoomTo(dw >= DayZoom ? dw + ZoomStep : qMin(dw * 2., DayZoom));
+}
+
+void RoadmapGrid::zoomOut()
+{
+	const qreal dw = dayWidth();
+	zoomTo(dw > DayZoom ? qMax(dw - ZoomStep, DayZoom) : dw / 2.);
+}
+
+bool RoadmapGrid::canZoomIn() const
+{
+	return dayWidth() < MaxZoom;
+}
+
+bool RoadmapGrid::canZoomOut() const
+{
+	return dayWidth() > MinZoom;
+}
+
+qreal RoadmapGrid::minimumDayWidth()
+{
+	return MinZoom;
+}
+
+qreal RoadmapGrid::maximumDayWidth()
+{
+	return MaxZoom;
+}
+
+RoadmapGrid::RoadmapScale RoadmapGrid::roadmapScale() const
+{
+	return m_scale;
+}
+
+RoadmapGrid::RoadmapScale RoadmapGrid::scaleForDayWidth(qreal dayWidth)
+{
+    /*
+     * Le soglie sono scelte in modo che la cella più piccola dell'header
+     * resti larga almeno una trentina di pixel
+     */
+	if (dayWidth >= DayZoom) return ScaleDays;
+	if (dayWidth >= 5.) return ScaleWeeks;
+	if (dayWidth >= 1.25) return ScaleMonths;
+	if (dayWidth >= 0.5) return ScaleQuarters;
+	return ScaleYears;
+}
+
+void RoadmapGrid::setFreeDays(const QSet<Qt::DayOfWeek>& fd)
+{
+	m_freedays = fd;
+
+	if (m_scale == ScaleDays)
+		DateTimeGrid::setFreeDays(fd);
+
+	invalidateBackground();
+}
+
+void RoadmapGrid::applyScale(RoadmapScale scale, qreal dayWidth)
+{
+	using KDGantt::DateTimeScaleFormatter;
+
+	/*
+	 * Nei giorni mantengo il comportamento originale: sopra i 50 pixel per giorno
+	 * l'header esteso di RoadmapGrid, sotto la scala giornaliera di KDGantt
+	 */
+	if (scale == ScaleDays)
+	{
+		if (m_scale != ScaleDays) {
+			setUserDefinedUpperScale(new DateTimeScaleFormatter(*m_dayupper));
+			setUserDefinedLowerScale(new DateTimeScaleFormatter(DateTimeScaleFormatter::Day, QString::fromLatin1("ddd dd")));
+			DateTimeGrid::setFreeDays(m_freedays);
+			invalidateBackground();
+		}
+
+		m_scale = scale;
+		setScale(dayWidth >= 50 ? ScaleUserDefined : ScaleDay);
+		return;
+	}
+
+	if (scale == m_scale)
+		return;
+
+	switch (scale)
+	{
+	case ScaleWeeks:
+		setUserDefinedUpperScale(new DateTimeScaleFormatter(DateTimeScaleFormatter::Month, QString::fromLatin1("MMMM yyyy")));
+		setUserDefinedLowerScale(new DateTimeScaleFormatter(DateTimeScaleFormatter::Week, QString::fromLatin1("ww")));
+		break;
+	case ScaleMonths:
+		setUserDefinedUpperScale(new DateTimeScaleFormatter(DateTimeScaleFormatter::Year, QString::fromLatin1("yyyy")));
+		setUserDefinedLowerScale(new DateTimeScaleFormatter(DateTimeScaleFormatter::Month, QString::fromLatin1("MMM")));
+		break;
+	case ScaleQuarters:
+		setUserDefinedUpperScale(new DateTimeScaleFormatter(DateTimeScaleFormatter::Year, QString::fromLatin1("yyyy")));
+		setUserDefinedLowerScale(new RoadmapPeriodFormatter(3));
+		break;
+	case ScaleYears:
+		setUserDefinedUpperScale(new RoadmapPeriodFormatter(120));
+		setUserDefinedLowerScale(new RoadmapPeriodFormatter(12));
+		break;
+	default:
+		break;
+	}
+
+    // Un giorno è largo pochi pixel, l'ombreggiatura dei festivi sarebbe solo rumore
+	DateTimeGrid::setFreeDays(QSet<Qt::DayOfWeek>());
+	invalidateBackground();
+
+	m_scale = scale;
+	setScale(ScaleUserDefined);
 }
 
 void RoadmapGrid::paintUserDefinedHeader(QPainter* painter, const QRectF& headerRect, const QRectF& exposedRect, qreal offset, const KDGantt::DateTimeScaleFormatter* formatter, QWidget* widget)
+{
+	// Stampa ed esportazioni disegnano le celle direttamente, niente pixmap nel documento
+	if (painter->device() == nullptr || painter->device()->devType() != QInternal::Widget) {
+		paintHeaderCells(painter, headerRect, offset + exposedRect.left(), offset + exposedRect.right(), offset, formatter, widget);
+		return;
+	}
+
+	/*
+	 * Al cambio di zoom tutte le strisce generate diventano inutili, le scarto
+	 */
+	if (!qFuzzyCompare(m_stripdaywidth, dayWidth())) {
+		for (const QString& key : m_stripkeys)
+			QPixmapCache::remove(key);
+		m_stripkeys.clear();
+		m_stripdaywidth = dayWidth();
+	}
+
+	/*
+	 * Compongo le strisce che coprono l'area esposta
+	 */
+	const int first = qFloor((offset + exposedRect.left()) / STRIPWIDTH);
+	const int last = qFloor((offset + exposedRect.right()) / STRIPWIDTH);
+	const int height = qCeil(headerRect.height());
+
+	for (int strip = first; strip <= last; strip++)
+		painter->drawPixmap(QPointF(strip * STRIPWIDTH - offset, headerRect.top()), headerStrip(strip, height, formatter, widget));
+}
+
+QPixmap RoadmapGrid::headerStrip(int strip, int height, const KDGantt::DateTimeScaleFormatter* formatter, QWidget* widget)
+{
+	const qreal dpr = widget ? widget->devicePixelRatioF() : 1.;
+
+	/*
+	 * La chiave contiene tutto quello che cambia il contenuto della striscia:
+	 * la grid, la scala (range e formato), lo zoom, la data di inizio della chart,
+	 * l'altezza dell'header e la posizione della striscia
+	 */
+	const QString key = QString("RoadmapGrid:%1:%2:%3:%4:%5:%6:%7:%8")
+		.arg(reinterpret_cast<quintptr>(this))
+		.arg(static_cast<int>(formatter->range()))
+		.arg(formatter->format())
+		.arg(dayWidth())
+		.arg(startDateTime().toMSecsSinceEpoch())
+		.arg(height)
+		.arg(strip)
+		.arg(dpr);
+
+	QPixmap pixmap;
+	if (QPixmapCache::find(key, &pixmap))
+		return pixmap;
+
+	pixmap = QPixmap(qCeil(STRIPWIDTH * dpr), qCeil(height * dpr));
+	pixmap.setDevicePixelRatio(dpr);
+	pixmap.fill(Qt::transparent);
+
+	QPainter painter(&pixmap);
+	const qreal left = strip * STRIPWIDTH;
+	paintHeaderCells(&painter, QRectF(0, 0, STRIPWIDTH, height), left, left + STRIPWIDTH, left, formatter, widget);
+	painter.end();
+
+	QPixmapCache::insert(key, pixmap);
+	m_stripkeys.insert(key);
+	return pixmap;
+}
+
+void RoadmapGrid::paintGrid(QPainter* painter, const QRectF& sceneRect, const QRectF& exposedRect, KDGantt::AbstractRowController* rowController, QWidget* widget)
+{
+	if (painter->device() == nullptr || painter->device()->devType() != QInternal::Widget) {
+		DateTimeGrid::paintGrid(painter, sceneRect, exposedRect, rowController, widget);
+		return;
+	}
+
+	// Come per le strisce dell'header, al cambio di zoom le tile non servono più
+	if (!qFuzzyCompare(m_tiledaywidth, dayWidth())) {
+		invalidateBackground();
+		m_tiledaywidth = dayWidth();
+	}
+
+	const QRectF area = exposedRect.intersected(sceneRect);
+	if (area.isEmpty())
+		return;
+
+	const qreal dpr = painter->device()->devicePixelRatioF();
+	const int left = qFloor(area.left() / BGTILE);
+	const int right = qFloor(area.right() / BGTILE);
+	const int top = qFloor(area.top() / BGTILE);
+	const int bottom = qFloor(area.bottom() / BGTILE);
+
+	for (int y = top; y <= bottom; y++)
+		for (int x = left; x <= right; x++)
+			painter->drawPixmap(QPointF(x * BGTILE, y * BGTILE), backgroundTile(x, y, dpr, sceneRect, rowController, widget));
+}
+
+QPixmap RoadmapGrid::backgroundTile(int x, int y, qreal dpr, const QRectF& sceneRect, KDGantt::AbstractRowController* rowController, QWidget* widget)
+{
+	/*
+	 * La chiave contiene tutto quello che cambia lo sfondo: la scala, lo zoom,
+	 * la data di inizio della chart, l'area della scena (righe aggiunte o tolte),
+	 * i separatori delle righe e la posizione della tile
+	 */
+	const QString key = QString("RoadmapGrid:bg:%1:%2:%3:%4:%5:%6:%7:%8:%9")
+		.arg(reinterpret_cast<quintptr>(this))
+		.arg(QString("%1.%2.%3").arg(static_cast<int>(m_scale)).arg(static_cast<int>(scale())).arg(m_tilegeneration))
+		.arg(dayWidth())
+		.arg(startDateTime().toMSecsSinceEpoch())
+		.arg(QString("%1.%2.%3.%4").arg(sceneRect.left()).arg(sceneRect.top()).arg(sceneRect.width()).arg(sceneRect.height()))
+		.arg(rowSeparators() && rowController != nullptr ? rowController->totalHeight() : -1)
+		.arg(x)
+		.arg(y)
+		.arg(dpr);
+
+	QPixmap pixmap;
+	if (QPixmapCache::find(key, &pixmap))
+		return pixmap;
+
+	pixmap = QPixmap(qCeil(BGTILE * dpr), qCeil(BGTILE * dpr));
+	pixmap.setDevicePixelRatio(dpr);
+	pixmap.fill(Qt::transparent); // Il colore di fondo della scena resta sotto
+
+	QPainter painter(&pixmap);
+	const QRectF tile(x * BGTILE, y * BGTILE, BGTILE, BGTILE);
+	painter.translate(-tile.topLeft());
+	painter.setClipRect(tile);
+	DateTimeGrid::paintGrid(&painter, sceneRect, tile, rowController, widget);
+	painter.end();
+
+	QPixmapCache::insert(key, pixmap);
+	m_tilekeys.insert(key);
+	return pixmap;
+}
+
+void RoadmapGrid::invalidateBackground()
+{
+	for (const QString& key : m_tilekeys)
+		QPixmapCache::remove(key);
+	m_tilekeys.clear();
+	m_tilegeneration++;
+}
+
+void RoadmapGrid::paintHeaderCells(QPainter* painter, const QRectF& headerRect, qreal left, qreal right, qreal offset, const KDGantt::DateTimeScaleFormatter* formatter, QWidget* widget)
 {
 	const QStyle* const style = widget ? widget->style() : QApplication::style();
 
-	QDateTime dt = formatter->currentRangeBegin(mapToDateTime(offset + exposedRect.left())).toUTC();
+	QDateTime dt = formatter->currentRangeBegin(mapToDateTime(left)).toUTC();
 	qreal x = mapFromDateTime(dt);
 
-	while (x < exposedRect.right() + offset) {
+	while (x < right) {
 		const QDateTime next = formatter->nextRangeBegin(dt);
 		const qreal nextx = mapFromDateTime(next);
 
@@ -30,7 +345,7 @@ void RoadmapGrid::paintUserDefinedHeader(QPainter* painter, const QRectF& header
 
 		opt.textAlignment = formatter->alignment();
 
-		if (formatter->range() == KDGantt::DateTimeScaleFormatter::Week) {
+		if (formatter->range() == KDGantt::DateTimeScaleFormatter::Week && m_scale == ScaleDays) {
 			int delta = Qt::Monday - dt.date().dayOfWeek();
 			QDate firstDayOfWeek = dt.date().addDays(delta);
 			QDate lastDayOfWeek = dt.date().addDays(7 - delta);
@@ -44,6 +359,10 @@ void RoadmapGrid::paintUserDefinedHeader(QPainter* painter, const QRectF& header
 				int weekinmonth = firstday.daysTo(firstDayOfWeek) / 7 + 1;
 				opt.text = QString("%1 settimana di %2").arg(weekinmonth).arg(firstDayOfWeek.toString("MMMM yy"));
             }
+
+			// Con lo zoom basso la descrizione estesa non ci sta, uso quella del formatter
+			if (opt.fontMetrics.width(opt.text) > opt.rect.width() - 6)
+				opt.text = formatter->text(dt);
 		}
 		else {
 			opt.text = formatter->text(dt);
@@ -1,20 +1,150 @@
 ﻿#pragma once
 #include <kdganttdatetimegrid.h>
+#include <QPixmap>
+#include <QSet>
+
+/*
+ * Formatter dell'header per periodi di più mesi, KDGantt arriva fino all'anno
+ * ma non conosce trimestri e decenni:
+ *  - months = 3 -> trimestri "Q1 24"
+ *  - months = 12 -> anni "2024"
+ *  - months = 120 -> decenni "2020 - 2029"
+ */
+class RoadmapPeriodFormatter : public KDGantt::DateTimeScaleFormatter {
+    int m_months; // Durata del periodo in mesi
+
+public:
+	explicit RoadmapPeriodFormatter(int months);
+
+	QDateTime currentRangeBegin(const QDateTime& datetime) const override;
+	QDateTime nextRangeBegin(const QDateTime& datetime) const override;
+	QString text(const QDateTime& datetime) const override;
+};
 
 /*
  * KDGantt::DateTimeGrid è la classe che si occupa di definire
  * e disegnare l'header della grid
+ *
+ * RoadmapGrid gestisce anche lo zoom: a seconda dei pixel per giorno sceglie
+ * la scala della timeline, da giorni fino ad anni, così anche una roadmap
+ * di più anni può stare in una sola schermata
  */
 class RoadmapGrid : public KDGantt::DateTimeGrid {
+    /*
+     * Le celle dell'header vengono disegnate in strisce di STRIPWIDTH pixel
+     * messe in QPixmapCache, lo scroll orizzontale ricompone le strisce già pronte
+     * senza riformattare le date, le strisce vengono scartate solo al cambio di zoom
+     */
+    const int STRIPWIDTH = 512;
+
+    qreal m_stripdaywidth = 0.; // dayWidth con cui sono state generate le strisce in cache
+    QSet<QString> m_stripkeys; // Chiavi delle strisce generate, per scartarle al cambio di zoom
+
+    /*
+     * Lo sfondo del Gantt (festivi, linee della griglia, separatori delle righe) è statico
+     * e viene disegnato a tile di BGTILE pixel messe in QPixmapCache, chiave (scala, zoom, tile):
+     * lo scroll ricompone le tile già pronte e gli item vengono disegnati sopra dalla scena.
+     * Le tile vengono scartate al cambio di zoom e quando cambiano i festivi
+     */
+    const int BGTILE = 256;
+
+    qreal m_tiledaywidth = 0.; // dayWidth con cui sono state generate le tile in cache
+    int m_tilegeneration = 0; // Incrementato quando le tile vanno scartate per altri motivi
+    QSet<QString> m_tilekeys; // Chiavi delle tile generate
 
 public:
+    /*
+     * Scale della timeline, dalla più dettagliata alla più grossolana
+     */
+    enum RoadmapScale
+    {
+        ScaleDays, // Giorni (dettaglio o scala giornaliera di KDGantt)
+        ScaleWeeks, // Settimane sotto i mesi
+        ScaleMonths, // Mesi sotto gli anni
+        ScaleQuarters, // Trimestri sotto gli anni
+        ScaleYears // Anni sotto i decenni
+    };
+
 	RoadmapGrid(QObject * parent = nullptr);
 	~RoadmapGrid();
 
+    /*
+     * Imposta lo zoom (pixel per giorno) nei limiti consentiti
+     * e la scala della timeline adatta allo zoom
+     */
+	void zoomTo(qreal dayWidth);
+
+    /*
+     * Un passo di zoom in avanti o indietro
+     */
+	void zoomIn();
+	void zoomOut();
+
+	bool canZoomIn() const;
+	bool canZoomOut() const;
+
+    /*
+     * Limiti dello zoom in pixel per giorno
+     */
+	static qreal minimumDayWidth();
+	static qreal maximumDayWidth();
+
+    /*
+     * Scala della timeline attuale e scala adatta ad un certo zoom
+     */
+	RoadmapScale roadmapScale() const;
+	static RoadmapScale scaleForDayWidth(qreal dayWidth);
+
+    /*
+     * Imposta i giorni festivi, nelle scale più grossolane dei giorni
+     * l'ombreggiatura viene spenta e ripristinata tornando ai giorni
+     */
+	void setFreeDays(const QSet<Qt::DayOfWeek>& fd);
+
 protected:
     /*
      * Dell'header l'unica cosa che ridefinisco è il drawing
      */
 	void paintUserDefinedHeader(QPainter* painter, const QRectF& headerRect, const QRectF& exposedRect, qreal offset, const KDGantt::DateTimeScaleFormatter* formatter, QWidget* widget) override;
-	
+
+public:
+    /*
+     * Sfondo del Gantt composto dalle tile in cache, stampa ed esportazioni
+     * disegnano direttamente alla risoluzione del device
+     */
+	void paintGrid(QPainter* painter, const QRectF& sceneRect, const QRectF& exposedRect, KDGantt::AbstractRowController* rowController = nullptr, QWidget* widget = nullptr) override;
+
+private:
+    /*
+     * Ottiene dalla cache (o genera) la tile (x, y) dello sfondo,
+     * la tile copre il rettangolo della chart [x * BGTILE, y * BGTILE, BGTILE, BGTILE]
+     */
+	QPixmap backgroundTile(int x, int y, qreal dpr, const QRectF& sceneRect, KDGantt::AbstractRowController* rowController, QWidget* widget);
+
+    /*
+     * Scarta tutte le tile dello sfondo
+     */
+	void invalidateBackground();
+
+    /*
+     * Ottiene dalla cache (o genera) la striscia numero strip dell'header,
+     * la striscia copre le coordinate della chart [strip * STRIPWIDTH, (strip + 1) * STRIPWIDTH)
+     */
+	QPixmap headerStrip(int strip, int height, const KDGantt::DateTimeScaleFormatter* formatter, QWidget* widget);
+
+    /*
+     * Disegna le celle dell'header che cadono tra left e right (coordinate della chart),
+     * offset è la coordinata della chart che corrisponde alla x 0 del painter
+     */
+	void paintHeaderCells(QPainter* painter, const QRectF& headerRect, qreal left, qreal right, qreal offset, const KDGantt::DateTimeScaleFormatter* formatter, QWidget* widget);
+
+    /*
+     * Imposta i formatter dell'header e l'ombreggiatura dei festivi per una scala
+     */
+	void applyScale(RoadmapScale scale, qreal dayWidth);
+
+    RoadmapScale m_scale = ScaleDays; // Scala attuale
+    QSet<Qt::DayOfWeek> m_freedays; // Giorni festivi impostati dall'utente
+    KDGantt::DateTimeScaleFormatter* m_dayupper = nullptr; // Copia dell'header superiore originale, usato nella scala dei giorni
+
 };
@@ -3,13 +3,27 @@
 #include <QPainter>
 
 #include <KDGanttStyleOptionGanttItem>
+#include <KDGanttDateTimeGrid>
 #include "RoadmapModel.hpp"
 #include <QColorDialog>
 #include <QApplication>
+#include <QAbstractProxyModel>
 #include "Utility.hpp"
+#include <algorithm>
 
 using namespace ModelUtility;
 
+/*
+ * Indice del modello sorgente dietro un indice dei proxy di KDGantt
+ */
+static QModelIndex sourceIndex(QModelIndex index)
+{
+	while (auto proxy = qobject_cast<const QAbstractProxyModel*>(index.model()))
+		index = proxy->mapToSource(index);
+
+	return index;
+}
+
 RoadmapItemDelegate::RoadmapItemDelegate(QObject * parent) : ItemDelegate(parent) {
 	
 }
@@ -43,7 +57,6 @@ bool RoadmapItemDelegate::editorEvent(QEvent* event, QAbstractItemModel* model,
 
 KDGantt::Span RoadmapItemDelegate::itemBoundingSpan(const KDGantt::StyleOptionGanttItem& opt, const QModelIndex& idx) const
 {
-	const QString txt = idx.model()->data(idx, Qt::DisplayRole).toString();
 	const int typ = idx.model()->data(idx, KDGantt::ItemTypeRole).toInt();
 	QRectF itemRect = opt.itemRect;
 
@@ -55,8 +68,17 @@ KDGantt::Span RoadmapItemDelegate::itemBoundingSpan(const KDGantt::StyleOptionGa
 			itemRect.height());
 	}
 
-	int tw = opt.fontMetrics.width(txt) * 1.2;
-	tw += static_cast<int>(itemRect.height() / 2.);
+	/*
+	 * Il testo allarga lo span solo se è disegnato a destra o a sinistra dell'item,
+	 * in quel caso la misura viene dalla cache, niente text shaping durante il layout
+	 */
+	int tw = 0;
+	if (opt.displayPosition == KDGantt::StyleOptionGanttItem::Left || opt.displayPosition == KDGantt::StyleOptionGanttItem::Right) {
+		const QString txt = idx.model()->data(idx, Qt::DisplayRole).toString();
+		tw = m_cache.textWidth(opt.font, opt.fontMetrics, txt) * 1.2;
+		tw += static_cast<int>(itemRect.height() / 2.);
+	}
+
 	KDGantt::Span s;
 	switch (opt.displayPosition) {
 	case KDGantt::StyleOptionGanttItem::Left:
@@ -72,34 +94,77 @@ KDGantt::Span RoadmapItemDelegate::itemBoundingSpan(const KDGantt::StyleOptionGa
 
 void RoadmapItemDelegate::paintGanttItem(QPainter* painter, const KDGantt::StyleOptionGanttItem& opt, const QModelIndex& idx)
 {
-	if (!idx.isValid()) return;
-	const KDGantt::ItemType typ = static_cast<KDGantt::ItemType>(idx.model()->data(idx, KDGantt::ItemTypeRole).toInt());
+	if (!idx.isValid() || suppressed(painter)) return;
 
-	const QString& txt = opt.text;
-	QRectF itemRect = opt.itemRect;
-	QRectF boundingRect = opt.boundingRect;
+	/*
+	 * Se il painter ha una clip (stampa, render della scena su una porzione)
+	 * scarto subito gli item fuori dall'area esposta, prima di preparare font e gradienti
+	 */
+	if (painter->hasClipping() && !painter->clipBoundingRect().intersects(opt.boundingRect))
+		return;
+
+	const KDGantt::DateTimeGrid* grid = dynamic_cast<const KDGantt::DateTimeGrid*>(opt.grid);
+	const qreal dayWidth = grid != nullptr ? grid->dayWidth() : LODREDUCED;
+	m_daywidth = dayWidth;
+
+	if (isFolded(idx, dayWidth))
+		return; // Riassunto dall'involucro del progetto
+
+	RoadmapPaintItem item;
+	item.Type = static_cast<KDGantt::ItemType>(idx.model()->data(idx, KDGantt::ItemTypeRole).toInt());
+	item.ItemRect = opt.itemRect;
+	item.BoundingRect = opt.boundingRect;
+	item.Text = opt.text;
+	item.Color = idx.model()->data(idx, Qt::BackgroundRole).value<QColor>();
+	item.Selected = opt.state & QStyle::State_Selected;
+
+	// Le milestone del progetto servono solo per l'involucro, vengono dalla cache
+	if (item.Type == KDGantt::TypeSummary && detailLevel(dayWidth) == DetailEnvelope)
+		item.Milestones = milestoneOffsets(idx, dayWidth);
+
+	paintItem(painter, m_cache, item, dayWidth, QApplication::fontMetrics().height());
+}
+
+void RoadmapItemDelegate::paintItem(QPainter* painter, RoadmapPaintCache& cache, const RoadmapPaintItem& item, qreal dayWidth, int gradHeight) const
+{
+	const KDGantt::ItemType typ = item.Type;
+
+	const QString& txt = item.Text;
+	QRectF itemRect = item.ItemRect;
+	QRectF boundingRect = item.BoundingRect;
 
 	boundingRect.setY(itemRect.y());
 	boundingRect.setHeight(itemRect.height());
 
 	painter->save();
 
-	QFont font = painter->font();
-	font.setBold(true);
-	painter->setFont(font);
-	
+	painter->setFont(cache.boldFont(painter->font()));
+
+	/*
+	 * Level of detail: quando gli item sono troppo piccoli per distinguere
+	 * gradienti e scritte li disegno in tinta unita e senza testo
+	 */
+	const Detail detail = detailLevel(dayWidth);
+	const bool flat = detail != DetailFull || itemRect.width() < LODGRADIENT;
 
-	QLinearGradient taskgrad(0., 0., 0., QApplication::fontMetrics().height());
-	QColor bgcolor = idx.model()->data(idx, Qt::BackgroundRole).value<QColor>();
-	taskgrad.setColorAt(0., bgcolor);
-	taskgrad.setColorAt(1., getLighter(bgcolor, 1.20));
-	painter->setBrush(taskgrad);
+	QColor bgcolor = item.Color;
+	painter->setBrush(flat ? QBrush(bgcolor) : cache.taskBrush(bgcolor, gradHeight));
 
 	QPen pen;
-	if (opt.state & QStyle::State_Selected) pen.setWidth(2 * pen.width());
+	if (item.Selected) pen.setWidth(2 * pen.width());
 	painter->setPen(pen);
 
-	bool drawText = true;
+	/*
+	 * In dettaglio completo le scritte vengono sempre disegnate,
+	 * in dettaglio ridotto solo se entrano nell'item, con gli involucri mai
+	 */
+	bool drawText = detail != DetailEnvelope && itemRect.height() >= LODTEXT;
+	if (drawText && detail == DetailReduced && typ != KDGantt::TypeEvent)
+		drawText = cache.textWidth(painter->font(), painter->fontMetrics(), txt) <= itemRect.width();
+
+	if (detail == DetailEnvelope && !item.Selected)
+		painter->setPen(Qt::NoPen); // Niente bordi, a questa scala sarebbero solo rumore
+
 	qreal pw = painter->pen().width() / 2.;
 	switch (typ) {
 	case KDGantt::TypeTask:
@@ -117,110 +182,265 @@ void RoadmapItemDelegate::paintGanttItem(QPainter* painter, const KDGantt::Style
 		}
 		break;
 	case KDGantt::TypeSummary:
-		if (opt.itemRect.isValid()) {
-			taskgrad.setColorAt(0., bgcolor);
-			taskgrad.setColorAt(1., getLighter(bgcolor, 0.8));
-			painter->setBrush(taskgrad);
+		if (itemRect.isValid() && detail == DetailEnvelope) {
+			paintEnvelope(painter, cache, item);
+		}
+		else if (itemRect.isValid()) {
+			painter->setBrush(flat ? QBrush(bgcolor) : cache.summaryBrush(bgcolor, gradHeight));
 
 			pw -= 1;
-			const QRectF r = QRectF(opt.itemRect).adjusted(-pw, -pw, pw, pw);
-			QPainterPath path;
-			const qreal deltaY = r.height();
-			const qreal deltaXBezierControl = .25*qMin(r.width(), r.height());
-			const qreal deltaX = qMin(r.width(), r.height());
-			path.moveTo(r.topLeft());
-			path.lineTo(r.topRight());
-			path.lineTo(QPointF(r.right(), r.top() + 2.*deltaY));
-			//path.lineTo( QPointF( r.right()-3./2.*delta, r.top() + delta ) );
-			path.quadTo(QPointF(r.right() - deltaXBezierControl, r.top() + deltaY), QPointF(r.right() - deltaX, r.top() + deltaY));
-			//path.lineTo( QPointF( r.left()+3./2.*delta, r.top() + delta ) );
-			path.lineTo(QPointF(r.left() + deltaX, r.top() + deltaY));
-			path.quadTo(QPointF(r.left() + deltaXBezierControl, r.top() + deltaY), QPointF(r.left(), r.top() + 2.*deltaY));
-			path.closeSubpath();
-			painter->setBrushOrigin(itemRect.topLeft());
+			const QRectF r = itemRect.adjusted(-pw, -pw, pw, pw);
 			painter->save();
+			/*
+			 * Il path in cache è costruito nell'origine, lo traslo nella posizione dell'item
+			 * e sposto l'origine del gradiente in modo che resti allineata a itemRect
+			 */
+			painter->translate(r.topLeft());
 			painter->translate(0.5, 0.5);
-			painter->drawPath(path);
+			painter->setBrushOrigin(itemRect.topLeft() - r.topLeft());
+			painter->drawPath(cache.summaryPath(r.size()));
 			painter->restore();
 		}
 		break;
 	case KDGantt::TypeEvent: /* TODO */
-		if (opt.boundingRect.isValid()) {
+		if (item.BoundingRect.isValid()) {
 			const qreal pw = painter->pen().width() / 2. - 1;
-			const QRectF r = QRectF(opt.itemRect).adjusted(-pw, -pw, pw, pw).translated(-opt.itemRect.height() / 2, 0);
-			QPainterPath path;
-			const qreal delta = static_cast< int >(r.height() / 2);
-			path.moveTo(delta, 0.);
-			path.lineTo(2.*delta, delta);
-			path.lineTo(delta, 2.*delta);
-			path.lineTo(0., delta);
-			path.closeSubpath();
+			const QRectF r = itemRect.adjusted(-pw, -pw, pw, pw).translated(-itemRect.height() / 2, 0);
 			painter->save();
 			painter->translate(r.topLeft());
 			painter->translate(0, 0.5);
-			painter->drawPath(path);
+			painter->drawPath(cache.eventPath(static_cast< int >(r.height() / 2)));
 			painter->restore();
 		}
 		break;
+	default:
+		break;
 	}
 
-	if(typ != KDGantt::TypeEvent)
+	if (drawText)
 	{
-		pen.setColor(getIdealTextColor(bgcolor));
-		painter->setPen(pen);
-		painter->drawText(boundingRect, Qt::AlignCenter | Qt::AlignVCenter, txt);
-	}
-	else {
-		//boundingRect.translate(9, 0);
-		painter->drawText(boundingRect, Qt::AlignRight | Qt::AlignVCenter, txt);
+		if(typ != KDGantt::TypeEvent)
+		{
+			pen.setColor(getIdealTextColor(bgcolor));
+			painter->setPen(pen);
+			painter->drawText(boundingRect, Qt::AlignCenter | Qt::AlignVCenter, txt);
+		}
+		else {
+			//boundingRect.translate(9, 0);
+			painter->drawText(boundingRect, Qt::AlignRight | Qt::AlignVCenter, txt);
+		}
 	}
 
 	painter->restore();
 }
 
-void RoadmapItemDelegate::paintConstraintItem(QPainter* p, const QStyleOptionGraphicsItem& opt, const QPointF& start, const QPointF& end, const KDGantt::Constraint& constraint)
+QVector<qreal> RoadmapItemDelegate::milestoneOffsets(const QModelIndex& idx, qreal dayWidth) const
 {
-	p->setRenderHints(QPainter::Antialiasing);
-	qreal midx = (end.x() - start.x()) / 2. + start.x();
-	qreal midy = (end.y() - start.y()) / 2. + start.y();
+	const QModelIndex source = sourceIndex(idx);
+	if (!source.isValid())
+		return QVector<qreal>();
 
-	if (start.x() <= end.x()) {
-		p->setPen(Qt::black);
-		p->setBrush(Qt::black);
-	}
-	else {
-		p->setPen(Qt::red);
-		p->setBrush(Qt::red);
+	const QAbstractItemModel* model = source.model();
+	watch(model);
+
+	auto it = m_envelopes.find(source.internalPointer());
+	if (it == m_envelopes.end())
+	{
+        // Le date delle milestone, lette una volta sola finché il progetto non cambia
+		Envelope envelope;
+
+		const int rows = model->rowCount(source);
+		for (int row = 0; row < rows; row++)
+		{
+			const QModelIndex child = model->index(row, 0, source);
+			if (model->data(child, KDGantt::ItemTypeRole).toInt() != KDGantt::TypeEvent)
+				continue;
+
+			envelope.Days.append(model->data(child, KDGantt::StartTimeRole).toDateTime().toMSecsSinceEpoch() / 86400000.);
+		}
+
+		std::sort(envelope.Days.begin(), envelope.Days.end());
+		it = m_envelopes.insert(source.internalPointer(), envelope);
 	}
-	if (start.x() > end.x() - TURN) {
-		QPainterPath path(start);
-		path.quadTo(QPointF(start.x() + TURN * 2., (start.y() + midy) / 2.),
-			QPointF(midx, midy));
-		path.quadTo(QPointF(end.x() - TURN * 2., (end.y() + midy) / 2.),
-			QPointF(end.x() - TURN / 2., end.y()));
-		QBrush brush = p->brush();
-		p->setBrush(QBrush());
-		p->drawPath(path);
-		p->setBrush(brush);
-		QPolygonF arrow;
-		arrow << end
-			<< QPointF(end.x() - TURN / 2., end.y() - TURN / 2.)
-			<< QPointF(end.x() - TURN / 2., end.y() + TURN / 2.);
-		p->drawPolygon(arrow);
+
+    /*
+     * L'inizio è quello dell'item (i proxy di KDGantt lo calcolano per i summary),
+     * la grid è lineare: la distanza in pixel è quella in giorni per lo zoom
+     */
+	const qreal origin = idx.model()->data(idx, KDGantt::StartTimeRole).toDateTime().toMSecsSinceEpoch() / 86400000.;
+	if (it->DayWidth != dayWidth || it->Origin != origin || it->Offsets.count() != it->Days.count())
+	{
+		it->DayWidth = dayWidth;
+		it->Origin = origin;
+		it->Offsets.resize(it->Days.count());
+		for (int i = 0; i < it->Days.count(); i++)
+			it->Offsets[i] = (it->Days.at(i) - origin) * dayWidth;
 	}
-	else {
-		p->setBrush(QBrush());
-		QPainterPath path(start);
-		path.cubicTo(QPointF(midx, start.y()),
-			QPointF(midx, end.y()),
-			QPointF(end.x() - TURN / 2., end.y()));
-		p->drawPath(path);
-		p->setBrush(Qt::black);
-		QPolygonF arrow;
-		arrow << end
-			<< QPointF(end.x() - TURN / 2., end.y() - TURN / 2.)
-			<< QPointF(end.x() - TURN / 2., end.y() + TURN / 2.);
-		p->drawPolygon(arrow);
+
+	return it->Offsets;
+}
+
+bool RoadmapItemDelegate::isFolded(const QModelIndex& idx, qreal dayWidth) const
+{
+	return detailLevel(dayWidth) == DetailEnvelope && idx.isValid() && idx.parent().isValid();
+}
+
+void RoadmapItemDelegate::watch(const QAbstractItemModel* model) const
+{
+	if (model == m_watched)
+		return;
+
+	if (m_watched != nullptr)
+		QObject::disconnect(m_watched, nullptr, this, nullptr);
+
+	m_envelopes.clear();
+	m_watched = model;
+
+    // Un campo modificato invalida il suo progetto (le date di un elemento o l'inizio del progetto)
+	connect(model, &QAbstractItemModel::dataChanged, this, [=](const QModelIndex& topLeft, const QModelIndex& bottomRight)
+	{
+		if (topLeft.parent().isValid()) {
+			m_envelopes.remove(topLeft.parent().internalPointer());
+			return;
+		}
+
+		for (int row = topLeft.row(); row <= bottomRight.row(); row++)
+			m_envelopes.remove(model->index(row, 0).internalPointer());
+	});
+
+    // Il refresh differito segue modifiche già arrivate con dataChanged, il resto cambia le righe
+	connect(model, &QAbstractItemModel::layoutChanged, this, [=]()
+	{
+		auto rmodel = dynamic_cast<const RoadmapModel*>(model);
+		if (rmodel == nullptr || !rmodel->isRefreshOnly())
+			m_envelopes.clear();
+	});
+
+	auto clear = [=]() { m_envelopes.clear(); };
+	connect(model, &QAbstractItemModel::rowsInserted, this, clear);
+	connect(model, &QAbstractItemModel::rowsRemoved, this, clear);
+	connect(model, &QAbstractItemModel::rowsMoved, this, clear);
+	connect(model, &QAbstractItemModel::modelReset, this, clear);
+	connect(model, &QObject::destroyed, this, [=]()
+	{
+		m_envelopes.clear();
+		m_watched = nullptr;
+	});
+}
+
+RoadmapItemDelegate::Detail RoadmapItemDelegate::detailLevel(qreal dayWidth) const
+{
+	if (dayWidth < LODENVELOPE)
+		return DetailEnvelope;
+
+	if (dayWidth < LODREDUCED)
+		return DetailReduced;
+
+	return DetailFull;
+}
+
+void RoadmapItemDelegate::setWidgetPaintingSuppressed(bool suppressed)
+{
+	m_suppressed = suppressed;
+}
+
+bool RoadmapItemDelegate::suppressed(QPainter* painter) const
+{
+	return m_suppressed && painter->device() != nullptr && painter->device()->devType() == QInternal::Widget;
+}
+
+void RoadmapItemDelegate::paintEnvelope(QPainter* painter, RoadmapPaintCache& cache, const RoadmapPaintItem& item) const
+{
+	const QRectF r = item.ItemRect;
+	const QColor& bgcolor = item.Color;
+
+	// L'involucro del progetto: una barra piena da inizio a fine
+	painter->setBrush(bgcolor);
+	painter->drawRect(r.adjusted(0., r.height() / 4., 0., -r.height() / 4.));
+
+	const QVector<qreal>& xs = item.Milestones;
+	if (xs.isEmpty())
+		return;
+
+	/*
+	 * Le milestone più vicine di LODCLUSTER pixel diventano un unico glifo:
+	 * un rombo per una milestone isolata, una capsula che copre tutto il gruppo altrimenti
+	 */
+	painter->setBrush(getIdealTextColor(bgcolor));
+	const qreal h = r.height() / 2.;
+	const qreal y = r.center().y() - h / 2.;
+
+	int i = 0;
+	while (i < xs.count())
+	{
+		const qreal first = r.left() + xs.at(i);
+		qreal last = first;
+		while (i + 1 < xs.count() && r.left() + xs.at(i + 1) - last < LODCLUSTER)
+			last = r.left() + xs.at(++i);
+		i++;
+
+		if (last == first) {
+			painter->save();
+			painter->translate(first - h / 2., y);
+			painter->drawPath(cache.eventPath(static_cast<int>(h / 2.)));
+			painter->restore();
+		}
+		else {
+			painter->drawRoundedRect(QRectF(first - h / 2., y, last - first + h, h), h / 2., h / 2.);
+		}
 	}
 }
 
+void RoadmapItemDelegate::paintConstraintItem(QPainter* p, const QStyleOptionGraphicsItem& opt, const QPointF& start, const QPointF& end, const KDGantt::Constraint& constraint)
+{
+	if (suppressed(p))
+		return;
+
+    // I link partono e arrivano sugli elementi, al livello degli involucri non ci sono
+	if (isFolded(constraint.startIndex(), m_daywidth) || isFolded(constraint.endIndex(), m_daywidth))
+		return;
+
+	/*
+	 * Il percorso viene calcolato solo quando si spostano gli estremi,
+	 * ai repaint successivi viene ripreso dalla cache
+	 */
+	const RoadmapRoute route = m_cache.constraintRoute(start, end, TURN);
+
+	/*
+	 * Scarto le frecce che non toccano l'area esposta
+	 */
+	QRectF exposed = opt.exposedRect;
+	if (p->hasClipping())
+		exposed = exposed.isValid() ? exposed.intersected(p->clipBoundingRect()) : p->clipBoundingRect();
+
+	if (exposed.isValid() && !exposed.intersects(route.Bounds))
+		return;
+
+	paintRoute(p, m_cache, start, end);
+}
+
+void RoadmapItemDelegate::paintRoute(QPainter* p, RoadmapPaintCache& cache, const QPointF& start, const QPointF& end) const
+{
+	const RoadmapRoute route = cache.constraintRoute(start, end, TURN);
+
+	/*
+	 * Penna cosmetica (larghezza 0) come le frecce originali: la linea resta di un pixel
+	 * anche sotto la scala della stampa o dell'anteprima dello zoom.
+	 * Le frecce che tornano indietro nel tempo sono rosse
+	 */
+	const QColor color = start.x() <= end.x() ? Qt::black : Qt::red;
+	const bool antialiasing = p->testRenderHint(QPainter::Antialiasing);
+	const QPen pen = p->pen();
+	const QBrush brush = p->brush();
+
+	p->setRenderHint(QPainter::Antialiasing, true);
+	p->setPen(QPen(color, 0.));
+	p->setBrush(Qt::NoBrush);
+	p->drawPath(route.Curve);
+	p->setBrush(color);
+	p->drawPolygon(route.Head);
+
+	p->setBrush(brush);
+	p->setPen(pen);
+	p->setRenderHint(QPainter::Antialiasing, antialiasing);
+}
@@ -1,5 +1,24 @@
 ﻿#pragma once
 #include <kdganttitemdelegate.h>
+#include <QVector>
+#include <QHash>
+#include "RoadmapPaintCache.hpp"
+
+/*
+ * Tutto quello che serve per disegnare un item del Gantt, ricavato dal modello
+ * e dalla geometria di KDGantt. Non contiene riferimenti al modello, quindi può
+ * essere disegnato anche fuori dal thread della GUI (vedi RoadmapRenderer)
+ */
+struct RoadmapPaintItem
+{
+	KDGantt::ItemType Type = KDGantt::TypeNone; // Task, milestone (event) o progetto (summary)
+	QRectF ItemRect; // Rettangolo dell'item
+	QRectF BoundingRect; // Rettangolo allargato dallo spazio per il testo
+	QString Text; // Testo dell'item
+	QColor Color; // Colore del progetto
+	bool Selected = false; // Item selezionato
+	QVector<qreal> Milestones; // Solo progetti: distanza ordinata delle milestone dall'inizio del progetto
+};
 
 /*
  * KDGantt:ItemDelegate permette di overridare alcuni behavior
@@ -8,6 +27,43 @@
 class RoadmapItemDelegate : public KDGantt::ItemDelegate {
     const qreal TURN = 10.; // Fattore minimo di raggio per le curve delle frecce
 
+    /*
+     * Soglie del level of detail
+     */
+    const qreal LODREDUCED = 25.; // Sotto questi pixel per giorno niente gradienti e solo le scritte che entrano nell'item
+    const qreal LODENVELOPE = 3.; // Sotto questi pixel per giorno i progetti diventano un'unica barra e spariscono le scritte
+    const qreal LODGRADIENT = 12.; // Sotto questa larghezza in pixel un item è disegnato in tinta unita
+    const qreal LODTEXT = 8.; // Sotto questa altezza in pixel un item non ha scritte
+    const qreal LODCLUSTER = 6.; // Milestone più vicine di questi pixel vengono fuse in un unico glifo
+
+    /*
+     * Livelli di dettaglio con cui vengono disegnati gli item
+     */
+    enum Detail
+    {
+        DetailFull, // Disegno completo: gradienti, parentesi, rombi e scritte
+        DetailReduced, // Tinta unita, solo le scritte che entrano nell'item
+        DetailEnvelope // Progetti come barre piene con le milestone raggruppate, nessuna scritta
+    };
+
+    mutable RoadmapPaintCache m_cache; // Gradienti, font, path e misure dei testi riutilizzati tra un paint e l'altro
+
+    /*
+     * Milestone di un progetto per l'involucro: date ordinate in giorni (valgono per ogni zoom)
+     * e distanze in pixel dall'inizio del progetto per l'ultimo zoom e inizio richiesti
+     */
+    struct Envelope
+    {
+        QVector<qreal> Days; // Giorni dall'epoch
+        qreal DayWidth = 0.;
+        qreal Origin = 0.; // Inizio del progetto in giorni dall'epoch
+        QVector<qreal> Offsets;
+    };
+
+    mutable QHash<const void*, Envelope> m_envelopes; // Per elemento del modello sorgente
+    mutable const QAbstractItemModel* m_watched = nullptr; // Modello le cui modifiche svuotano m_envelopes
+    qreal m_daywidth = 25.; // Zoom dell'ultimo item disegnato, per le frecce
+
 public:
 	explicit RoadmapItemDelegate(QObject * parent = nullptr);
 	~RoadmapItemDelegate();
@@ -36,6 +92,57 @@ public:
      * Routine che disegna le "frecce" dei links tra gli oggetti
      */
 	void paintConstraintItem(QPainter* p, const QStyleOptionGraphicsItem& opt, const QPointF& start, const QPointF& end, const KDGantt::Constraint& constraint) override;
+
+    /*
+     * Disegnano un item e una freccia senza interrogare il modello, con la cache indicata.
+     * Sono le routine usate da paintGanttItem e paintConstraintItem, il renderer le chiama
+     * dai thread di lavoro ognuno con la propria cache.
+     * dayWidth è lo zoom della grid (decide il level of detail), gradHeight l'altezza dei gradienti
+     */
+	void paintItem(QPainter* painter, RoadmapPaintCache& cache, const RoadmapPaintItem& item, qreal dayWidth, int gradHeight) const;
+	void paintRoute(QPainter* painter, RoadmapPaintCache& cache, const QPointF& start, const QPointF& end) const;
+
+    /*
+     * Milestone del progetto idx in pixel dall'inizio del progetto, ordinate (RoadmapPaintItem::Milestones).
+     * Restano in cache per progetto finché il modello non segnala una modifica, va chiamata dal thread della GUI
+     */
+	QVector<qreal> milestoneOffsets(const QModelIndex& idx, qreal dayWidth) const;
+
+    /*
+     * Al livello degli involucri le righe degli elementi (e le loro frecce) non vengono
+     * disegnate, l'involucro del progetto le riassume: il costo dipende dai progetti visibili
+     */
+	bool isFolded(const QModelIndex& idx, qreal dayWidth) const;
+
+    /*
+     * Sopprime il disegno degli item e delle frecce sui widget, quando il Gantt
+     * viene disegnato a tile da RoadmapRenderer. Stampa ed esportazioni disegnano comunque
+     */
+	void setWidgetPaintingSuppressed(bool suppressed);
+
 private:
-	
+	bool m_suppressed = false; // Vedi setWidgetPaintingSuppressed
+
+    /*
+     * Calcola il livello di dettaglio a partire dallo zoom della grid
+     */
+	Detail detailLevel(qreal dayWidth) const;
+
+    /*
+     * Vero se il disegno sul device del painter è affidato alle tile
+     */
+	bool suppressed(QPainter* painter) const;
+
+    /*
+     * Aggancia le modifiche del modello sorgente alla cache degli involucri
+     */
+	void watch(const QAbstractItemModel* model) const;
+
+    /*
+     * Disegna un progetto come unica barra piena, le sue milestone sono
+     * raggruppate in glifi quando sono più vicine di LODCLUSTER pixel,
+     * così il costo dipende dai pixel disponibili e non dal numero di elementi
+     */
+	void paintEnvelope(QPainter* painter, RoadmapPaintCache& cache, const RoadmapPaintItem& item) const;
+
 };
@@ -0,0 +1,438 @@
+#include "RoadmapJournal.hpp"
+#include "Roadmap.hpp"
+#include "RoadmapWal.hpp"
+#include "RoadmapFormat.hpp"
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QtEndian>
+
+#define RecordHeader 6 // quint32 lunghezza + quint16 checksum
+
+/*
+ * Serializza l'operazione e i suoi campi in un record
+ */
+template<typename... Fields>
+static QByteArray encode(RoadmapJournal::Operation op, const Fields&... fields)
+{
+	QByteArray payload;
+	QDataStream out(&payload, QIODevice::WriteOnly);
+	out << quint8(op);
+
+	int expand[] = { 0, ((out << fields), 0)... };
+	Q_UNUSED(expand);
+	return payload;
+}
+
+void RoadmapJournal::projectAdded()
+{
+	record(encode(ProjectAdded));
+}
+
+void RoadmapJournal::projectRemoved(int position)
+{
+	record(encode(ProjectRemoved, qint32(position)));
+}
+
+void RoadmapJournal::projectMoved(int position, int delta)
+{
+	record(encode(ProjectMoved, qint32(position), qint32(delta)));
+}
+
+void RoadmapJournal::projectName(int position, const QString& name)
+{
+	record(encode(ProjectName, qint32(position), name));
+}
+
+void RoadmapJournal::projectColor(int position, const QColor& color)
+{
+	record(encode(ProjectColor, qint32(position), color));
+}
+
+void RoadmapJournal::elementAdded(int project, int type, int id)
+{
+	record(encode(ElementAdded, qint32(project), qint32(type), qint32(id)));
+}
+
+void RoadmapJournal::elementRemoved(int id)
+{
+	record(encode(ElementRemoved, qint32(id)));
+}
+
+void RoadmapJournal::elementMoved(int id, int delta)
+{
+	record(encode(ElementMoved, qint32(id), qint32(delta)));
+}
+
+void RoadmapJournal::elementName(int id, const QString& name)
+{
+	record(encode(ElementName, qint32(id), name));
+}
+
+void RoadmapJournal::elementDate(int id, const QDate& date)
+{
+	record(encode(ElementDate, qint32(id), date));
+}
+
+void RoadmapJournal::taskDays(int id, int days)
+{
+	record(encode(TaskDays, qint32(id), qint32(days)));
+}
+
+void RoadmapJournal::milestoneDelivered(int id, bool delivered)
+{
+	record(encode(MilestoneDelivered, qint32(id), delivered));
+}
+
+void RoadmapJournal::linkAdded(int parent, int child)
+{
+	record(encode(LinkAdded, qint32(parent), qint32(child)));
+}
+
+void RoadmapJournal::linkRemoved(int parent, int child)
+{
+	record(encode(LinkRemoved, qint32(parent), qint32(child)));
+}
+
+void RoadmapJournal::record(const QByteArray& payload)
+{
+	QByteArray framed;
+	framed.reserve(RecordHeader + payload.size());
+
+	QDataStream out(&framed, QIODevice::WriteOnly);
+	out << quint32(payload.size()) << quint16(qChecksum(payload.constData(), uint(payload.size())));
+	out.writeRawData(payload.constData(), payload.size());
+
+	m_pending.append(framed);
+	m_pendingcount++;
+
+	if (m_wal != nullptr)
+		m_wal->append(framed);
+}
+
+bool RoadmapJournal::hasPending() const
+{
+	return m_pendingcount > 0;
+}
+
+int RoadmapJournal::pendingCount() const
+{
+	return m_pendingcount;
+}
+
+QByteArray RoadmapJournal::pending() const
+{
+	return m_pending;
+}
+
+void RoadmapJournal::restorePending(const QByteArray& records)
+{
+	m_pending.append(records);
+
+	for (int at = 0; at + RecordHeader <= records.size(); at += RecordHeader + int(qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(records.constData()) + at)))
+		m_pendingcount++;
+
+	if (m_wal != nullptr)
+		m_wal->append(records);
+}
+
+void RoadmapJournal::setWal(RoadmapWal* wal)
+{
+	m_wal = wal;
+}
+
+QByteArray RoadmapJournal::takePending()
+{
+	QByteArray pending = m_pending;
+	m_pending.clear();
+	m_pendingcount = 0;
+	return pending;
+}
+
+QString RoadmapJournal::pathOf(const QString& base)
+{
+	return base + JournalExtension;
+}
+
+void RoadmapJournal::baseIdentity(const QString& base, qint64* size, qint64* modified)
+{
+	const QFileInfo info(base);
+	*size = info.exists() ? info.size() : -1;
+	*modified = info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+void RoadmapJournal::attach(const QString& base, bool valid)
+{
+	m_base = base;
+	baseIdentity(base, &m_basesize, &m_basemodified);
+	m_valid = valid || !QFile::exists(pathOf(base)); // Un journal di un'altra base va compattato via
+	takePending();
+}
+
+void RoadmapJournal::rebase(const QString& base)
+{
+	QFile::remove(pathOf(base));
+
+	m_base = base;
+	baseIdentity(base, &m_basesize, &m_basemodified);
+	m_valid = !QFile::exists(pathOf(base));
+}
+
+void RoadmapJournal::invalidate()
+{
+	m_valid = false;
+}
+
+bool RoadmapJournal::canAppend(const QString& path) const
+{
+	if (m_base.isEmpty() || path != m_base || !m_valid)
+		return false;
+
+    // La base deve essere ancora quella che conosco
+	qint64 size = 0;
+	qint64 modified = 0;
+	baseIdentity(path, &size, &modified);
+	if (size != m_basesize || modified != m_basemodified)
+		return false;
+
+    // Oltre una certa dimensione riapplicare il journal costa più che riscrivere la base
+	const qint64 journal = QFileInfo(pathOf(path)).size() + m_pending.size();
+	return journal * COMPACTRATIO <= size;
+}
+
+bool RoadmapJournal::append()
+{
+	if (m_base.isEmpty())
+		return false;
+
+	if (m_pending.isEmpty())
+		return true;
+
+	QFile file(pathOf(m_base));
+	const bool fresh = file.size() == 0; // Anche se non esiste
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+		return false;
+
+	if (fresh)
+	{
+		QDataStream out(&file);
+		out << JournalMagic << m_basesize << m_basemodified;
+		if (out.status() != QDataStream::Ok)
+			return false;
+	}
+
+	if (file.write(m_pending) != m_pending.size() || !file.flush())
+	{
+		m_valid = false; // Dopo un record scritto a metà non si può più accodare, serve un salvataggio completo
+		return false;
+	}
+
+	takePending();
+	return true;
+}
+
+bool RoadmapJournal::readHeader(QIODevice* device, qint64* size, qint64* modified)
+{
+	QDataStream in(device);
+	QByteArray magic;
+	in >> magic >> *size >> *modified;
+
+	return in.status() == QDataStream::Ok && qstrcmp(magic.constData(), JournalMagic) == 0;
+}
+
+bool RoadmapJournal::load(const QString& base, Roadmap& rmap, bool* replayed)
+{
+    // Caricare e riapplicare non sono modifiche
+	RoadmapJournal* journal = rmap.journal();
+	rmap.setJournal(nullptr);
+
+	if (!RoadmapTables::load(base, rmap)) {
+		rmap.setJournal(journal);
+		return false;
+	}
+
+	const bool applied = replay(base, rmap);
+	if (replayed != nullptr)
+		*replayed = applied;
+
+	rmap.setJournal(journal);
+	return true;
+}
+
+bool RoadmapJournal::replay(const QString& base, Roadmap& rmap)
+{
+    // In sola lettura (ad esempio su un disco di rete) il journal si riapplica comunque, senza ripararlo
+	QFile file(pathOf(base));
+	const bool writable = file.open(QIODevice::ReadWrite);
+	if (!writable && !file.open(QIODevice::ReadOnly))
+		return false;
+
+	qint64 size = 0;
+	qint64 modified = 0;
+	qint64 basesize = 0;
+	qint64 basemodified = 0;
+	baseIdentity(base, &basesize, &basemodified);
+	if (!readHeader(&file, &size, &modified) || size != basesize || modified != basemodified)
+		return false; // Journal di un'altra versione della base
+
+	rmap.loadAll(); // I record trovano gli elementi per id, servono tutti
+
+	const qint64 start = file.pos();
+	const QByteArray records = file.readAll();
+	const qint64 consumed = apply(records, rmap);
+
+    // Tolgo la coda di un'eventuale scrittura interrotta, così i prossimi record la seguono
+	if (consumed < records.size() && writable)
+		file.resize(start + consumed);
+
+	return true;
+}
+
+qint64 RoadmapJournal::apply(const QByteArray& records, Roadmap& rmap)
+{
+    // Indice degli elementi per id, mantenuto durante la riapplicazione
+	QHash<int, RoadmapProjectElement*> ids;
+	for (RoadmapProject* pro : rmap.projects())
+		for (RoadmapProjectElement* element : pro->elements())
+			ids.insert(element->id(), element);
+
+    // Le modifiche riapplicate non sono nuove modifiche
+	RoadmapJournal* journal = rmap.journal();
+	rmap.setJournal(nullptr);
+
+	QDataStream in(records);
+	qint64 consumed = 0;
+	while (records.size() - consumed >= RecordHeader)
+	{
+		quint32 length = 0;
+		quint16 checksum = 0;
+		in >> length >> checksum;
+		if (length > quint64(records.size() - consumed - RecordHeader))
+			break; // Record troncato
+
+		const QByteArray payload = records.mid(int(consumed + RecordHeader), int(length));
+		if (qChecksum(payload.constData(), length) != checksum)
+			break; // Record corrotto
+
+		in.skipRawData(int(length));
+		consumed += RecordHeader + length;
+
+		QDataStream data(payload);
+		quint8 op = 0;
+		qint32 a = 0;
+		qint32 b = 0;
+		data >> op >> a;
+
+		switch (op)
+		{
+		case ProjectAdded:
+			rmap.addProject();
+			break;
+		case ProjectRemoved:
+			if (RoadmapProject* pro = rmap.projects().value(a)) {
+				for (RoadmapProjectElement* element : pro->elements())
+					ids.remove(element->id());
+				rmap.delProject(pro);
+			}
+			break;
+		case ProjectMoved:
+			data >> b;
+			if (b > 0)
+				rmap.movNextPosition(rmap.projects().value(a));
+			else
+				rmap.movPrevPosition(rmap.projects().value(a));
+			break;
+		case ProjectName:
+			if (RoadmapProject* pro = rmap.projects().value(a)) {
+				QString name;
+				data >> name;
+				pro->setName(name);
+			}
+			break;
+		case ProjectColor:
+			if (RoadmapProject* pro = rmap.projects().value(a)) {
+				QColor color;
+				data >> color;
+				pro->setColor(color);
+			}
+			break;
+		case ElementAdded:
+			if (RoadmapProject* pro = rmap.projects().value(a)) {
+				qint32 id = 0;
+				data >> b >> id;
+				RoadmapProjectElement* element = b == PROJECT_MILESTONE
+					? static_cast<RoadmapProjectElement*>(pro->addMilestone())
+					: static_cast<RoadmapProjectElement*>(pro->addTask());
+				element->Id = id; // Lo stesso id della sessione registrata
+				ids.insert(id, element);
+			}
+			break;
+		default:
+			break;
+		}
+
+        // Le altre operazioni si riferiscono ad un elemento
+		if (op < ElementRemoved)
+			continue;
+
+		RoadmapProjectElement* element = ids.value(a);
+		if (element == nullptr)
+			continue;
+
+		switch (op)
+		{
+		case ElementRemoved:
+			ids.remove(a);
+			element->project()->delElement(element);
+			break;
+		case ElementMoved:
+			data >> b;
+			if (b > 0)
+				element->project()->movNext(element);
+			else
+				element->project()->movPrev(element);
+			break;
+		case ElementName: {
+			QString name;
+			data >> name;
+			element->setName(name);
+			break;
+		}
+		case ElementDate: {
+			QDate date;
+			data >> date;
+			element->setDate(date);
+			break;
+		}
+		case TaskDays:
+			data >> b;
+			if (element->type() == PROJECT_TASK)
+				static_cast<RoadmapTask*>(element)->setDays(b);
+			break;
+		case MilestoneDelivered: {
+			bool delivered = false;
+			data >> delivered;
+			if (element->type() == PROJECT_MILESTONE)
+				static_cast<RoadmapMilestone*>(element)->setDelivered(delivered);
+			break;
+		}
+		case LinkAdded:
+		case LinkRemoved:
+			data >> b;
+			if (RoadmapProjectElement* child = ids.value(b)) {
+				if (op == LinkAdded)
+					element->addChild(child);
+				else
+					element->remChild(child);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	rmap.setJournal(journal);
+	return consumed;
+}
@@ -0,0 +1,175 @@
+#pragma once
+/*
+ * Questo file contiene la definizione di RoadmapJournal
+ *
+ *  - RoadmapJournal
+ *      -> registra le modifiche fatte alla Roadmap come record binari compatti, per salvare
+ *         in modo incrementale: invece di riscrivere tutto il file i record vengono accodati
+ *         al journal (<file>.journal) accanto al file base, il salvataggio costa quanto le
+ *         modifiche e non quanto il file. All'apertura il journal viene riapplicato sulla base.
+ *
+ *         La Roadmap chiama il journal da ogni metodo che la modifica (Roadmap::setJournal),
+ *         i progetti sono identificati dalla posizione e gli elementi dall'id: riapplicati
+ *         nello stesso ordine sulla stessa base i record riproducono le stesse modifiche.
+ *
+ *         Il journal ricorda la base su cui è stato scritto (dimensione e data di modifica),
+ *         un journal che non corrisponde più alla base viene ignorato.
+ *         Quando il journal supera 1/COMPACTRATIO della base si torna al salvataggio completo
+ *         (compattazione), che riscrive la base ed elimina il journal.
+ *
+ * Formato del file: magic string e identità della base serializzate con QDataStream,
+ * poi i record uno dopo l'altro, ognuno con lunghezza, checksum e dati:
+ *   quint32 lunghezza, quint16 qChecksum dei dati, quint8 Operation, campi dell'operazione
+ * Un record troncato o con checksum errato (scrittura interrotta) chiude il journal.
+ */
+#include <QByteArray>
+#include <QString>
+#include <QDate>
+#include <QColor>
+
+class QIODevice;
+class Roadmap;
+class RoadmapWal;
+
+#define JournalMagic "RoadmapJournal01"
+#define JournalExtension ".journal"
+
+class RoadmapJournal
+{
+public:
+    enum
+    {
+        COMPACTRATIO = 4 // Il journal viene compattato quando supera 1/4 della base
+    };
+
+    /*
+     * Operazioni registrate, il valore viene scritto nel record
+     */
+    enum Operation
+    {
+        ProjectAdded = 1, // Progetto aggiunto in coda
+        ProjectRemoved, // Posizione
+        ProjectMoved, // Posizione, spostamento (+1 o -1)
+        ProjectName, // Posizione, nome
+        ProjectColor, // Posizione, colore
+        ElementAdded, // Posizione del progetto, tipo, id
+        ElementRemoved, // Id
+        ElementMoved, // Id, spostamento (+1 o -1)
+        ElementName, // Id, nome
+        ElementDate, // Id, data
+        TaskDays, // Id, durata
+        MilestoneDelivered, // Id, stato
+        LinkAdded, // Id del padre, id del figlio
+        LinkRemoved // Id del padre, id del figlio
+    };
+
+private:
+    QByteArray m_pending; // Record registrati e non ancora scritti
+    int m_pendingcount = 0;
+    QString m_base; // File base a cui si riferisce il journal, vuoto se non c'è
+    qint64 m_basesize = -1; // Identità della base quando è stata salvata o caricata
+    qint64 m_basemodified = -1;
+    bool m_valid = false; // Il journal su disco (se esiste) appartiene alla base
+    RoadmapWal* m_wal = nullptr; // Log della sessione che riceve ogni record, non posseduto
+
+public:
+    /*
+     * Registrazione delle modifiche, chiamate dalla Roadmap
+     */
+	void projectAdded();
+	void projectRemoved(int position);
+	void projectMoved(int position, int delta);
+	void projectName(int position, const QString& name);
+	void projectColor(int position, const QColor& color);
+	void elementAdded(int project, int type, int id);
+	void elementRemoved(int id);
+	void elementMoved(int id, int delta);
+	void elementName(int id, const QString& name);
+	void elementDate(int id, const QDate& date);
+	void taskDays(int id, int days);
+	void milestoneDelivered(int id, bool delivered);
+	void linkAdded(int parent, int child);
+	void linkRemoved(int parent, int child);
+
+    /*
+     * Record registrati dall'ultimo salvataggio
+     */
+	bool hasPending() const;
+	int pendingCount() const;
+
+    /*
+     * Record registrati (già incorniciati), takePending li toglie dal journal
+     */
+	QByteArray pending() const;
+	QByteArray takePending();
+
+    /*
+     * Aggiunge ai record registrati dei record recuperati (ad esempio dal log di una
+     * sessione interrotta, già riapplicati alla Roadmap), come se fossero appena stati fatti
+     */
+	void restorePending(const QByteArray& records);
+
+    /*
+     * Imposta il log della sessione a cui viene passato ogni record (Vedi RoadmapWal)
+     */
+	void setWal(RoadmapWal* wal);
+
+    /*
+     * Associa il journal alla base appena caricata, valid indica se il journal
+     * su disco è stato riapplicato (e quindi si può continuare ad accodare)
+     */
+	void attach(const QString& base, bool valid);
+
+    /*
+     * Dopo un salvataggio completo: elimina il journal su disco e ricorda la nuova
+     * identità della base. I record registrati restano: i record già contenuti nella base
+     * vanno tolti con takePending() quando la base viene fotografata
+     */
+	void rebase(const QString& base);
+
+    /*
+     * Il journal su disco non è più allineato con le modifiche (ad esempio dopo un
+     * salvataggio completo fallito), il prossimo salvataggio deve essere completo
+     */
+	void invalidate();
+
+    /*
+     * Indica se il salvataggio su path può essere incrementale: stessa base, non modificata
+     * da altri, journal valido e non troppo grande rispetto alla base
+     */
+	bool canAppend(const QString& path) const;
+
+    /*
+     * Accoda i record registrati al journal della base (lo crea se non esiste)
+     */
+	bool append();
+
+    /*
+     * Carica base nella Roadmap (vuota) con RoadmapTables::load e riapplica il suo journal:
+     * dopo un salvataggio incrementale le ultime modifiche sono solo nel journal, per questo
+     * ogni lettore (finestra principale, riga di comando) deve caricare i file da qui.
+     * Ritorna false se il file non si apre, replayed indica se il journal è stato riapplicato.
+     * Lancia std::exception come operator >> se il contenuto non è valido
+     */
+	static bool load(const QString& base, Roadmap& rmap, bool* replayed = nullptr);
+
+    /*
+     * Riapplica il journal di base sulla Roadmap appena caricata da base,
+     * ritorna false se non c'è un journal che appartiene alla base
+     */
+	static bool replay(const QString& base, Roadmap& rmap);
+
+    /*
+     * Riapplica dei record sulla Roadmap, si ferma al primo record troncato o corrotto.
+     * Ritorna il numero di byte consumati
+     */
+	static qint64 apply(const QByteArray& records, Roadmap& rmap);
+
+	static QString pathOf(const QString& base);
+
+private:
+	void record(const QByteArray& payload);
+
+	static bool readHeader(QIODevice* device, qint64* size, qint64* modified);
+	static void baseIdentity(const QString& base, qint64* size, qint64* modified);
+};
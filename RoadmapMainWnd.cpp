@@ -3,11 +3,16 @@
 #include "RoadmapModel.hpp"
 #include "RoadmapItemDelegate.hpp"
 #include "RoadmapGrid.hpp"
+#include "RoadmapMinimap.hpp"
+#include "RoadmapPrinter.hpp"
+#include "RoadmapFormat.hpp"
+#include "RoadmapJournal.hpp"
+#include "RoadmapSaver.hpp"
+#include "RoadmapWal.hpp"
 
 #define SoftwareName "Roadmap Planet"
 #define FormatExtension ".ropl"
-#define MaxZoom 100
-#define MinZoom 20
+#define ExportDpi 200 // Risoluzione delle pagine esportate
 
 #include <QCloseEvent>
 #include <QPushButton>
@@ -21,21 +26,103 @@
 #include <KDGantt>
 #include <KDGanttGlobal>
 #include <QLineEdit>
+#include <QInputDialog>
+#include <QDockWidget>
+#include <QProgressDialog>
+#include <QScrollBar>
+#include <QStatusBar>
+#include <QProgressBar>
+#include <QRegularExpression>
+#include <QLockFile>
+#include <limits>
 
 RoadmapMainWnd::RoadmapMainWnd(QWidget *parent)
 	: QMainWindow(parent)
 {
     initToolbar(); // Creo la toolbar con tutti i bottoni
+    initMinimap(); // Creo il dock della panoramica
+    initStatusBar(); // Creo la status bar
+    m_wal = new RoadmapWal(); // Il log della sessione, scritto dal suo thread
     clearLayout(); // Pulisco il layout (Qua serve solo per impostare i bottoni disabilitati)
 }
 
 RoadmapMainWnd::~RoadmapMainWnd()
 {
+    delete m_saver; // Aspetta l'eventuale salvataggio in corso
+    delete m_wal; // Scrive quello che è ancora in coda
+}
+
+void RoadmapMainWnd::recover()
+{
+	for (const QString& path : RoadmapWal::logs())
+	{
+		if (path == m_wal->path())
+			continue;
+
+        // Il lock si prende solo se il processo che scriveva il log non esiste più
+		QLockFile lock(RoadmapWal::lockPathOf(path));
+		lock.setStaleLockTime(0);
+		if (!lock.tryLock(0))
+			continue; // Istanza ancora in esecuzione (o un'altra lo sta già recuperando)
+
+		RoadmapWalHeader header;
+		QByteArray records;
+		if (!RoadmapWal::read(path, &header, &records) || records.isEmpty()) {
+			QFile::remove(path); // Niente da recuperare
+			continue;
+		}
+
+		const QString document = header.Base.isEmpty() ? QString("A new roadmap") : header.Base;
+		if (!Ask("Recover", document + " was not closed properly.\nDo you want to recover the unsaved changes?")) {
+			QFile::remove(path);
+			continue;
+		}
+
+        // Le modifiche valgono solo sullo stesso salvataggio su cui sono state fatte
+		if (!header.Base.isEmpty() && !header.matches()) {
+			Say("Warning", "The file has changed since the changes were made, they can't be recovered.");
+			QFile::remove(path);
+			continue;
+		}
+
+		if (recover(header, records))
+			QFile::remove(path); // Le modifiche adesso sono nel log di questa sessione
+		return; // La finestra mostra un documento alla volta, gli altri log restano per il prossimo avvio
+	}
+}
+
+bool RoadmapMainWnd::recover(const RoadmapWalHeader& header, const QByteArray& records)
+{
+	if (header.Base.isEmpty()) {
+		setupGantt();
+	} else {
+		m_filepath = header.Base;
+		if (!tryLoad()) {
+			m_filepath = "";
+			return false;
+		}
+	}
 
+    /*
+     * Il modello non ha ancora mostrato nessuna riga (il refresh è in attesa),
+     * carico gli elementi direttamente e riapplico i record che li trovano per id
+     */
+	Roadmap* rmap = m_model->roadmap();
+	rmap->loadAll();
+	const qint64 consumed = RoadmapJournal::apply(records, *rmap);
+
+    // Le modifiche recuperate sono di nuovo modifiche non salvate, nel journal e nel log
+	m_journal->restorePending(records.left(int(consumed)));
+	m_model->emitChanged();
+	m_pendingchanges = true;
+	refreshTitle();
+	return true;
 }
 
 void RoadmapMainWnd::closeEvent(QCloseEvent* e)
 {
+    m_saver->wait(); // Il flag delle modifiche vale solo a salvataggio concluso
+
 	if(m_pendingchanges)
 		if(!Ask("Warning", "Exit without save?"))
             if (!ensureClose())
@@ -47,6 +134,63 @@ void RoadmapMainWnd::closeEvent(QCloseEvent* e)
     clearLayout();
 }
 
+void RoadmapMainWnd::initStatusBar()
+{
+	m_saveprogress = new QProgressBar(this);
+	m_saveprogress->setRange(0, 100);
+	m_saveprogress->setMaximumWidth(200);
+	m_saveprogress->setFormat("Saving %p%");
+	m_saveprogress->hide();
+	statusBar()->addPermanentWidget(m_saveprogress);
+
+	m_saver = new RoadmapSaver();
+	m_saver->setProgress([=](int percent)
+	{
+		m_saveprogress->setValue(percent);
+	});
+}
+
+void RoadmapMainWnd::initMinimap()
+{
+	m_minimapdock = new QDockWidget("Overview", this);
+	m_minimapdock->setFeatures(QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetFloatable);
+	m_minimapdock->setAllowedAreas(Qt::TopDockWidgetArea | Qt::BottomDockWidgetArea);
+
+	m_minimap = new RoadmapMinimap(m_minimapdock);
+	m_minimapdock->setWidget(m_minimap);
+	addDockWidget(Qt::BottomDockWidgetArea, m_minimapdock);
+
+	m_minimap->setNavigate([=](const QModelIndex& index, const QDate& date) // Click sulla panoramica
+	{
+		if (m_gantt == nullptr) return;
+
+        // Prima la riga nella treeview (KDGantt sincronizza lo scroll verticale del Gantt)
+		if (index.isValid())
+			treeView()->scrollTo(index, QAbstractItemView::PositionAtCenter);
+
+        // Poi centro il Gantt sulla data mantenendo la riga
+		QGraphicsView* gview = m_gantt->graphicsView();
+		const qreal y = gview->mapToScene(gview->viewport()->rect().center()).y();
+		gview->centerOn(grid()->mapFromDateTime(QDateTime(date)), y);
+	});
+}
+
+void RoadmapMainWnd::refreshMinimapArea()
+{
+	if (m_gantt == nullptr) return;
+
+	QGraphicsView* gview = m_gantt->graphicsView();
+	const QRectF area = gview->mapToScene(gview->viewport()->rect()).boundingRect();
+
+	const QModelIndex top = treeView()->indexAt(QPoint(0, 0));
+	const QModelIndex bottom = treeView()->indexAt(QPoint(0, treeView()->viewport()->height() - 1));
+
+	m_minimap->setVisibleArea(grid()->mapToDateTime(area.left()).date(),
+		grid()->mapToDateTime(area.right()).date(),
+		m_minimap->rowOf(top),
+		bottom.isValid() ? m_minimap->rowOf(bottom) : std::numeric_limits<int>::max()); // Sotto l'ultima riga è tutto visibile
+}
+
 void RoadmapMainWnd::initToolbar()
 {
 	m_toolbar = new QToolBar(this);
@@ -61,8 +205,10 @@ void RoadmapMainWnd::initToolbar()
     m_new = m_toolbar->addAction(QIcon(":/Icons/document-new-4.png"), "New.."); // Creo il bottone New (Con relativa icona)
     QObject::connect(m_new, &QAction::triggered, this, [=]() // Sull'evento di attivazione dell'evento attacco una lambda
 	{
-        if(ensureClose()) // Mi assicuro non ci sia niente di aperto
+        if(ensureClose()) { // Mi assicuro non ci sia niente di aperto
             setupGantt(); // Creo un nuovo Gantt vuoto
+            syncCompression(false); // Un documento nuovo parte non compresso
+        }
 	});
 
     m_open = m_toolbar->addAction(QIcon(":/Icons/folder-open-3.png"), "Open.."); // Creo il bottone Open
@@ -90,23 +236,26 @@ void RoadmapMainWnd::initToolbar()
             m_filepath = fpath; // se ensureSave() non è riuscita a salvare reimposto il percorso precedente
 	});
 
+    m_compress = m_toolbar->addAction(QIcon(":/Icons/shopping-bag.png"), "Compressed Files"); // Salvataggi compressi, per i file su disco di rete
+	m_compress->setCheckable(true);
+	QObject::connect(m_compress, &QAction::toggled, this, [=](bool checked)
+	{
+		m_saver->setCompressed(checked);
+
+        // Il journal accoda alla base così com'è, il prossimo salvataggio la riscrive nel nuovo formato
+		if (m_journal != nullptr)
+			m_journal->invalidate();
+	});
+
     m_zoomIn = m_toolbar->addAction(QIcon(":/Icons/zoom-in.png"), "Zoom In"); // Creo il bottone Zoom In
     QObject::connect(m_zoomIn, &QAction::triggered, this, [=]()
 	{
         if (m_gantt == nullptr) return; // Check
 
-        qreal dayWidth = grid()->dayWidth() + 10; // Ingrandisco la colonna del giorno di 10 pixel
-        if (dayWidth > MaxZoom) { // Se sono andato oltre il massimo
-            dayWidth = MaxZoom; // Reimposto sul massimo
-            m_zoomIn->setEnabled(false); // Disabilito lo zoom In
-		}
-		else
-            m_zoomOut->setEnabled(true); // nel caso fosse andato ok, abilito lo zoom out
+        grid()->zoomIn(); // La grid sceglie anche la scala adatta (giorni, settimane, mesi, ...) (Vedi RoadmapGrid)
 
-        if (dayWidth >= 50) // Sopra una certa soglia faccio vedere una descrizione più estesa su settimane\giorni (Vedi RoadmapGrid)
-			grid()->setScale(KDGantt::DateTimeGrid::ScaleUserDefined);
-
-        grid()->setDayWidth(dayWidth); // Imposto la grandezza
+        m_zoomIn->setEnabled(grid()->canZoomIn()); // Se sono arrivato al massimo disabilito lo zoom In
+        m_zoomOut->setEnabled(grid()->canZoomOut());
 	});
 
     m_zoomOut = m_toolbar->addAction(QIcon(":/Icons/zoom-out.png"), "Zoom Out"); // Creo il bottone Zoom out
@@ -115,18 +264,19 @@ void RoadmapMainWnd::initToolbar()
         // Stessa logica di ZoomIn al contrario
 		if (m_gantt == nullptr) return;
 
-		qreal dayWidth = grid()->dayWidth() - 10;
-		if (dayWidth < MinZoom) {
-			dayWidth = MinZoom;
-			m_zoomOut->setEnabled(false);
-		}
-		else
-			m_zoomIn->setEnabled(true);
+		grid()->zoomOut();
+
+		m_zoomIn->setEnabled(grid()->canZoomIn());
+		m_zoomOut->setEnabled(grid()->canZoomOut());
+	});
 
-		if (dayWidth <= 50)
-			grid()->setScale(KDGantt::DateTimeGrid::ScaleDay);
+    m_tiled = m_toolbar->addAction(QIcon(":/Icons/settings-1.png"), "Background Rendering"); // Rendering del Gantt a tile sui thread di lavoro
+	m_tiled->setCheckable(true);
+	QObject::connect(m_tiled, &QAction::toggled, this, [=](bool checked)
+	{
+		if (m_gantt == nullptr) return;
 
-		grid()->setDayWidth(dayWidth);
+		static_cast<RoadmapView*>(m_gantt->graphicsView())->setTiledRendering(checked);
 	});
 
     m_moveUp = m_toolbar->addAction(QIcon(":/Icons/go-up-4.png"), "Move Up"); // Creo il bottone Move Up
@@ -135,9 +285,13 @@ void RoadmapMainWnd::initToolbar()
         if (m_gantt == nullptr) return;
 
         if (selectionModel()->hasSelection()) { // Se c'è qualcosa di selezionato
-            QModelIndex idx = selectionModel()->currentIndex( ); // Ottengo l'indice selezionato
-            if(m_model->moveRows(idx.parent(), idx.row(), 1, idx.parent(), idx.row() - 1)) // Yento di muoverlo
-                selectRow(idx.parent(), idx.row() - 1); // Se si è mosso lo riseleziono
+            QModelIndexList rows = selectedRows(); // Ottengo tutte le righe selezionate
+            QList<RoadmapElement*> moved;
+            for (const QModelIndex& idx : rows)
+                moved.append(ModelUtility::unbox(idx));
+
+            m_model->moveIndexes(rows, -1); // Le sposto tutte con un solo aggiornamento del modello
+            selectElements(moved); // Le riseleziono nella nuova posizione
 		}
 	});
 
@@ -148,9 +302,13 @@ void RoadmapMainWnd::initToolbar()
 		if (m_gantt == nullptr) return;
 
 		if (selectionModel()->hasSelection()) {
-			QModelIndex idx = selectionModel()->currentIndex();
-			m_model->moveRows(idx.parent(), idx.row(), 1, idx.parent(), idx.row() + 1);
-			selectRow(idx.parent(), idx.row() + 1);
+			QModelIndexList rows = selectedRows();
+			QList<RoadmapElement*> moved;
+			for (const QModelIndex& idx : rows)
+				moved.append(ModelUtility::unbox(idx));
+
+			m_model->moveIndexes(rows, 1);
+			selectElements(moved);
 		}
 	});
 
@@ -160,11 +318,18 @@ void RoadmapMainWnd::initToolbar()
 		if (m_gantt->model() == nullptr)
 			return;
 
-        QString filter = "PDF File (*.pdf)"; // Chiedo una desetinazione .pdf
-        QString file = QFileDialog::getSaveFileName(this, "Select file", "", filter, &filter);
+        /*
+         * Chiedo una desetinazione .pdf o .png, il PDF resta vettoriale (testi selezionabili):
+         * le pagine rasterizzate sono un'opzione esplicita per i Gantt troppo pesanti da aprire
+         */
+        QString filter = "PDF File (*.pdf)";
+        QString file = QFileDialog::getSaveFileName(this, "Select file", "", "PDF File (*.pdf);;PDF File, raster pages (*.pdf);;PNG Images (*.png)", &filter);
         if(file.isEmpty()) // Se ritorna un valore valido
             return;
 
+        const bool png = filter.startsWith("PNG") || file.endsWith(".png", Qt::CaseInsensitive);
+        const bool raster = !png && filter.startsWith("PDF File, raster");
+
         // Renderizzo in una QPrinter appositamente creata
 
         //Creazione della stampante
@@ -175,7 +340,47 @@ void RoadmapMainWnd::initToolbar()
         printer.setOutputFormat(QPrinter::PdfFormat); // Impostazione Pdf
         printer.setOutputFileName(file); // File di destinazione
 
-        m_gantt->print(&printer, false, true); // Commit sulla stampante
+        /*
+         * Esporto su più pagine, una alla volta, con header e nomi delle righe ripetuti
+         * (Vedi RoadmapPrinter), il dialog di avanzamento permette di interrompere
+         */
+		RoadmapPrinter exporter(m_gantt->graphicsView());
+		if (raster)
+			exporter.setRasterResolution(ExportDpi); // Le pagine vengono rasterizzate in parallelo
+		const int pages = png
+			? exporter.layout(QSizeF(297., 210.) / 25.4 * ExportDpi, ExportDpi).pages()
+			: exporter.layout(&printer).pages();
+		if (pages == 0) {
+			Say("Warning", "Nothing to export.");
+			return;
+		}
+
+		QProgressDialog progress("Exporting pages...", "Cancel", 0, pages, this);
+		progress.setWindowModality(Qt::WindowModal);
+		progress.setMinimumDuration(500);
+
+		auto advance = [&](int page, int count)
+		{
+			progress.setValue(page);
+			progress.setLabelText(QString("Exporting page %1 of %2...").arg(page).arg(count));
+			QCoreApplication::processEvents(); // Aggiorno il dialog e leggo il Cancel
+			return !progress.wasCanceled();
+		};
+
+        /*
+         * Le immagini PNG sono una per pagina (A4 orizzontale): nome-001.png, nome-002.png...
+         */
+		bool done;
+		if (png) {
+			QString path = file;
+			path.replace(QRegularExpression("\\.png$", QRegularExpression::CaseInsensitiveOption), "");
+			done = exporter.exportImages(path + "-%1.png", QSizeF(297., 210.), ExportDpi, advance);
+		}
+		else
+			done = exporter.print(&printer, advance);
+
+		if (!done && !progress.wasCanceled())
+			Say("Error", "An error occured exporting the roadmap.");
 	});
 
     m_addProject = m_toolbar->addAction(QIcon(":/Icons/list.png"), "Add Project"); // Pulsante aggiungi progetto
@@ -184,6 +389,7 @@ void RoadmapMainWnd::initToolbar()
 		if (m_gantt == nullptr) return;
 
         int prjRow = getProjectInsertRow(); // Ottengo la riga di inserimento
+        RoadmapBatch batch(m_model); // Inserimento e inizializzazione producono un solo refresh del modello
         if (m_model->insertRows(prjRow, 1, QModelIndex())) { // Tento di inserirlo
 
             // Se l'inserimento aviene con successo, ottengo l'indice della colonna Nome
@@ -215,6 +421,7 @@ void RoadmapMainWnd::initToolbar()
         if(!project.isValid()) return; // Se non ci sono riuscito early exit
 
         int row = getProjectElementInsertRow(); // Ottengo la riga di inserimento
+        RoadmapBatch batch(m_model); // Un solo refresh per inserimento, nome e data
         if (m_model->insertRows(row, 1, project)) { // Tento di inserire la riga
             //Imposto il nome a seconda del numero degli elementi
             QModelIndex taskIndexName = m_model->index(row, Name, project);
@@ -239,6 +446,7 @@ void RoadmapMainWnd::initToolbar()
         if(!project.isValid()) return;
 
 		int row = getProjectElementInsertRow();
+		RoadmapBatch batch(m_model);
 		if (m_model->insertRows(row, 1, project)) {
 			QModelIndex milestone = m_model->index(row, Type, project);
 			m_model->setData(milestone, KDGantt::TypeEvent, KDGantt::ItemTypeRole);
@@ -265,11 +473,12 @@ void RoadmapMainWnd::initToolbar()
 		if (m_gantt == nullptr) return;
 
 		if (selectionModel()->hasSelection()) {
-            QModelIndex todelete = selectionModel()->currentIndex();
-			int row = todelete.row();
-			QModelIndex parent = todelete.parent();
+            QModelIndexList todelete = selectedRows();
+            QModelIndex current = selectionModel()->currentIndex();
+			int row = current.row();
+            QPersistentModelIndex parent = current.parent(); // Persistente: il padre potrebbe essere tra le righe eliminate
 			selectionModel()->clear();
-			m_model->removeRows(row, 1, parent);
+            m_model->removeIndexes(todelete); // Elimino tutta la selezione con un solo aggiornamento
 			int rc = m_model->rowCount(parent);
 			if(rc > 0)
 			{
@@ -283,6 +492,46 @@ void RoadmapMainWnd::initToolbar()
 			}
 		}
 	});
+
+    m_shiftDates = m_toolbar->addAction(QIcon(":/Icons/route.png"), "Shift Dates"); // Sposta le date della selezione
+	QObject::connect(m_shiftDates, &QAction::triggered, [=]()
+	{
+		if (m_gantt == nullptr) return;
+		if (!selectionModel()->hasSelection()) return;
+
+		bool ok = false;
+		int days = QInputDialog::getInt(this, "Shift Dates", "Days (negative to move back):", 7, -3650, 3650, 1, &ok);
+		if (ok)
+            m_model->shiftDates(selectedRows(), days); // Un progetto selezionato sposta tutti i suoi elementi
+	});
+
+    m_setDuration = m_toolbar->addAction(QIcon(":/Icons/bar-chart-horizontal.png"), "Set Duration"); // Imposta la durata dei task selezionati
+	QObject::connect(m_setDuration, &QAction::triggered, [=]()
+	{
+		if (m_gantt == nullptr) return;
+		if (!selectionModel()->hasSelection()) return;
+
+		bool ok = false;
+		int days = QInputDialog::getInt(this, "Set Duration", "Duration in days:", 5, 1, 3650, 1, &ok);
+		if (ok)
+			m_model->setDuration(selectedRows(), days);
+	});
+
+    m_deliver = m_toolbar->addAction(QIcon(":/Icons/pencil.png"), "Delivered"); // Segna come consegnate le milestone selezionate
+	QObject::connect(m_deliver, &QAction::triggered, [=]()
+	{
+		if (m_gantt == nullptr) return;
+		if (!selectionModel()->hasSelection()) return;
+
+        // Se sono già tutte consegnate il comando le riapre, altrimenti le consegna tutte
+		QModelIndexList rows = selectedRows();
+		bool allDelivered = true;
+		for (const QModelIndex& idx : rows)
+			if (idx.data(KDGantt::ItemTypeRole).toInt() == KDGantt::TypeEvent)
+				allDelivered &= m_model->index(idx.row(), Delivered, idx.parent()).data(Qt::EditRole).toBool();
+
+		m_model->setDelivered(rows, !allDelivered);
+	});
 }
 
 void RoadmapMainWnd::setupGantt()
@@ -291,6 +540,11 @@ void RoadmapMainWnd::setupGantt()
 
 	m_gantt = new KDGantt::View();
 	auto view = new RoadmapView();
+	view->setZoomChanged([=]() // Lo zoom continuo (Ctrl + rotella) cambia il dayWidth senza passare dai bottoni
+	{
+		m_zoomIn->setEnabled(grid()->canZoomIn());
+		m_zoomOut->setEnabled(grid()->canZoomOut());
+	});
 	
     m_gantt->setGraphicsView(view); // imposto la view
 	
@@ -310,18 +564,34 @@ void RoadmapMainWnd::setupGantt()
 	//auto rmap = createSampleRoadmap(this);
     auto rmap = new Roadmap(this); // Creo la Roadmap
     m_model = new RoadmapModel(rmap); // Creo il modello e glie la passo al modello
+    m_journal = new RoadmapJournal(); // Registra le modifiche per i salvataggi incrementali
+    m_journal->setWal(m_wal); // e le passa al log della sessione
+    rmap->setJournal(m_journal);
+    m_wal->start(RoadmapWalHeader::of(m_filepath));
 
     m_gantt->setModel(m_model); // Imposto il modello sul gantt
     m_gantt->setConstraintModel(m_model->constraintModel()); // Imposto il ConstraintModel sul Gantt
     view->setSelectionModel(selectionModel()); // Imposto il selection model sulla view
 
+    m_minimap->setModel(m_model, treeView()); // La panoramica segue le modifiche del modello e le righe espanse
+
+    // Lo scroll e lo zoom del Gantt spostano il rettangolo dell'area visibile sulla panoramica
+	connect(view->horizontalScrollBar(), &QScrollBar::valueChanged, this, &RoadmapMainWnd::refreshMinimapArea);
+	connect(view->horizontalScrollBar(), &QScrollBar::rangeChanged, this, &RoadmapMainWnd::refreshMinimapArea);
+	connect(view->verticalScrollBar(), &QScrollBar::valueChanged, this, &RoadmapMainWnd::refreshMinimapArea);
+	connect(view->verticalScrollBar(), &QScrollBar::rangeChanged, this, &RoadmapMainWnd::refreshMinimapArea);
+
     /*
      * Questi eventi mi indicano la dove il modello abbia committato qualche modifica
      * per sporcare il flag di changed
      */
     connect(m_model, &QAbstractItemModel::dataChanged, this, &RoadmapMainWnd::notifyChanged);
 	connect(m_model, &QAbstractItemModel::rowsRemoved, this, &RoadmapMainWnd::notifyChanged);
-	connect(m_model, &QAbstractItemModel::rowsInserted, this, &RoadmapMainWnd::notifyChanged);
+	connect(m_model, &QAbstractItemModel::rowsInserted, this, [=]()
+	{
+        if (!m_model->isFetching()) // Le righe caricate pigramente dal file non sono modifiche
+			notifyChanged();
+	});
 	connect(m_model, &QAbstractItemModel::rowsAboutToBeMoved, this, &RoadmapMainWnd::notifyChanged);
 
     connect(selectionModel(), &QItemSelectionModel::selectionChanged, this, [=]() // Sul cambio di selezione
@@ -339,6 +609,9 @@ void RoadmapMainWnd::setupGantt()
 			m_addMilestone->setEnabled(true);
 			m_addTask->setEnabled(true);
             m_delete->setEnabled(true);
+			m_shiftDates->setEnabled(true);
+			m_setDuration->setEnabled(true);
+			m_deliver->setEnabled(true);
         }
 		else
 		{
@@ -348,11 +621,15 @@ void RoadmapMainWnd::setupGantt()
 			m_moveUp->setEnabled(false);
 			m_moveDown->setEnabled(false);
 			m_delete->setEnabled(false);
+			m_shiftDates->setEnabled(false);
+			m_setDuration->setEnabled(false);
+			m_deliver->setEnabled(false);
 		}
 	});
 
 
     // Imposto la grandezza delle colonne
+    treeView()->setSelectionMode(QAbstractItemView::ExtendedSelection); // Permetto la selezione multipla per le modifiche massive
     treeView()->hideColumn(Type); // Nascondo la colonna del tipo
 	treeView()->setColumnWidth(Name, 140);
 	treeView()->setColumnWidth(StartDate, 80);
@@ -366,14 +643,24 @@ void RoadmapMainWnd::setupGantt()
 	m_save->setEnabled(true);
 	m_saveas->setEnabled(true);
 	m_addProject->setEnabled(true);
-	m_zoomIn->setEnabled(true);
-	m_zoomOut->setEnabled(true);
+	m_zoomIn->setEnabled(grid()->canZoomIn());
+	m_zoomOut->setEnabled(grid()->canZoomOut());
+	m_tiled->setEnabled(true);
+	view->setTiledRendering(m_tiled->isChecked()); // Il nuovo Gantt mantiene la modalità scelta
 	m_print->setEnabled(true);
 	m_pendingchanges = false;
 
 	refreshTitle();
 }
 
+void RoadmapMainWnd::syncCompression(bool compressed)
+{
+    // Non passo dal toggled: il journal del documento appena aperto è già nel formato giusto
+	QSignalBlocker blocker(m_compress);
+	m_compress->setChecked(compressed);
+	m_saver->setCompressed(compressed);
+}
+
 void RoadmapMainWnd::notifyChanged()
 {
 	if (m_pendingchanges != true) {
@@ -407,9 +694,12 @@ bool RoadmapMainWnd::ensureClose()
 	if (m_model == nullptr)
 		return true;
 
+    // Un salvataggio in corso va concluso prima: se fallisce le modifiche tornano pendenti
+	m_saver->wait();
+
 	if (m_pendingchanges)
 	{
-		if (!ensureSave())
+        if (!ensureSave() || !m_saver->wait()) // Il salvataggio deve essere riuscito prima di chiudere
 			return false;
 	}
 
@@ -461,18 +751,68 @@ bool RoadmapMainWnd::ensureSave()
 bool RoadmapMainWnd::trySave()
 {
 	try {
-		QFile file(m_filepath);
+        m_saver->wait(); // Un salvataggio alla volta, il journal deve sapere su quale base accodare
+
+        /*
+         * Salvataggio incrementale: se il file è ancora quello caricato o salvato
+         * accodo al journal solo le modifiche, altrimenti (o se il journal è cresciuto troppo)
+         * riscrivo tutto il file, che compatta il journal (Vedi RoadmapJournal)
+         */
+        if (m_journal->canAppend(m_filepath) && m_journal->append()) {
+            m_wal->start(RoadmapWalHeader::of(m_filepath)); // Le modifiche sono al sicuro nel journal
+            m_pendingchanges = false;
+            refreshTitle();
+            return true;
+        }
 
-        if (!file.open(QIODevice::WriteOnly)) // Tento di aprire il file in scrittura
-			return false;
+        // I record non validi del file sono stati caricati come task senza nome, riscriverli li perde
+        if (m_model->roadmap()->isDamaged()) {
+            if (!Ask("Warning", "Some elements of the file could not be read and were loaded empty.\nSave anyway?"))
+                return false;
+            m_model->roadmap()->acceptDamage();
+        }
+
+        /*
+         * Salvataggio completo in background (Vedi RoadmapSaver): la Roadmap viene fotografata
+         * adesso, con un costo proporzionale ai soli elementi caricati (i progetti mai espansi
+         * vengono copiati dal file mappato sul thread di lavoro, insieme alla costruzione delle tabelle),
+         * poi si può continuare a modificarla mentre il file viene scritto: le modifiche fatte
+         * nel frattempo restano nel journal per il prossimo salvataggio.
+         * Le modifiche restano pendenti finché il salvataggio non è riuscito
+         */
+        m_journal->takePending(); // Queste sono già nella fotografia
+        const QString path = m_filepath;
+
+        m_saveprogress->setValue(0);
+        m_saveprogress->show();
+        m_saver->save(path, *m_model->roadmap(), [=](bool saved)
+        {
+            m_saveprogress->hide();
+
+            if (!saved) {
+                if (m_journal != nullptr)
+                    m_journal->invalidate(); // Le modifiche fotografate non sono né nella base né nel journal
+                m_pendingchanges = true;
+                refreshTitle();
+                Say("Error", "An error occured saving file.");
+                return;
+            }
+
+            if (m_journal != nullptr && path == m_filepath) {
+                m_journal->rebase(path); // Il file contiene tutto, il journal non serve più
+
+                // Nel log restano solo le modifiche fatte durante la scrittura
+                m_wal->start(RoadmapWalHeader::of(path), m_journal->pending());
+            }
 
-        QDataStream stream(&file); // inizizlizzo lo stream in scrittura
-        stream << *m_model->roadmap(); // tento la Serializzazione
-		file.close();
+            // Restano pendenti solo le modifiche fatte durante la scrittura
+            if (m_journal != nullptr) {
+                m_pendingchanges = m_journal->hasPending();
+                refreshTitle();
+            }
+            statusBar()->showMessage("Saved " + path, 3000);
+        });
 
-        // Rinfresco il titolo e il flag per i cambiamenti in pending
-        m_pendingchanges = false;
-        refreshTitle();
 		return true;
 	}
 	catch (std::exception e)
@@ -493,11 +833,30 @@ bool RoadmapMainWnd::tryLoad()
         if (!file.open(QIODevice::ReadOnly)) // se non è stato possibile aprire il file
 			return false;
 
+        file.close(); // Il file verrà riaperto (e mappato) da RoadmapJournal::load
+
         setupGantt(); // inizializzo la finestra con il Gantt
-	
-        QDataStream stream(&file); // inizializzo lo stream di lettura
-        stream >> *m_model->roadmap(); // tento la deserializzazione
-        file.close();
+
+        /*
+         * I file v2 vengono mappati in memoria e i nomi restano viste nel file,
+         * gli altri vengono letti a flusso (Vedi RoadmapTables::load).
+         * Dai file v2 vengono creati solo i progetti, gli elementi di un progetto
+         * vengono creati quando viene espanso (RoadmapModel::fetchMore).
+         * Le modifiche salvate nel journal dopo l'ultimo salvataggio completo
+         * vengono riapplicate subito (Vedi RoadmapJournal::load)
+         */
+        Roadmap* rmap = m_model->roadmap();
+        rmap->setJournal(nullptr); // Caricare non è una modifica
+
+        bool replayed = false;
+        if (!RoadmapJournal::load(m_filepath, *rmap, &replayed))
+            return false;
+
+        syncCompression(rmap->isCompressed()); // Il file resta nel formato in cui è stato aperto
+
+        m_journal->attach(m_filepath, replayed);
+        rmap->setJournal(m_journal);
+        m_wal->start(RoadmapWalHeader::of(m_filepath)); // Il log parte da quello che c'è su disco adesso
 
 		return true;
 	}
@@ -529,25 +888,40 @@ QDate RoadmapMainWnd::newItemStartDate(QModelIndex parent, int position)
 
 void RoadmapMainWnd::clearLayout()
 {
+    m_saver->wait(); // Il salvataggio in corso chiude sul journal di questo documento
+
 	setCentralWidget(nullptr);
 
+    m_minimap->setModel(nullptr); // Sgancio la panoramica prima di distruggere il modello
+
 	if (m_gantt != nullptr) {
 		delete m_gantt;
 		m_gantt = nullptr;
 	}
 
 	if (m_model != nullptr) {
+        m_wal->discard(); // Il documento viene chiuso normalmente, non c'è niente da recuperare
+
+		Roadmap* rmap = m_model->roadmap();
 		delete m_model;
 		m_model = nullptr;
+		delete rmap; // Rilascia anche l'eventuale file mappato
 	}
+
+	delete m_journal;
+	m_journal = nullptr;
 	
 	m_addProject->setEnabled(false);
 	m_addMilestone->setEnabled(false);
 	m_addTask->setEnabled(false);
     m_delete->setEnabled(false);
+	m_shiftDates->setEnabled(false);
+	m_setDuration->setEnabled(false);
+	m_deliver->setEnabled(false);
 
 	m_zoomOut->setEnabled(false);
 	m_zoomIn->setEnabled(false);
+	m_tiled->setEnabled(false);
 
 	m_moveUp->setEnabled(false);
 	m_moveDown->setEnabled(false);
@@ -654,9 +1028,9 @@ QTreeView* RoadmapMainWnd::treeView() const
 	return reinterpret_cast<QTreeView*>(m_gantt->leftView());
 }
 
-KDGantt::DateTimeGrid* RoadmapMainWnd::grid() const
+RoadmapGrid* RoadmapMainWnd::grid() const
 {
-	return static_cast<KDGantt::DateTimeGrid*>(m_gantt->grid());
+	return static_cast<RoadmapGrid*>(m_gantt->grid());
 }
 
 QItemSelectionModel* RoadmapMainWnd::selectionModel() const
@@ -664,6 +1038,35 @@ QItemSelectionModel* RoadmapMainWnd::selectionModel() const
 	return m_gantt->selectionModel();
 }
 
+QModelIndexList RoadmapMainWnd::selectedRows() const
+{
+	QModelIndexList rows;
+	QSet<QModelIndex> seen;
+	for (const QModelIndex& idx : selectionModel()->selectedIndexes())
+	{
+		QModelIndex row = idx.sibling(idx.row(), Name); // Una riga può essere selezionata da una cella qualunque
+		if (!seen.contains(row)) {
+			seen.insert(row);
+			rows.append(row);
+		}
+	}
+
+	if (rows.isEmpty() && selectionModel()->currentIndex().isValid())
+		rows.append(selectionModel()->currentIndex());
+
+	return rows;
+}
+
+void RoadmapMainWnd::selectElements(const QList<RoadmapElement*>& elements)
+{
+	selectionModel()->clearSelection();
+	for (RoadmapElement* element : elements)
+		selectionModel()->select(m_model->indexOf(element), QItemSelectionModel::Select);
+
+	if (!elements.isEmpty())
+		selectionModel()->setCurrentIndex(m_model->indexOf(elements.first()), QItemSelectionModel::NoUpdate);
+}
+
 bool RoadmapMainWnd::Ask(QString title, QString msg)
 {
 	QMessageBox::StandardButton reply = QMessageBox::question(this, title, msg, QMessageBox::Yes | QMessageBox::No);
@@ -6,6 +6,14 @@
 #include "RoadmapModel.hpp"
 
 class QTreeView;
+class QDockWidget;
+class RoadmapGrid;
+class RoadmapMinimap;
+class RoadmapJournal;
+class RoadmapSaver;
+class RoadmapWal;
+struct RoadmapWalHeader;
+class QProgressBar;
 
 /*
  * Finestra che gestisce l'interop programm
@@ -25,9 +33,15 @@ class RoadmapMainWnd : public QMainWindow
     QAction* m_addTask; // Aggiungi Task
     QAction* m_delete; // Elimina elemento
 
+    /* Modifiche massive sulla selezione */
+    QAction* m_shiftDates; // Sposta le date di N giorni
+    QAction* m_setDuration; // Imposta la durata dei task
+    QAction* m_deliver; // Segna le milestone come consegnate (o le riapre)
+
     /* Gestione dello Zoom */
     QAction* m_zoomOut; // Zoom In
     QAction* m_zoomIn; // zoom out
+    QAction* m_tiled; // Rendering del Gantt sui thread di lavoro
 
     QAction* m_moveUp; // Sposta l'elemento inalto
     QAction* m_moveDown; // Sposta l'elemento in basso
@@ -38,11 +52,19 @@ class RoadmapMainWnd : public QMainWindow
     QAction* m_open; // Apri una roadmap
     QAction* m_save; // Salva la roadmap
     QAction* m_saveas; // Salva la roadmap in una nuova posizione
+    QAction* m_compress; // Salva i file compressi a blocchi
 
 
     RoadmapModel* m_model = nullptr; // Modello visualizzato attualmente
+    RoadmapJournal* m_journal = nullptr; // Modifiche dall'ultimo salvataggio, per i salvataggi incrementali
+    RoadmapSaver* m_saver; // Salvataggi completi in background
+    RoadmapWal* m_wal; // Log delle modifiche della sessione, per recuperarle dopo un crash
+    QProgressBar* m_saveprogress; // Avanzamento del salvataggio nella status bar
     KDGantt::View* m_gantt = nullptr; // Gantt
 
+    QDockWidget* m_minimapdock; // Dock della panoramica
+    RoadmapMinimap* m_minimap; // Panoramica dell'intera Roadmap, click per navigare
+
     QString m_filepath; // Percorso del file aperto
     bool m_pendingchanges = false; // Flag che indica se ci sono modifiche non salvate
 	
@@ -50,16 +72,27 @@ public:
 	explicit RoadmapMainWnd(QWidget *parent = nullptr);
 	~RoadmapMainWnd();
 
+    /*
+     * Se una sessione precedente è terminata senza chiudere il documento (il suo log delle
+     * modifiche esiste ancora e il suo lock è stale) propone di riaprirlo e di riapplicare
+     * le modifiche non salvate. I log delle altre istanze in esecuzione non vengono toccati
+     */
+	void recover();
+
 protected:
     void closeEvent(QCloseEvent*) override; // Viene eseguita al momento della chiusura
 
 private:
     void initToolbar(); // Inizializza tutti i tasti della toolbar
+    void initMinimap(); // Crea il dock con la panoramica della Roadmap
+    void initStatusBar(); // Crea la status bar con l'avanzamento dei salvataggi
+    void refreshMinimapArea(); // Aggiorna sulla panoramica l'area visibile nel Gantt
 
     void setupGantt(); // Inizializza il body con il gantt, setappa il model e inizializza i bottoni
 
     void notifyChanged(); // Imposta flag di changed e aggiorna il title se cambia lo stato
     void refreshTitle(); // Reimposta il title a seconda della situazione
+    void syncCompression(bool compressed); // Allinea il bottone e il saver alla compressione del documento aperto
 
     /*
      * Se nell'editor non c'è niente in editing ritorna true direttamente
@@ -85,6 +118,11 @@ private:
      */
 	bool tryLoad();
 
+    /*
+     * Apre la base del log di una sessione interrotta e ci riapplica i suoi record
+     */
+	bool recover(const RoadmapWalHeader& header, const QByteArray& records);
+
     /*
      * Algoritmo che genera la data di partenza del nuovo elemento figlio di un progetto
      */
@@ -124,11 +162,20 @@ private:
 	QTreeView* treeView() const;
 
     /* Unbox la grid() internal al Gantt */
-	KDGantt::DateTimeGrid* grid() const;
+	RoadmapGrid* grid() const;
 
     /* Unbox il selection modeò */
 	QItemSelectionModel* selectionModel() const;
 
+    /*
+     * Ottiene un indice (colonna Name) per ogni riga selezionata,
+     * se non c'è niente di selezionato ritorna l'indice corrente
+     */
+	QModelIndexList selectedRows() const;
+
+    /* Riseleziona una lista di elementi (ad esempio dopo uno spostamento) */
+	void selectElements(const QList<RoadmapElement*>& elements);
+
     /* Crea una dialog interrogativa Sì\No */
 	bool Ask(QString title, QString msg);
 
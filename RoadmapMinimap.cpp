@@ -0,0 +1,323 @@
+#include "RoadmapMinimap.hpp"
+#include <QPainter>
+#include <QMouseEvent>
+#include <QTreeView>
+#include <QtMath>
+#include <algorithm>
+#include "RoadmapModel.hpp"
+
+using namespace ModelUtility;
+
+RoadmapMinimap::RoadmapMinimap(QWidget* parent) : QWidget(parent)
+{
+	m_rebuildtimer.setSingleShot(true);
+	m_rebuildtimer.setInterval(100);
+	QObject::connect(&m_rebuildtimer, &QTimer::timeout, this, [=]() { rebuild(); });
+
+	setMinimumHeight(60);
+	setCursor(Qt::PointingHandCursor);
+}
+
+void RoadmapMinimap::setModel(RoadmapModel* model, QTreeView* view)
+{
+	if (m_model != nullptr)
+		QObject::disconnect(m_model, nullptr, this, nullptr);
+	if (m_view != nullptr)
+		QObject::disconnect(m_view, nullptr, this, nullptr);
+
+	m_model = model;
+	m_view = model != nullptr ? view : nullptr;
+
+	if (m_model != nullptr)
+	{
+        // Le modifiche ai campi aggiornano solo gli elementi toccati
+		connect(m_model, &QAbstractItemModel::dataChanged, this, [=](const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+			refresh(topLeft, bottomRight);
+		});
+
+        // I cambi di struttura spostano le righe, ricostruisco tutto
+		auto schedule = [=]() { m_rebuildtimer.start(); };
+		connect(m_model, &QAbstractItemModel::rowsInserted, this, schedule);
+		connect(m_model, &QAbstractItemModel::rowsRemoved, this, schedule);
+		connect(m_model, &QAbstractItemModel::rowsMoved, this, schedule);
+		connect(m_model, &QAbstractItemModel::modelReset, this, schedule);
+
+        // Il refresh differito dopo setData\endBatch non sposta righe, basta il dataChanged
+		connect(m_model, &QAbstractItemModel::layoutChanged, this, [=]() {
+			if (!m_model->isRefreshOnly())
+				schedule();
+		});
+
+        // Espandere o chiudere un progetto cambia le righe mostrate
+		if (m_view != nullptr) {
+			connect(m_view, &QTreeView::expanded, this, schedule);
+			connect(m_view, &QTreeView::collapsed, this, schedule);
+		}
+	}
+
+	rebuild();
+}
+
+void RoadmapMinimap::setVisibleArea(const QDate& from, const QDate& to, int firstRow, int lastRow)
+{
+	m_visiblefrom = from;
+	m_visibleto = to;
+	m_visiblefirst = firstRow;
+	m_visiblelast = lastRow;
+	update();
+}
+
+int RoadmapMinimap::rowOf(const QModelIndex& index) const
+{
+	if (m_model == nullptr || !index.isValid())
+		return -1;
+
+	RoadmapElement* element = unbox(index);
+	if (isProject(element->type()))
+		return m_projectrows.value(index.row(), -1);
+
+	const int project = index.parent().row();
+	if (!isExpanded(project))
+		return m_projectrows.value(project, -1); // Nascosto nella riga del progetto
+
+	return m_projectrows.value(project, -1) + index.row() + 1;
+}
+
+QModelIndex RoadmapMinimap::indexAt(int row) const
+{
+	if (m_model == nullptr || row < 0 || m_projectrows.isEmpty())
+		return QModelIndex();
+
+    // Ultimo progetto che inizia prima della riga cercata
+	auto it = std::upper_bound(m_projectrows.constBegin(), m_projectrows.constEnd(), row);
+	const int project = int(it - m_projectrows.constBegin()) - 1;
+	if (project < 0)
+		return QModelIndex();
+
+	QModelIndex parent = m_model->index(project, 0, QModelIndex());
+	const int offset = row - m_projectrows.at(project);
+	if (offset == 0)
+		return parent;
+
+	return m_model->index(qMin(offset - 1, m_model->rowCount(parent) - 1), 0, parent);
+}
+
+void RoadmapMinimap::setNavigate(std::function<void(const QModelIndex&, const QDate&)> callback)
+{
+	m_navigate = callback;
+}
+
+QSize RoadmapMinimap::sizeHint() const
+{
+	return QSize(TIMEBUCKETS * 2, 120);
+}
+
+void RoadmapMinimap::rebuild()
+{
+	m_rebuildtimer.stop();
+	m_spans.clear();
+	m_projectrows.clear();
+	m_buckets.clear();
+	m_rows = 0;
+	m_rowbuckets = 0;
+	m_imagedirty = true;
+
+	Roadmap* rmap = m_model != nullptr ? m_model->roadmap() : nullptr;
+	if (rmap == nullptr) {
+		update();
+		return;
+	}
+
+    // Righe nello stesso ordine della treeview, i progetti chiusi occupano una riga sola
+	const QList<RoadmapProject*> projects = rmap->projects();
+	QVector<bool> expanded(projects.count());
+	for (int p = 0; p < projects.count(); p++) {
+		expanded[p] = isExpanded(p);
+		m_projectrows.append(m_rows);
+		m_rows += 1 + (expanded[p] ? projects.at(p)->elements().count() : 0);
+	}
+
+    /*
+     * L'intervallo rappresentato è quello della timeline con un margine,
+     * così spostare un elemento di poco non costringe a ricostruire la griglia
+     */
+	const QDate first = rmap->firstDate();
+	const QDate last = rmap->lastDate();
+	if (!first.isValid() || m_rows == 0) {
+		m_first = QDate();
+		m_days = 0;
+		update();
+		return;
+	}
+
+	const qint64 margin = qMax<qint64>(7, first.daysTo(last) / 10);
+	m_first = first.addDays(-margin);
+	m_days = m_first.daysTo(last.addDays(margin)) + 1;
+
+	m_rowbuckets = qMin(m_rows, int(MAXROWBUCKETS));
+	m_buckets.fill(0, m_rowbuckets * TIMEBUCKETS);
+
+	for (int p = 0; p < projects.count(); p++) {
+		const QList<RoadmapProjectElement*> elements = projects.at(p)->elements();
+		for (int e = 0; e < elements.count(); e++) {
+			Span span;
+			if (!spanOf(elements.at(e), m_projectrows.at(p) + (expanded[p] ? e + 1 : 0), span))
+				continue;
+
+			m_spans.insert(elements.at(e), span);
+			account(span, 1);
+		}
+	}
+
+	update();
+}
+
+void RoadmapMinimap::refresh(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+	if (m_model == nullptr || m_rebuildtimer.isActive())
+		return; // La ricostruzione in arrivo conterà anche queste modifiche
+
+	const QModelIndex parent = topLeft.parent();
+	if (!parent.isValid())
+		return; // I progetti non contribuiscono alla griglia
+
+	for (int r = topLeft.row(); r <= bottomRight.row(); r++) {
+		const QModelIndex index = m_model->index(r, 0, parent);
+		RoadmapElement* element = unbox(index);
+		if (element == nullptr || !isProjectElement(element->type()))
+			continue;
+
+		Span span;
+		const bool valid = spanOf(element, rowOf(index), span);
+
+        // Un elemento uscito dall'intervallo rappresentato cambia la scala: ricostruisco
+		if (!valid && static_cast<RoadmapProjectElement*>(element)->date().isValid()) {
+			m_rebuildtimer.start();
+			return;
+		}
+
+		auto it = m_spans.find(element);
+		if (it != m_spans.end()) {
+			account(it.value(), -1);
+			m_spans.erase(it);
+		}
+
+		if (valid) {
+			m_spans.insert(element, span);
+			account(span, 1);
+		}
+	}
+
+	update();
+}
+
+bool RoadmapMinimap::spanOf(RoadmapElement* element, int row, Span& span) const
+{
+	if (m_days <= 0 || row < 0 || !isProjectElement(element->type()))
+		return false;
+
+	auto pelement = static_cast<RoadmapProjectElement*>(element);
+	if (!pelement->date().isValid())
+		return false;
+
+	const qint64 from = m_first.daysTo(pelement->date());
+	const qint64 to = from + RoadmapTimeline::endOf(pelement) - RoadmapTimeline::startOf(pelement);
+	if (from < 0 || to >= m_days)
+		return false;
+
+	span.Row = int(qint64(row) * m_rowbuckets / m_rows);
+	span.From = int(from * TIMEBUCKETS / m_days);
+	span.To = int(to * TIMEBUCKETS / m_days);
+	return true;
+}
+
+void RoadmapMinimap::account(const Span& span, int delta)
+{
+	quint32* line = m_buckets.data() + span.Row * TIMEBUCKETS;
+	for (int b = span.From; b <= span.To; b++)
+		line[b] += delta;
+
+	m_imagedirty = true;
+}
+
+bool RoadmapMinimap::isExpanded(int project) const
+{
+	if (m_view == nullptr)
+		return true;
+
+	return m_view->isExpanded(m_model->index(project, 0, QModelIndex()));
+}
+
+void RoadmapMinimap::paintEvent(QPaintEvent*)
+{
+	QPainter painter(this);
+	painter.fillRect(rect(), palette().base());
+
+	if (m_rowbuckets == 0)
+		return;
+
+    /*
+     * L'immagine ha un pixel per bucket, viene rigenerata solo se i conteggi
+     * sono cambiati e poi scalata sul widget
+     */
+	if (m_imagedirty) {
+		quint32 max = 1;
+		for (quint32 count : m_buckets)
+			max = qMax(max, count);
+
+		const QColor base = palette().color(QPalette::Highlight);
+		const qreal scale = 255. / qLn(max + 1.);
+
+		m_image = QImage(TIMEBUCKETS, m_rowbuckets, QImage::Format_ARGB32_Premultiplied);
+		for (int r = 0; r < m_rowbuckets; r++) {
+			QRgb* pixels = reinterpret_cast<QRgb*>(m_image.scanLine(r));
+			const quint32* line = m_buckets.constData() + r * TIMEBUCKETS;
+			for (int b = 0; b < TIMEBUCKETS; b++) {
+                // Scala logaritmica, anche un bucket con un solo elemento resta visibile
+				const int alpha = line[b] == 0 ? 0 : qMax(60, int(qLn(line[b] + 1.) * scale));
+				pixels[b] = qPremultiply(qRgba(base.red(), base.green(), base.blue(), alpha));
+			}
+		}
+
+		m_imagedirty = false;
+	}
+
+	painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+	painter.drawImage(rect(), m_image);
+
+    // Rettangolo dell'area visibile nel Gantt
+	if (m_visiblefrom.isValid() && m_visibleto.isValid() && m_visiblefirst >= 0) {
+		const qreal x1 = m_first.daysTo(m_visiblefrom) * width() / qreal(m_days);
+		const qreal x2 = m_first.daysTo(m_visibleto) * width() / qreal(m_days);
+		const qreal y1 = m_visiblefirst * height() / qreal(m_rows);
+		const qreal y2 = (qBound(m_visiblefirst, m_visiblelast, m_rows - 1) + 1) * height() / qreal(m_rows);
+
+		painter.setPen(palette().color(QPalette::Text));
+		painter.setBrush(Qt::NoBrush);
+		painter.drawRect(QRectF(x1, y1, x2 - x1, y2 - y1).adjusted(0.5, 0.5, -0.5, -0.5));
+	}
+}
+
+void RoadmapMinimap::mousePressEvent(QMouseEvent* event)
+{
+	if (event->button() == Qt::LeftButton)
+		navigate(event->pos());
+}
+
+void RoadmapMinimap::mouseMoveEvent(QMouseEvent* event)
+{
+    // Trascinando il mouse la navigazione segue il cursore
+	if (event->buttons() & Qt::LeftButton)
+		navigate(event->pos());
+}
+
+void RoadmapMinimap::navigate(const QPoint& pos)
+{
+	if (!m_navigate || m_rows == 0 || m_days <= 0 || width() <= 0 || height() <= 0)
+		return;
+
+	const int row = qBound(0, int(qint64(pos.y()) * m_rows / height()), m_rows - 1);
+	const QDate date = m_first.addDays(qBound<qint64>(0, qint64(pos.x()) * m_days / width(), m_days - 1));
+
+	m_navigate(indexAt(row), date);
+}
@@ -0,0 +1,128 @@
+#pragma once
+/*
+ * Questo file contiene la definizione di RoadmapMinimap
+ *
+ *  - RoadmapMinimap : QWidget()
+ *      -> è la panoramica dell'intera Roadmap mostrata in un dock accanto al Gantt.
+ *         La Roadmap viene ridotta ad una griglia di bucket (righe x periodi di tempo),
+ *         ogni bucket conta quanti elementi lo occupano, la minimappa disegna solo
+ *         l'immagine di densità ricavata dai bucket e mai i singoli item.
+ *
+ *         Ogni elemento ricorda lo span di bucket in cui è stato contato:
+ *          - una modifica di data o durata (dataChanged) toglie il vecchio contributo
+ *            e aggiunge quello nuovo, senza ricalcolare tutta la griglia
+ *          - inserimenti, rimozioni e spostamenti di righe, progetti espansi o chiusi
+ *            ricostruiscono la griglia (con un piccolo ritardo, così una sequenza di modifiche
+ *            costa una sola ricostruzione). Il layoutChanged del refresh differito del modello
+ *            (RoadmapModel::isRefreshOnly) segue modifiche già arrivate con dataChanged e non conta
+ *
+ *         Le righe sono quelle della treeview: gli elementi di un progetto chiuso
+ *         vengono contati sulla riga del progetto.
+ *
+ *         Un click sulla minimappa chiama la callback di navigazione con la riga e la data
+ *         corrispondenti al punto cliccato.
+ */
+#include <QWidget>
+#include <QTimer>
+#include <QImage>
+#include <QHash>
+#include <QVector>
+#include <QDate>
+#include <QModelIndex>
+#include <functional>
+
+class RoadmapModel;
+class RoadmapElement;
+class QTreeView;
+
+class RoadmapMinimap : public QWidget
+{
+    /*
+     * Contributo di un elemento alla griglia
+     */
+    struct Span
+    {
+        int Row; // Riga di bucket
+        int From; // Primo bucket di tempo occupato
+        int To; // Ultimo bucket di tempo occupato (incluso)
+    };
+
+    RoadmapModel* m_model = nullptr; // Modello rappresentato
+    QTreeView* m_view = nullptr; // Treeview del Gantt, per sapere quali progetti sono espansi
+    QTimer m_rebuildtimer; // Isteresi sulle ricostruzioni complete
+
+    QDate m_first; // Primo giorno rappresentato
+    qint64 m_days = 0; // Giorni rappresentati
+    int m_rows = 0; // Righe mostrate (progetti + elementi dei progetti espansi)
+    int m_rowbuckets = 0; // Righe della griglia
+    QVector<quint32> m_buckets; // Griglia dei conteggi, m_rowbuckets x TIMEBUCKETS
+    QHash<RoadmapElement*, Span> m_spans; // Contributo attuale di ogni elemento
+    QVector<int> m_projectrows; // Riga del modello di ogni progetto
+
+    QImage m_image; // Immagine di densità, un pixel per bucket
+    bool m_imagedirty = true; // L'immagine va rigenerata dai bucket
+
+    QDate m_visiblefrom; // Area visibile nel Gantt, disegnata come rettangolo
+    QDate m_visibleto;
+    int m_visiblefirst = -1;
+    int m_visiblelast = -1;
+
+    std::function<void(const QModelIndex&, const QDate&)> m_navigate; // Callback del click
+
+public:
+    enum
+    {
+        TIMEBUCKETS = 256, // Colonne della griglia
+        MAXROWBUCKETS = 128 // Righe massime della griglia
+    };
+
+	explicit RoadmapMinimap(QWidget* parent = nullptr);
+
+    /*
+     * Imposta il modello da rappresentare (nullptr per svuotare la minimappa)
+     * e la treeview che lo mostra (nullptr per considerare tutti i progetti espansi)
+     */
+	void setModel(RoadmapModel* model, QTreeView* view = nullptr);
+
+    /*
+     * Imposta l'area visibile nel Gantt, righe del modello contate come nella minimappa
+     */
+	void setVisibleArea(const QDate& from, const QDate& to, int firstRow, int lastRow);
+
+    /*
+     * Posizione di un indice nell'elenco piatto delle righe (progetti seguiti dai loro elementi
+     * se espansi, altrimenti la riga del progetto), -1 se l'indice non è valido
+     */
+	int rowOf(const QModelIndex& index) const;
+
+    /*
+     * Indice della colonna 0 per una riga dell'elenco piatto
+     */
+	QModelIndex indexAt(int row) const;
+
+    /*
+     * Callback chiamata al click con l'indice e la data del punto cliccato
+     */
+	void setNavigate(std::function<void(const QModelIndex&, const QDate&)> callback);
+
+	QSize sizeHint() const override;
+
+protected:
+	void paintEvent(QPaintEvent* event) override;
+	void mousePressEvent(QMouseEvent* event) override;
+	void mouseMoveEvent(QMouseEvent* event) override;
+
+private:
+	void rebuild(); // Ricostruisce la griglia da zero
+	void refresh(const QModelIndex& topLeft, const QModelIndex& bottomRight); // Aggiorna gli elementi modificati
+
+    /*
+     * Calcola lo span di un elemento, false se l'elemento non ha date
+     * o se cade fuori dall'intervallo rappresentato
+     */
+	bool spanOf(RoadmapElement* element, int row, Span& span) const;
+	void account(const Span& span, int delta); // Aggiunge (o toglie) un contributo alla griglia
+	bool isExpanded(int project) const; // Il progetto mostra le righe dei suoi elementi
+
+	void navigate(const QPoint& pos);
+};
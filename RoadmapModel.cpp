@@ -3,6 +3,8 @@
 #include <KDGanttStyleOptionGanttItem>
 #include <QItemSelectionModel>
 #include <Utility.hpp>
+#include <algorithm>
+#include <functional>
 
 using namespace ModelUtility;
 
@@ -168,6 +170,66 @@ int RoadmapModel::columnCount(const QModelIndex& parent) const
 	return 6;
 }
 
+bool RoadmapModel::hasChildren(const QModelIndex& parent) const
+{
+	if (!parent.isValid())
+		return !roadmap()->projects().isEmpty();
+
+	RoadmapElement* element = unbox(parent);
+	if (isProject(element->type()))
+		return unboxProject(parent)->elementCount() > 0; // Anche se non ancora caricato
+
+	return false;
+}
+
+bool RoadmapModel::canFetchMore(const QModelIndex& parent) const
+{
+	if (!parent.isValid() || parent.model() != this)
+		return false;
+
+	RoadmapElement* element = unbox(parent);
+	return isProject(element->type()) && !unboxProject(parent)->isLoaded();
+}
+
+void RoadmapModel::fetchMore(const QModelIndex& parent)
+{
+	if (!canFetchMore(parent))
+		return;
+
+	fetchProject(unboxProject(parent));
+	emitChanged(); // Le constraint dei nuovi elementi vanno aggiunte
+}
+
+void RoadmapModel::fetchProject(RoadmapProject* project)
+{
+	if (project->isLoaded())
+		return;
+
+	m_fetching = true;
+	beginInsertRows(indexOf(project), 0, project->elementCount() - 1);
+	project->load();
+	endInsertRows();
+	m_fetching = false;
+}
+
+void RoadmapModel::fetchAll()
+{
+	bool fetched = false;
+	for (RoadmapProject* project : roadmap()->projects()) {
+		fetched |= !project->isLoaded();
+		fetchProject(project);
+	}
+
+	roadmap()->loadAll(); // L'indice del file non serve più
+	if (fetched)
+		emitChanged();
+}
+
+bool RoadmapModel::isFetching() const
+{
+	return m_fetching;
+}
+
 QVariant RoadmapModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
 	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
@@ -271,8 +333,10 @@ QVariant RoadmapModel::data(const QModelIndex& index, int role) const
 		case Name:
 			switch (role) {
 			case Qt::DisplayRole:
-			case Qt::EditRole:
 				return project->name();
+
+			case Qt::EditRole:
+				return detachedString(project->name()); // L'editor lo conserva, anche dopo Roadmap::unmap()
 			}
 			break;
 
@@ -326,8 +390,10 @@ QVariant RoadmapModel::data(const QModelIndex& index, int role) const
 		case Name:
 			switch (role) {
 			case Qt::DisplayRole:
-			case Qt::EditRole:
 				return milestone->name();
+
+			case Qt::EditRole:
+				return detachedString(milestone->name()); // L'editor lo conserva, anche dopo Roadmap::unmap()
 			}
 			break;
 
@@ -370,8 +436,10 @@ QVariant RoadmapModel::data(const QModelIndex& index, int role) const
 		case Name:
 			switch (role) {
 			case Qt::DisplayRole:
-			case Qt::EditRole:
 				return task->name();
+
+			case Qt::EditRole:
+				return detachedString(task->name()); // L'editor lo conserva, anche dopo Roadmap::unmap()
 			}
 			break;
 
@@ -443,6 +511,7 @@ bool RoadmapModel::setData(const QModelIndex& idx, const QVariant& value, int ro
 			if(value.toInt()==KDGantt::TypeEvent)
 			{
 				emitChanged();
+				batchForget(task);
 				QModelIndex pidx = parent(idx);
 				beginRemoveRows(pidx, task->position(), task->position());
 				QString name = task->name();
@@ -462,6 +531,9 @@ bool RoadmapModel::setData(const QModelIndex& idx, const QVariant& value, int ro
 					parent->movPrev(miles);
 
 				endInsertRows();
+
+				if (inBatch())
+					m_batchdirty.insert(miles);
 				//result = true;
 				return true;
 		/*		break;*/
@@ -510,8 +582,12 @@ bool RoadmapModel::setData(const QModelIndex& idx, const QVariant& value, int ro
 	}
 
     if (result) {
-		emitChanged();
-		emit dataChanged(idx, idx);
+		if (inBatch()) {
+			m_batchdirty.insert(element); // Il dataChanged verrà emesso alla endBatch()
+		} else {
+			emitChanged();
+			emit dataChanged(idx, idx);
+		}
 	}
 
 	return result;
@@ -544,6 +620,7 @@ bool RoadmapModel::insertRows(int row, int count, const QModelIndex& parent)
 	} else
 	{
 		RoadmapProject* project = unboxProject(parent);
+		fetchProject(project); // Le posizioni valgono solo con tutti gli elementi presenti
 		emitChanged();
 		beginInsertRows(parent, row, row + count - 1);
 		while (count-- > 0)
@@ -578,7 +655,9 @@ bool RoadmapModel::removeRows(int row, int count, const QModelIndex& parent)
 		emitChanged();
 		beginRemoveRows(parent, row, row + count - 1);
 		while (count-- > 0) {
-			roadmap()->delProject(roadmap()->projects().value(row));
+			RoadmapProject* project = roadmap()->projects().value(row);
+			batchForget(project);
+			roadmap()->delProject(project);
 		}
 		endRemoveRows();
 	} else
@@ -590,7 +669,9 @@ bool RoadmapModel::removeRows(int row, int count, const QModelIndex& parent)
 		emitChanged();
 		beginRemoveRows(parent, row, row + count - 1);
 		while (count-- > 0) {
-			project->delElement(project->elements().value(row));
+			RoadmapProjectElement* element = project->elements().value(row);
+			batchForget(element);
+			project->delElement(element);
 		}
 		endRemoveRows();
 	}
@@ -607,11 +688,17 @@ bool RoadmapModel::moveRows(const QModelIndex& sourceParent, int sourceRow, int
 {
     if(isChanging()) return false;
 
-    m_cmodel->clearConstraints();
-    layoutChanged();
 	if (sourceParent != destinationParent)
 		return false;
 
+	m_restructured = true; // Il layoutChanged che chiude lo spostamento cambia le righe
+
+	// In batch le constraint sono già staccate e il layout verrà rinfrescato alla endBatch()
+	if (!inBatch()) {
+		m_cmodel->clearConstraints();
+		layoutChanged();
+	}
+
 	int delta = destinationChild - sourceRow;
 
 	if (delta == 0)
@@ -641,13 +728,18 @@ bool RoadmapModel::moveRows(const QModelIndex& sourceParent, int sourceRow, int
 		}
     }
 
-    layoutChanged();
-    m_cmodel->rebuildConstraints();
+	if (!inBatch()) {
+		layoutChanged();
+		m_cmodel->rebuildConstraints();
+	}
 	return true;
 }
 
 void RoadmapModel::emitChanged()
 {
+	if (inBatch())
+		return; // Il refresh verrà fatto una volta sola alla chiusura della batch
+
 	if(m_layoutchanger == nullptr)
 	{
 		m_layoutchanger = new QTimer();
@@ -657,7 +749,7 @@ void RoadmapModel::emitChanged()
 		{
 			QTimer* timer = m_layoutchanger;
 			m_layoutchanger = nullptr;
-			emit layoutChanged();
+			emitLayoutChanged();
             m_cmodel->rebuildConstraints();
 			delete timer;
 		});
@@ -671,6 +763,308 @@ void RoadmapModel::emitChanged()
 	}
 }
 
+void RoadmapModel::beginBatch()
+{
+	if (m_batchdepth++ > 0)
+		return; // Batch annidata, è già tutto pronto
+
+	if (isChanging())
+	{
+		/*
+		 * C'è già un refresh in attesa: le constraint sono già state staccate
+		 * e il layoutAboutToBeChanged è già stato emesso, assorbo il refresh nella batch
+		 */
+		delete m_layoutchanger;
+		m_layoutchanger = nullptr;
+	}
+	else
+	{
+		emit layoutAboutToBeChanged();
+		m_cmodel->clearConstraints();
+	}
+
+	m_batchdirty.clear();
+}
+
+void RoadmapModel::endBatch()
+{
+	if (m_batchdepth == 0)
+		return; // endBatch() senza beginBatch()
+
+	if (--m_batchdepth > 0)
+		return; // Si chiude solo una batch annidata
+
+	/*
+	 * Raggruppo le righe modificate per padre (nullptr = Root, quindi progetti)
+	 * per emettere un solo dataChanged per padre
+	 */
+	QHash<RoadmapProject*, QPair<int, int>> ranges;
+	for (RoadmapElement* element : m_batchdirty)
+	{
+		RoadmapProject* parent = nullptr;
+		int row = -1;
+
+		if (isProject(element->type())) {
+			row = static_cast<RoadmapProject*>(element)->position();
+		} else {
+			RoadmapProjectElement* pelement = static_cast<RoadmapProjectElement*>(element);
+			parent = pelement->project();
+			row = pelement->position();
+		}
+
+		if (row < 0)
+			continue;
+
+		if (!ranges.contains(parent)) {
+			ranges.insert(parent, qMakePair(row, row));
+		} else {
+			QPair<int, int>& range = ranges[parent];
+			range.first = qMin(range.first, row);
+			range.second = qMax(range.second, row);
+		}
+	}
+	m_batchdirty.clear();
+
+	for (auto it = ranges.constBegin(); it != ranges.constEnd(); ++it)
+	{
+		QModelIndex pidx = it.key() == nullptr ? QModelIndex() : createIndex(it.key()->position(), 0, it.key());
+		emit dataChanged(index(it.value().first, 0, pidx), index(it.value().second, columnCount(pidx) - 1, pidx));
+	}
+
+	emitLayoutChanged();
+	m_cmodel->rebuildConstraints();
+}
+
+bool RoadmapModel::inBatch() const
+{
+	return m_batchdepth > 0;
+}
+
+bool RoadmapModel::isRefreshOnly() const
+{
+	return m_refreshonly;
+}
+
+void RoadmapModel::emitLayoutChanged()
+{
+    // Senza spostamenti di righe il refresh differito non cambia la struttura
+	m_refreshonly = !m_restructured;
+	m_restructured = false;
+	emit layoutChanged();
+	m_refreshonly = false;
+}
+
+void RoadmapModel::batchForget(RoadmapElement* element)
+{
+	if (!inBatch() || element == nullptr)
+		return;
+
+	m_batchdirty.remove(element);
+
+	// Eliminando un progetto vengono eliminati anche tutti i suoi elementi
+	if (isProject(element->type()))
+		for (RoadmapProjectElement* pelement : static_cast<RoadmapProject*>(element)->elements())
+			m_batchdirty.remove(pelement);
+}
+
+void RoadmapModel::shiftDates(const QModelIndexList& indexes, int days)
+{
+	if (days == 0)
+		return;
+
+	/*
+	 * Un progetto selezionato sposta tutti i suoi elementi, uso un set
+	 * per non spostare due volte un elemento selezionato insieme al suo progetto
+	 */
+	QSet<RoadmapProjectElement*> toshift;
+	for (RoadmapElement* element : uniqueElements(indexes))
+	{
+		if (isProject(element->type())) {
+			fetchMore(indexOf(element)); // Vanno spostati anche gli elementi non ancora caricati
+			for (RoadmapProjectElement* pelement : static_cast<RoadmapProject*>(element)->elements())
+				toshift.insert(pelement);
+		}
+		else
+			toshift.insert(static_cast<RoadmapProjectElement*>(element));
+	}
+
+	if (toshift.isEmpty())
+		return;
+
+	RoadmapBatch batch(this);
+	for (RoadmapProjectElement* pelement : toshift)
+	{
+		pelement->setDate(pelement->date().addDays(days));
+		m_batchdirty.insert(pelement);
+		m_batchdirty.insert(pelement->project()); // Cambiano anche inizio e fine del progetto
+	}
+}
+
+void RoadmapModel::setDuration(const QModelIndexList& indexes, int days)
+{
+	RoadmapBatch batch(this);
+	for (RoadmapElement* element : uniqueElements(indexes))
+	{
+		if (element->type() != PROJECT_TASK)
+			continue;
+
+		RoadmapTask* task = static_cast<RoadmapTask*>(element);
+		task->setDays(qMax(1, days)); // Stesso vincolo di setData: almeno un giorno
+		m_batchdirty.insert(task);
+		m_batchdirty.insert(task->project());
+	}
+}
+
+void RoadmapModel::setDelivered(const QModelIndexList& indexes, bool delivered)
+{
+	RoadmapBatch batch(this);
+	for (RoadmapElement* element : uniqueElements(indexes))
+	{
+		if (element->type() != PROJECT_MILESTONE)
+			continue;
+
+		RoadmapMilestone* milestone = static_cast<RoadmapMilestone*>(element);
+		milestone->setDelivered(delivered);
+		m_batchdirty.insert(milestone);
+	}
+}
+
+void RoadmapModel::removeIndexes(const QModelIndexList& indexes)
+{
+	QList<RoadmapElement*> elements = uniqueElements(indexes);
+
+	/*
+	 * Separo i progetti dagli elementi, gli elementi di un progetto
+	 * che verrà eliminato non vanno rimossi singolarmente
+	 */
+	QSet<RoadmapProject*> projects;
+	for (RoadmapElement* element : elements)
+		if (isProject(element->type()))
+			projects.insert(static_cast<RoadmapProject*>(element));
+
+	QMap<RoadmapProject*, QList<int>> elementRows;
+	for (RoadmapElement* element : elements)
+	{
+		if (isProject(element->type()))
+			continue;
+
+		RoadmapProjectElement* pelement = static_cast<RoadmapProjectElement*>(element);
+		if (!projects.contains(pelement->project()))
+			elementRows[pelement->project()].append(pelement->position());
+	}
+
+	QList<int> projectRows;
+	for (RoadmapProject* project : projects)
+		projectRows.append(project->position());
+
+	/*
+	 * Rimuove le righe partendo dal fondo, così le posizioni ancora da rimuovere
+	 * restano valide, e raggruppa le righe contigue in una sola removeRows
+	 */
+	auto removeDescending = [this](QList<int> rows, const QModelIndex& parent)
+	{
+		std::sort(rows.begin(), rows.end(), std::greater<int>());
+		int i = 0;
+		while (i < rows.count())
+		{
+			int last = rows.at(i);
+			int first = last;
+			while (i + 1 < rows.count() && rows.at(i + 1) == first - 1)
+				first = rows.at(++i);
+
+			removeRows(first, last - first + 1, parent);
+			i++;
+		}
+	};
+
+	RoadmapBatch batch(this);
+	for (auto it = elementRows.constBegin(); it != elementRows.constEnd(); ++it)
+		removeDescending(it.value(), indexOf(it.key()));
+
+	removeDescending(projectRows, QModelIndex());
+}
+
+void RoadmapModel::moveIndexes(const QModelIndexList& indexes, int delta)
+{
+	if (delta == 0)
+		return;
+
+	/*
+	 * Raggruppo le righe per padre (nullptr = Root, quindi progetti)
+	 */
+	QMap<RoadmapProject*, QList<int>> rows;
+	for (RoadmapElement* element : uniqueElements(indexes))
+	{
+		if (isProject(element->type()))
+			rows[nullptr].append(static_cast<RoadmapProject*>(element)->position());
+		else {
+			RoadmapProjectElement* pelement = static_cast<RoadmapProjectElement*>(element);
+			rows[pelement->project()].append(pelement->position());
+		}
+	}
+
+	RoadmapBatch batch(this);
+	for (auto it = rows.begin(); it != rows.end(); ++it)
+	{
+		QModelIndex parent = it.key() == nullptr ? QModelIndex() : indexOf(it.key());
+		int count = rowCount(parent);
+		QList<int>& prows = it.value();
+
+		/*
+		 * Verso l'alto muovo prima le righe più in alto, verso il basso prima quelle più in basso,
+		 * una riga bloccata dal bordo o da un'altra riga bloccata resta dov'è
+		 */
+		if (delta < 0)
+			std::sort(prows.begin(), prows.end());
+		else
+			std::sort(prows.begin(), prows.end(), std::greater<int>());
+
+		int limit = delta < 0 ? -1 : count; // Prima posizione non raggiungibile
+		for (int row : prows)
+		{
+			int dest = delta < 0 ? qMax(row + delta, limit + 1) : qMin(row + delta, limit - 1);
+			if (dest != row)
+				moveRows(parent, row, 1, parent, dest);
+			limit = dest;
+		}
+	}
+}
+
+QModelIndex RoadmapModel::indexOf(RoadmapElement* element, int column) const
+{
+	if (element == nullptr)
+		return QModelIndex();
+
+	if (isProject(element->type())) {
+		RoadmapProject* project = static_cast<RoadmapProject*>(element);
+		return createIndex(project->position(), column, project);
+	}
+
+	RoadmapProjectElement* pelement = static_cast<RoadmapProjectElement*>(element);
+	return createIndex(pelement->position(), column, pelement);
+}
+
+QList<RoadmapElement*> RoadmapModel::uniqueElements(const QModelIndexList& indexes) const
+{
+	QList<RoadmapElement*> elements;
+	QSet<RoadmapElement*> seen;
+
+	for (const QModelIndex& idx : indexes)
+	{
+		if (!idx.isValid() || idx.model() != this)
+			continue;
+
+		RoadmapElement* element = unbox(idx);
+		if (element == nullptr || seen.contains(element))
+			continue;
+
+		seen.insert(element);
+		elements.append(element);
+	}
+
+	return elements;
+}
+
 RoadmapConstraintModel* RoadmapModel::constraintModel() const
 {
     return m_cmodel;
@@ -5,6 +5,7 @@
 #include <KDGanttGlobal>
 #include "Roadmap.hpp"
 #include <QTimer>
+#include <QSet>
 
 // Enumerazione che descrive le collonne utilizzate dal modello
 enum RoadmapModelColumns
@@ -78,6 +79,12 @@ class RoadmapModel : public QAbstractItemModel {
     RoadmapConstraintModel* m_cmodel; // Il constraint model
     QTimer* m_layoutchanger = nullptr; // Un timer per gestire un isteresi sui refresh
 
+    int m_batchdepth = 0; // Profondità delle batch aperte (beginBatch\endBatch possono essere annidate)
+    QSet<RoadmapElement*> m_batchdirty; // Elementi modificati durante la batch corrente
+    bool m_fetching = false; // Sta inserendo righe caricate dal file, non modifiche
+    bool m_restructured = false; // Righe spostate dall'ultimo layoutChanged (moveRows non emette rowsMoved)
+    bool m_refreshonly = false; // Il layoutChanged in corso è solo il refresh differito
+
 public:
 	explicit RoadmapModel(Roadmap* rmap = nullptr, QObject * parent = nullptr);
 	~RoadmapModel();
@@ -120,6 +127,25 @@ public:
      */
 	int columnCount(const QModelIndex& parent) const override;
 
+    /*
+     * Caricamento pigro (Vedi RoadmapLazyTables): un progetto non ancora caricato
+     * ha zero righe ma dichiara figli, la view chiama fetchMore quando lo espande
+     * o quando deve mostrarne le righe e gli elementi vengono creati solo allora
+     */
+	bool hasChildren(const QModelIndex& parent) const override;
+	bool canFetchMore(const QModelIndex& parent) const override;
+	void fetchMore(const QModelIndex& parent) override;
+
+    /*
+     * Carica tutti i progetti ancora da caricare (prima di salvare o stampare)
+     */
+	void fetchAll();
+
+    /*
+     * Indica se le righe inserite in questo momento arrivano dal file
+     */
+	bool isFetching() const;
+
     /*
      * Dati di descrizione relativi alle intestazioni delle varie colonne, noi ritorneremo solo i titoli
      */
@@ -162,6 +188,50 @@ public:
      */
 	void emitChanged();
 
+    /*
+     * Apre una batch di modifiche programmatiche (script, import, comandi composti).
+     * Fino alla endBatch() corrispondente setData, insertRows, removeRows e moveRows
+     * non innescano emitChanged: le constraint vengono staccate una sola volta
+     * all'apertura e i dataChanged vengono accumulati.
+     * Le batch possono essere annidate, conta solo la più esterna
+     */
+	void beginBatch();
+
+    /*
+     * Chiude la batch, alla chiusura di quella più esterna emette un solo dataChanged
+     * per ogni padre toccato (dalla prima all'ultima riga modificata),
+     * un solo layoutChanged e ricostruisce le constraint una sola volta
+     */
+	void endBatch();
+
+    /*
+     * Indica se è aperta una batch
+     */
+	bool inBatch() const;
+
+    /*
+     * Indica se il layoutChanged in corso è solo il refresh differito di emitChanged\endBatch
+     * dopo modifiche ai campi (già notificate con dataChanged), senza righe spostate:
+     * chi tiene strutture per riga (ad esempio la panoramica) non deve ricostruirle
+     */
+	bool isRefreshOnly() const;
+
+    /*
+     * Operazioni massive su una selezione di indici (di qualunque colonna, conta la riga).
+     * Ognuna lavora direttamente sulla Roadmap all'interno di una sola batch,
+     * quindi produce una sola notifica coalescente indipendentemente dal numero di righe
+     */
+	void shiftDates(const QModelIndexList& indexes, int days); // Sposta le date, un progetto sposta tutti i suoi elementi
+	void setDuration(const QModelIndexList& indexes, int days); // Imposta la durata dei task selezionati
+	void setDelivered(const QModelIndexList& indexes, bool delivered); // Imposta lo stato delle milestone selezionate
+	void removeIndexes(const QModelIndexList& indexes); // Elimina le righe selezionate
+	void moveIndexes(const QModelIndexList& indexes, int delta); // Sposta le righe di delta posizioni all'interno del padre
+
+    /*
+     * Ottiene l'indice di un elemento della Roadmap (progetto o project element)
+     */
+	QModelIndex indexOf(RoadmapElement* element, int column = 0) const;
+
     /*
      * Ottiene un cosntraint model che agisce direttamente sui link della Roadmap
      */
@@ -179,6 +249,45 @@ private:
      * Indica se c'è un refresh che attende di essere eseguito
      */
     bool isChanging();
+
+    /*
+     * Crea le righe di un progetto non caricato, senza innescare il refresh
+     */
+    void fetchProject(RoadmapProject* project);
+
+    /*
+     * Toglie dalla batch corrente i riferimenti ad un elemento che sta per essere eliminato
+     */
+    void batchForget(RoadmapElement* element);
+
+    /*
+     * Emette il layoutChanged del refresh differito (Vedi isRefreshOnly)
+     */
+    void emitLayoutChanged();
+
+    /*
+     * Riduce una lista di indici alla lista dei relativi elementi, senza duplicati
+     * e mantenendo l'ordine di selezione
+     */
+    QList<RoadmapElement*> uniqueElements(const QModelIndexList& indexes) const;
+};
+
+/*
+ * Utility RAII che apre una batch sul modello e la chiude all'uscita dallo scope,
+ * anche in caso di eccezione
+ *
+ * Es: { RoadmapBatch batch(model); model->insertRows(...); model->setData(...); }
+ */
+class RoadmapBatch
+{
+    RoadmapModel* m_model;
+
+public:
+	explicit RoadmapBatch(RoadmapModel* model) : m_model(model) { m_model->beginBatch(); }
+	~RoadmapBatch() { m_model->endBatch(); }
+
+	RoadmapBatch(const RoadmapBatch&) = delete;
+	RoadmapBatch& operator=(const RoadmapBatch&) = delete;
 };
 
 class RoadmapConstraintModel : public KDGantt::ConstraintModel
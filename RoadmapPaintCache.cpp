@@ -0,0 +1,177 @@
+#include "RoadmapPaintCache.hpp"
+#include <QLinearGradient>
+#include "Utility.hpp"
+
+RoadmapPaintCache::RoadmapPaintCache() : m_summarypaths(256), m_routes(4096)
+{
+}
+
+QBrush RoadmapPaintCache::taskBrush(const QColor& color, int height)
+{
+	const QPair<QRgb, int> key(color.rgba(), height);
+
+	auto it = m_taskbrushes.constFind(key);
+	if (it != m_taskbrushes.constEnd())
+		return it.value();
+
+	QLinearGradient grad(0., 0., 0., height);
+	grad.setColorAt(0., color);
+	grad.setColorAt(1., getLighter(color, 1.20));
+
+	QBrush brush(grad);
+	m_taskbrushes.insert(key, brush);
+	return brush;
+}
+
+QBrush RoadmapPaintCache::summaryBrush(const QColor& color, int height)
+{
+	const QPair<QRgb, int> key(color.rgba(), height);
+
+	auto it = m_summarybrushes.constFind(key);
+	if (it != m_summarybrushes.constEnd())
+		return it.value();
+
+	QLinearGradient grad(0., 0., 0., height);
+	grad.setColorAt(0., color);
+	grad.setColorAt(1., getLighter(color, 0.8));
+
+	QBrush brush(grad);
+	m_summarybrushes.insert(key, brush);
+	return brush;
+}
+
+QFont RoadmapPaintCache::boldFont(const QFont& base)
+{
+	const QString key = base.key();
+
+	auto it = m_boldfonts.constFind(key);
+	if (it != m_boldfonts.constEnd())
+		return it.value();
+
+	QFont font = base;
+	font.setBold(true);
+	m_boldfonts.insert(key, font);
+	return font;
+}
+
+QPainterPath RoadmapPaintCache::eventPath(int delta)
+{
+	auto it = m_eventpaths.constFind(delta);
+	if (it != m_eventpaths.constEnd())
+		return it.value();
+
+	QPainterPath path;
+	path.moveTo(delta, 0.);
+	path.lineTo(2.*delta, delta);
+	path.lineTo(delta, 2.*delta);
+	path.lineTo(0., delta);
+	path.closeSubpath();
+
+	m_eventpaths.insert(delta, path);
+	return path;
+}
+
+QPainterPath RoadmapPaintCache::summaryPath(const QSizeF& size)
+{
+	// Chiave al quarto di pixel, sotto non si vedono differenze
+	const QPair<int, int> key(qRound(size.width() * 4.), qRound(size.height() * 4.));
+
+	if (QPainterPath* cached = m_summarypaths.object(key))
+		return *cached;
+
+	const qreal w = size.width();
+	const qreal h = size.height();
+
+	QPainterPath path;
+	const qreal deltaY = h;
+	const qreal deltaXBezierControl = .25*qMin(w, h);
+	const qreal deltaX = qMin(w, h);
+	path.moveTo(0., 0.);
+	path.lineTo(w, 0.);
+	path.lineTo(QPointF(w, 2.*deltaY));
+	path.quadTo(QPointF(w - deltaXBezierControl, deltaY), QPointF(w - deltaX, deltaY));
+	path.lineTo(QPointF(deltaX, deltaY));
+	path.quadTo(QPointF(deltaXBezierControl, deltaY), QPointF(0., 2.*deltaY));
+	path.closeSubpath();
+
+	m_summarypaths.insert(key, new QPainterPath(path));
+	return path;
+}
+
+int RoadmapPaintCache::textWidth(const QFont& font, const QFontMetrics& metrics, const QString& text)
+{
+	QHash<QString, int>& widths = m_textwidths[font.key()];
+
+	auto it = widths.constFind(text);
+	if (it != widths.constEnd())
+		return it.value();
+
+	/*
+	 * Le chiavi dei nomi rinominati restano in cache finché non viene riempita,
+	 * a quel punto la svuoto e riparto, costa una misura per nome visibile
+	 */
+	if (m_textcount >= 16384) {
+		m_textwidths.clear();
+		m_textcount = 0;
+		return textWidth(font, metrics, text);
+	}
+
+	const int width = metrics.width(text);
+	widths.insert(detachedString(text), width); // Il nome può essere una vista su un file mappato (Vedi RoadmapTables::load)
+	m_textcount++;
+	return width;
+}
+
+RoadmapRoute RoadmapPaintCache::constraintRoute(const QPointF& start, const QPointF& end, qreal turn)
+{
+	const QPair<QPair<int, int>, QPair<int, int>> key(
+		qMakePair(qRound(start.x() * 4.), qRound(start.y() * 4.)),
+		qMakePair(qRound(end.x() * 4.), qRound(end.y() * 4.)));
+
+	if (RoadmapRoute* cached = m_routes.object(key))
+		return *cached;
+
+	qreal midx = (end.x() - start.x()) / 2. + start.x();
+	qreal midy = (end.y() - start.y()) / 2. + start.y();
+
+	QPainterPath path(start);
+	if (start.x() > end.x() - turn) {
+		path.quadTo(QPointF(start.x() + turn * 2., (start.y() + midy) / 2.),
+			QPointF(midx, midy));
+		path.quadTo(QPointF(end.x() - turn * 2., (end.y() + midy) / 2.),
+			QPointF(end.x() - turn / 2., end.y()));
+	}
+	else {
+		path.cubicTo(QPointF(midx, start.y()),
+			QPointF(midx, end.y()),
+			QPointF(end.x() - turn / 2., end.y()));
+	}
+
+	/*
+	 * La curva resta un path da tracciare: con una penna cosmetica è larga un pixel
+	 * a qualsiasi scala (stampa, anteprima dello zoom), un contorno calcolato qui
+	 * sarebbe in unità della chart e si allargherebbe con la trasformazione
+	 */
+	RoadmapRoute route;
+	route.Curve = path;
+	route.Head << end
+		<< QPointF(end.x() - turn / 2., end.y() - turn / 2.)
+		<< QPointF(end.x() - turn / 2., end.y() + turn / 2.);
+
+	route.Bounds = path.boundingRect().united(route.Head.boundingRect()).adjusted(-1., -1., 1., 1.); // Mezzo pixel di penna per lato, abbondante
+
+	m_routes.insert(key, new RoadmapRoute(route));
+	return route;
+}
+
+void RoadmapPaintCache::clear()
+{
+	m_taskbrushes.clear();
+	m_summarybrushes.clear();
+	m_boldfonts.clear();
+	m_eventpaths.clear();
+	m_summarypaths.clear();
+	m_textwidths.clear();
+	m_textcount = 0;
+	m_routes.clear();
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <QHash>
+#include <QCache>
+#include <QPair>
+#include <QBrush>
+#include <QFont>
+#include <QPainterPath>
+#include <QPolygonF>
+#include <QFontMetrics>
+
+/*
+ * Percorso già calcolato di una freccia tra due elementi collegati
+ */
+struct RoadmapRoute
+{
+	QPainterPath Curve; // Curva della freccia, da tracciare con una penna cosmetica
+	QPolygonF Head; // Punta della freccia
+	QRectF Bounds; // Ingombro di curva e punta, per scartare le frecce fuori dall'area esposta
+};
+
+/*
+ * Cache degli oggetti di disegno usati dal delegate per gli item del Gantt
+ *
+ * Gradienti, font e path dipendono da pochi parametri (colore del progetto,
+ * altezza della riga, font di base, dimensione dell'item) ma venivano ricreati
+ * ad ogni paint di ogni item, qui vengono creati una sola volta e riutilizzati:
+ *  - Brush: per (colore, altezza del gradiente)
+ *  - Font: per font di base
+ *  - Path: costruiti nell'origine, il chiamante li trasla nella posizione dell'item
+ *  - Larghezza dei testi: per (testo, font), il layout non deve più fare text shaping
+ *  - Percorsi delle frecce dei link: per posizione degli estremi
+ *
+ * La cache non è thread safe, ogni thread di disegno deve avere la propria
+ */
+class RoadmapPaintCache
+{
+	QHash<QPair<QRgb, int>, QBrush> m_taskbrushes; // Gradiente dei task e delle milestone
+	QHash<QPair<QRgb, int>, QBrush> m_summarybrushes; // Gradiente dei progetti
+	QHash<QString, QFont> m_boldfonts; // Versione in grassetto dei font, per QFont::key()
+	QHash<int, QPainterPath> m_eventpaths; // Rombi delle milestone, per metà altezza
+	QCache<QPair<int, int>, QPainterPath> m_summarypaths; // Parentesi dei progetti, per dimensione
+	QHash<QString, QHash<QString, int>> m_textwidths; // Larghezza dei testi misurati, per QFont::key() e testo
+	int m_textcount = 0; // Numero di larghezze memorizzate
+	QCache<QPair<QPair<int, int>, QPair<int, int>>, RoadmapRoute> m_routes; // Frecce dei link, per estremi al quarto di pixel
+
+public:
+	RoadmapPaintCache();
+
+    /*
+     * Gradiente verticale da color ad una sua versione più chiara (task)
+     * o più scura (progetti), alto height pixel
+     */
+	QBrush taskBrush(const QColor& color, int height);
+	QBrush summaryBrush(const QColor& color, int height);
+
+    /*
+     * Font in grassetto a partire dal font di base
+     */
+	QFont boldFont(const QFont& base);
+
+    /*
+     * Path del rombo di una milestone, delta è metà del lato del quadrato che lo contiene
+     */
+	QPainterPath eventPath(int delta);
+
+    /*
+     * Path della parentesi di un progetto che occupa un rettangolo di dimensione size
+     */
+	QPainterPath summaryPath(const QSizeF& size);
+
+    /*
+     * Larghezza in pixel di un testo misurato con le metriche del font indicato,
+     * la chiave è il testo stesso quindi rinominare un elemento produce una nuova misura,
+     * le misure vecchie vengono scartate quando la cache si riempie
+     */
+	int textWidth(const QFont& font, const QFontMetrics& metrics, const QString& text);
+
+    /*
+     * Percorso della freccia che va da start a end, turn è il raggio minimo delle curve.
+     * Se la destinazione è più avanti della partenza la freccia è una cubica,
+     * altrimenti torna indietro con due quadratiche
+     */
+	RoadmapRoute constraintRoute(const QPointF& start, const QPointF& end, qreal turn);
+
+    /*
+     * Svuota tutte le cache
+     */
+	void clear();
+};
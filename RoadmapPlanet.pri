@@ -5,15 +5,39 @@ HEADERS += RoadmapItemDelegate.hpp \
     RoadmapMainWnd.hpp \
     RoadmapModel.hpp \
     RoadmapGrid.hpp \
-    Roadmap.hpp
+    Roadmap.hpp \
+    RoadmapTimeline.hpp \
+    RoadmapPaintCache.hpp \
+    RoadmapMinimap.hpp \
+    RoadmapRenderer.hpp \
+    RoadmapPrinter.hpp \
+    RoadmapPngWriter.hpp \
+    RoadmapFormat.hpp \
+    RoadmapJournal.hpp \
+    RoadmapSaver.hpp \
+    RoadmapWal.hpp
 
-SOURCES += main.cpp \
-    Roadmap.cpp \
+SOURCES += Roadmap.cpp \
     RoadmapGrid.cpp \
     RoadmapItemDelegate.cpp \
     RoadmapMainWnd.cpp \
     RoadmapView.cpp \
-    RoadmapModel.cpp
+    RoadmapModel.cpp \
+    RoadmapTimeline.cpp \
+    RoadmapPaintCache.cpp \
+    RoadmapMinimap.cpp \
+    RoadmapRenderer.cpp \
+    RoadmapPrinter.cpp \
+    RoadmapPngWriter.cpp \
+    RoadmapFormat.cpp \
+    RoadmapJournal.cpp \
+    RoadmapSaver.cpp \
+    RoadmapWal.cpp
+
+# RoadmapPngWriter usa zlib direttamente attraverso <QtZlib/zlib.h>:
+# con la zlib di sistema va linkata, altrimenti (Qt compilato con la propria zlib,
+# come le build ufficiali per Windows) i simboli arrivano da QtCore
+qtConfig(system-zlib): LIBS += -lz
 
 RESOURCES += RoadmapPlanet.qrc
 
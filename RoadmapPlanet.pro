@@ -4,6 +4,8 @@ INCLUDEPATH += "$$_PRO_FILE_PWD_/include/" \
     "$$_PRO_FILE_PWD_/include/KDChart/" \
     "$$_PRO_FILE_PWD_/include/KDGantt/"
 
-QT += printsupport
+QT += printsupport concurrent
 
 include( RoadmapPlanet.pri )
+
+SOURCES += main.cpp
@@ -0,0 +1,17 @@
+
+# Renderer a riga di comando (vedi RoadmapCli.cpp), non richiede un display
+
+TARGET = RoadmapPlanetCli
+CONFIG += console
+CONFIG -= app_bundle
+
+LIBS += -L"$$_PRO_FILE_PWD_/lib/" -lkdchart
+INCLUDEPATH += "$$_PRO_FILE_PWD_/include/" \
+    "$$_PRO_FILE_PWD_/include/KDChart/" \
+    "$$_PRO_FILE_PWD_/include/KDGantt/"
+
+QT += widgets printsupport concurrent svg
+
+include( RoadmapPlanet.pri )
+
+SOURCES += RoadmapCli.cpp
@@ -0,0 +1,138 @@
+#include "RoadmapPngWriter.hpp"
+#include <QIODevice>
+#include <QtEndian>
+#include <cstring>
+
+RoadmapPngWriter::RoadmapPngWriter(QIODevice* device) : m_device(device)
+{
+	memset(&m_zstream, 0, sizeof(m_zstream));
+}
+
+RoadmapPngWriter::~RoadmapPngWriter()
+{
+	if (m_open)
+		deflateEnd(&m_zstream);
+}
+
+bool RoadmapPngWriter::begin(int width, int height, int dpi)
+{
+	if (m_open || m_device == nullptr || width <= 0 || height <= 0)
+		return false;
+
+	if (deflateInit(&m_zstream, Z_DEFAULT_COMPRESSION) != Z_OK)
+		return false;
+
+	m_open = true;
+	m_width = width;
+	m_height = height;
+	m_written = 0;
+	m_row.resize(1 + width * 3); // Byte del filtro + RGB
+	m_out.resize(CHUNKSIZE);
+	m_zstream.next_out = reinterpret_cast<Bytef*>(m_out.data());
+	m_zstream.avail_out = CHUNKSIZE;
+
+	static const char signature[] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n' };
+	if (m_device->write(signature, sizeof(signature)) != sizeof(signature))
+		return false;
+
+    // IHDR: dimensioni, 8 bit, RGB (2), deflate, filtri standard, niente interlacciamento
+	QByteArray header(13, '\0');
+	qToBigEndian<quint32>(width, reinterpret_cast<uchar*>(header.data()));
+	qToBigEndian<quint32>(height, reinterpret_cast<uchar*>(header.data() + 4));
+	header[8] = 8;
+	header[9] = 2;
+	if (!writeChunk("IHDR", header))
+		return false;
+
+    // pHYs: risoluzione in pixel per metro
+	QByteArray physical(9, '\0');
+	const quint32 ppm = quint32(qRound(dpi / 0.0254));
+	qToBigEndian<quint32>(ppm, reinterpret_cast<uchar*>(physical.data()));
+	qToBigEndian<quint32>(ppm, reinterpret_cast<uchar*>(physical.data() + 4));
+	physical[8] = 1; // Metri
+	return writeChunk("pHYs", physical);
+}
+
+bool RoadmapPngWriter::writeRows(const QImage& image, int rows)
+{
+	if (!m_open || image.width() != m_width || rows > image.height() || m_written + rows > m_height)
+		return false;
+
+	const QImage rgb = image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32
+		? image : image.convertToFormat(QImage::Format_RGB32);
+
+	for (int y = 0; y < rows; y++)
+	{
+		const QRgb* pixels = reinterpret_cast<const QRgb*>(rgb.constScanLine(y));
+		uchar* out = reinterpret_cast<uchar*>(m_row.data());
+		*out++ = 1; // Filtro Sub
+
+		uchar left[3] = { 0, 0, 0 };
+		for (int x = 0; x < m_width; x++)
+		{
+			const uchar px[3] = { uchar(qRed(pixels[x])), uchar(qGreen(pixels[x])), uchar(qBlue(pixels[x])) };
+			for (int c = 0; c < 3; c++) {
+				*out++ = uchar(px[c] - left[c]);
+				left[c] = px[c];
+			}
+		}
+
+		m_zstream.next_in = reinterpret_cast<Bytef*>(m_row.data());
+		m_zstream.avail_in = uInt(m_row.size());
+		if (!deflate(Z_NO_FLUSH))
+			return false;
+	}
+
+	m_written += rows;
+	return true;
+}
+
+bool RoadmapPngWriter::end()
+{
+	if (!m_open)
+		return false;
+
+	const bool ok = m_written == m_height && deflate(Z_FINISH) && writeChunk("IEND", QByteArray());
+	deflateEnd(&m_zstream);
+	m_open = false;
+	return ok;
+}
+
+bool RoadmapPngWriter::deflate(int flush)
+{
+	for (;;)
+	{
+		const int result = ::deflate(&m_zstream, flush);
+		if (result == Z_STREAM_ERROR)
+			return false;
+
+        // Buffer pieno, o flusso finito: scrivo un chunk e riparto
+		const int produced = CHUNKSIZE - int(m_zstream.avail_out);
+		if (m_zstream.avail_out == 0 || (result == Z_STREAM_END && produced > 0)) {
+			if (!writeChunk("IDAT", QByteArray::fromRawData(m_out.constData(), produced)))
+				return false;
+
+			m_zstream.next_out = reinterpret_cast<Bytef*>(m_out.data());
+			m_zstream.avail_out = CHUNKSIZE;
+		}
+
+		if (flush == Z_FINISH ? result == Z_STREAM_END : m_zstream.avail_in == 0)
+			return true;
+	}
+}
+
+bool RoadmapPngWriter::writeChunk(const char* type, const QByteArray& data)
+{
+	uchar length[4];
+	qToBigEndian<quint32>(data.size(), length);
+
+	uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+	crc = crc32(crc, reinterpret_cast<const Bytef*>(data.constData()), uInt(data.size()));
+	uchar checksum[4];
+	qToBigEndian<quint32>(quint32(crc), checksum);
+
+	return m_device->write(reinterpret_cast<const char*>(length), 4) == 4
+		&& m_device->write(type, 4) == 4
+		&& m_device->write(data) == data.size()
+		&& m_device->write(reinterpret_cast<const char*>(checksum), 4) == 4;
+}
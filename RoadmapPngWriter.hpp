@@ -0,0 +1,58 @@
+#pragma once
+#include <QByteArray>
+#include <QImage>
+#include <QtZlib/zlib.h> // La zlib di Qt: quella di sistema se Qt la usa, altrimenti quella inclusa in QtCore
+
+class QIODevice;
+
+/*
+ * Encoder PNG a flusso: le righe dell'immagine vengono compresse e scritte
+ * sul device man mano che arrivano, a blocchi (ad esempio le fasce di un'esportazione),
+ * senza mai avere in memoria l'immagine intera.
+ *
+ * Il file è RGB a 8 bit per canale senza interlacciamento, ogni riga usa il filtro
+ * Sub (differenza con il pixel a sinistra) che sulle aree piatte del Gantt comprime molto.
+ * I dati compressi escono in chunk IDAT di al massimo CHUNKSIZE byte.
+ */
+class RoadmapPngWriter
+{
+	QIODevice* m_device; // Destinazione
+	z_stream m_zstream; // Stato del deflate, le righe compresse non restano in memoria
+	QByteArray m_row; // Riga filtrata da comprimere
+	QByteArray m_out; // Buffer di uscita del deflate, diventa un chunk IDAT quando è pieno
+	int m_width = 0;
+	int m_height = 0;
+	int m_written = 0; // Righe già scritte
+	bool m_open = false; // begin() riuscita e end() non ancora chiamata
+
+public:
+	enum
+	{
+		CHUNKSIZE = 64 * 1024 // Dimensione massima dei chunk IDAT
+	};
+
+	explicit RoadmapPngWriter(QIODevice* device);
+	~RoadmapPngWriter();
+
+	RoadmapPngWriter(const RoadmapPngWriter&) = delete;
+	RoadmapPngWriter& operator=(const RoadmapPngWriter&) = delete;
+
+    /*
+     * Scrive l'intestazione di un'immagine width x height a dpi punti per pollice
+     */
+	bool begin(int width, int height, int dpi = 96);
+
+    /*
+     * Accoda le prime rows righe di image, che deve essere larga quanto l'immagine
+     */
+	bool writeRows(const QImage& image, int rows);
+
+    /*
+     * Chiude il flusso, fallisce se non sono state scritte tutte le righe
+     */
+	bool end();
+
+private:
+	bool writeChunk(const char* type, const QByteArray& data);
+	bool deflate(int flush);
+};
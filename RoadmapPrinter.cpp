@@ -0,0 +1,372 @@
+#include "RoadmapPrinter.hpp"
+#include <QPainter>
+#include <QPrinter>
+#include <QApplication>
+#include <QGraphicsScene>
+#include <QtMath>
+#include <QPicture>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QFile>
+#include "RoadmapPngWriter.hpp"
+#include <KDGanttGraphicsView>
+#include <KDGanttAbstractGrid>
+#include <KDGanttAbstractRowController>
+#include <KDGanttGlobal>
+
+#define ScreenDpi 96. // Le misure della chart sono pensate per uno schermo a 96 dpi
+#define LabelColumn 200. // Larghezza della colonna dei nomi
+
+RoadmapPrinter::RoadmapPrinter(KDGantt::GraphicsView* view) : m_view(view)
+{
+}
+
+void RoadmapPrinter::setRasterResolution(int dpi)
+{
+	m_rasterdpi = qMax(0, dpi);
+}
+
+int RoadmapPrinter::rasterResolution() const
+{
+	return m_rasterdpi;
+}
+
+void RoadmapPrinter::setRange(qreal left, qreal right)
+{
+	m_rangeleft = left;
+	m_rangeright = right;
+}
+
+RoadmapPageLayout RoadmapPrinter::layout(QPrinter* printer) const
+{
+	return layout(printer->pageRect().size(), printer->resolution());
+}
+
+RoadmapPageLayout RoadmapPrinter::layout(const QSizeF& page, qreal resolution) const
+{
+	RoadmapPageLayout layout;
+
+	KDGantt::AbstractRowController* rows = m_view->rowController();
+	const QAbstractItemModel* model = m_view->model();
+	if (rows == nullptr || model == nullptr || m_view->scene() == nullptr)
+		return layout;
+
+	const QFontMetricsF metrics(QApplication::font());
+
+	layout.Scale = resolution / ScreenDpi;
+	layout.HeaderHeight = m_view->headerWidget() != nullptr ? m_view->headerWidget()->height() : 2. * metrics.height() + 8.;
+	layout.LabelWidth = LabelColumn;
+	layout.FooterHeight = metrics.height() + 4.;
+	layout.PageWidth = page.width() / layout.Scale - layout.LabelWidth;
+	layout.PageHeight = page.height() / layout.Scale - layout.HeaderHeight - layout.FooterHeight;
+
+	const QRectF scene = m_view->scene()->sceneRect();
+	layout.Chart = QRectF(scene.left(), 0., scene.width(), rows->totalHeight());
+	if (m_rangeright > m_rangeleft)
+		layout.Chart = layout.Chart.intersected(QRectF(m_rangeleft, 0., m_rangeright - m_rangeleft, layout.Chart.height()));
+
+	if (layout.PageWidth <= 0. || layout.PageHeight <= 0. || layout.Chart.isEmpty())
+		return layout;
+
+	layout.Columns = qCeil(layout.Chart.width() / layout.PageWidth);
+
+	/*
+	 * Divido le righe in fasce alte al massimo una pagina, una riga più alta
+	 * di una pagina occupa comunque una fascia intera
+	 */
+	layout.Bands.append(layout.Chart.top());
+	for (QModelIndex idx = model->index(0, 0, m_view->rootIndex()); idx.isValid(); idx = rows->indexBelow(idx))
+	{
+		const KDGantt::Span row = rows->rowGeometry(idx);
+		if (row.end() - layout.Bands.last() > layout.PageHeight && row.start() > layout.Bands.last())
+			layout.Bands.append(row.start());
+	}
+	layout.Bands.append(qMax(layout.Chart.bottom(), layout.Bands.last() + 1.));
+
+	return layout;
+}
+
+RoadmapPageLayout RoadmapPrinter::fit(qreal resolution) const
+{
+	// Prima calcolo l'area da esportare con una pagina qualsiasi, poi la allargo fino a contenerla
+	RoadmapPageLayout layout = this->layout(QSizeF(1000., 1000.) * resolution / ScreenDpi, resolution);
+	if (layout.Chart.isEmpty())
+		return layout;
+
+	layout.PageWidth = layout.Chart.width();
+	layout.PageHeight = layout.Chart.height();
+	layout.Columns = 1;
+	layout.Bands = QVector<qreal>() << layout.Chart.top() << layout.Chart.bottom();
+	return layout;
+}
+
+bool RoadmapPrinter::print(QPrinter* printer, Progress progress)
+{
+	const RoadmapPageLayout pages = layout(printer);
+	if (pages.pages() == 0)
+		return false;
+
+	QPainter painter;
+	if (!painter.begin(printer))
+		return false;
+
+	if (m_rasterdpi > 0)
+	{
+		// Le immagini coprono l'intera pagina, le scalo sulla risoluzione del printer
+		const QRectF target(0., 0.,
+			(pages.LabelWidth + pages.PageWidth) * pages.Scale,
+			(pages.HeaderHeight + pages.PageHeight + pages.FooterHeight) * pages.Scale);
+
+		const bool done = rasterize(pages, m_rasterdpi, PageSink(), [&](int page, const QImage& image)
+		{
+			if (page > 0)
+				printer->newPage();
+
+			painter.drawImage(target, image);
+			return true;
+		}, progress);
+
+		painter.end();
+		return done;
+	}
+
+	for (int page = 0; page < pages.pages(); page++)
+	{
+		if (page > 0)
+			printer->newPage();
+
+		paintPage(&painter, pages, page);
+
+		if (progress && !progress(page + 1, pages.pages())) {
+			painter.end();
+			return false;
+		}
+	}
+
+	painter.end();
+	return true;
+}
+
+bool RoadmapPrinter::exportImages(const QString& path, const QSizeF& page, int dpi, Progress progress)
+{
+	const QSizeF pixels = page / 25.4 * dpi; // Millimetri -> pixel
+
+	return rasterize(layout(pixels, dpi), dpi, [path](int index, const QImage& image)
+	{
+		return image.save(path.arg(index + 1, 3, 10, QChar('0')), "PNG");
+	}, PageSink(), progress);
+}
+
+bool RoadmapPrinter::rasterize(const RoadmapPageLayout& layout, int dpi, PageSink save, PageSink sink, Progress progress)
+{
+	const int count = layout.pages();
+	if (count == 0 || dpi <= 0)
+		return false;
+
+	/*
+	 * Le pagine vengono registrate in coordinate della chart,
+	 * la scala alla risoluzione richiesta la applica il rasterizzatore
+	 */
+	RoadmapPageLayout flat = layout;
+	flat.Scale = 1.;
+
+	const qreal scale = dpi / ScreenDpi;
+	const QSize size(qCeil((layout.LabelWidth + layout.PageWidth) * scale),
+		qCeil((layout.HeaderHeight + layout.PageHeight + layout.FooterHeight) * scale));
+
+	struct Raster
+	{
+		bool Ok; // Pagina rasterizzata (ed eventualmente salvata)
+		QImage Image; // Vuota se la pagina è stata salvata dal thread del pool
+	};
+
+	const int window = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+	QList<QFuture<Raster>> inflight; // Job in ordine di pagina
+	int next = 0; // Prossima pagina da registrare
+	bool ok = true;
+
+	for (int page = 0; page < count && ok; page++)
+	{
+		// Tengo il pool pieno registrando le pagine successive finché c'è posto
+		while (next < count && inflight.count() < window)
+		{
+			QPicture picture;
+			QPainter recorder(&picture);
+			paintPage(&recorder, flat, next);
+			recorder.end();
+
+			const int index = next++;
+			inflight.append(QtConcurrent::run([=]() mutable -> Raster
+			{
+				QImage image(size, QImage::Format_RGB32);
+				image.fill(Qt::white);
+
+				QPainter painter(&image);
+				painter.setRenderHint(QPainter::Antialiasing, true);
+				painter.setRenderHint(QPainter::TextAntialiasing, true);
+				painter.scale(scale, scale);
+				picture.play(&painter);
+				painter.end();
+
+				if (save)
+					return Raster{ save(index, image), QImage() };
+
+				return Raster{ true, image };
+			}));
+		}
+
+		const Raster raster = inflight.takeFirst().result(); // Aspetto la pagina successiva in ordine
+		ok = raster.Ok && (!sink || sink(page, raster.Image));
+
+		if (ok && progress)
+			ok = progress(page + 1, count);
+	}
+
+	// Se interrotta aspetto i job ancora in volo prima di uscire
+	for (QFuture<Raster>& job : inflight)
+		job.waitForFinished();
+
+	return ok;
+}
+
+bool RoadmapPrinter::exportStream(const QString& path, int dpi, Progress progress)
+{
+	const RoadmapPageLayout layout = fit(dpi);
+	if (layout.pages() == 0)
+		return false;
+
+	const QSizeF page(layout.LabelWidth + layout.PageWidth, layout.HeaderHeight + layout.PageHeight + layout.FooterHeight);
+	const QSize size(qCeil(page.width() * layout.Scale), qCeil(page.height() * layout.Scale));
+
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	RoadmapPngWriter png(&file);
+	if (!png.begin(size.width(), size.height(), dpi))
+		return false;
+
+	QImage band(size.width(), qMin(size.height(), int(BANDHEIGHT)), QImage::Format_RGB32);
+	if (band.isNull())
+		return false;
+
+	const int bands = (size.height() + BANDHEIGHT - 1) / BANDHEIGHT;
+	for (int b = 0; b < bands; b++)
+	{
+		const int y = b * BANDHEIGHT;
+		const int rows = qMin(int(BANDHEIGHT), size.height() - y);
+
+		band.fill(Qt::white);
+		QPainter painter(&band);
+		painter.setRenderHint(QPainter::Antialiasing, true);
+		painter.setRenderHint(QPainter::TextAntialiasing, true);
+		painter.translate(0., -y);
+
+        // La fascia in coordinate della pagina, con un pixel di margine per l'antialiasing
+		const QRectF exposed(0., (y - 1) / layout.Scale, page.width(), (rows + 2) / layout.Scale);
+		paintPage(&painter, layout, 0, exposed);
+		painter.end();
+
+		if (!png.writeRows(band, rows))
+			return false;
+
+		if (progress && !progress(b + 1, bands))
+			return false;
+	}
+
+	return png.end();
+}
+
+void RoadmapPrinter::paintPage(QPainter* painter, const RoadmapPageLayout& layout, int page, const QRectF& exposed) const
+{
+	const int column = page % layout.Columns;
+	const int band = page / layout.Columns;
+
+	const qreal left = layout.Chart.left() + column * layout.PageWidth;
+	const qreal right = qMin(left + layout.PageWidth, layout.Chart.right());
+	const qreal top = layout.Bands.at(band);
+	const qreal bottom = layout.Bands.at(band + 1);
+
+	painter->save();
+	painter->scale(layout.Scale, layout.Scale); // Da qui in poi lavoro in coordinate della chart
+
+	const QRectF area = exposed.isValid() ? exposed
+		: QRectF(0., 0., layout.LabelWidth + layout.PageWidth, layout.HeaderHeight + layout.PageHeight + layout.FooterHeight);
+
+	/*
+	 * Chart: la scena disegna solo gli item che intersecano l'area della pagina,
+	 * ristretta alla parte esposta (la pagina è una copia 1:1 della chart)
+	 */
+	const QRectF target = QRectF(layout.LabelWidth, layout.HeaderHeight, right - left, bottom - top).intersected(area);
+	if (!target.isEmpty()) {
+		const QRectF source = target.translated(left - layout.LabelWidth, top - layout.HeaderHeight);
+		painter->save();
+		painter->setClipRect(target);
+		m_view->scene()->render(painter, target, source, Qt::IgnoreAspectRatio);
+		painter->restore();
+	}
+
+	/*
+	 * Header ripetuto, la grid disegna le celle a partire dall'offset della pagina
+	 */
+	const QRectF header(0., 0., right - left, layout.HeaderHeight);
+	if (header.translated(layout.LabelWidth, 0.).intersects(area)) {
+		painter->save();
+		painter->translate(layout.LabelWidth, 0.);
+		painter->setClipRect(header);
+		m_view->grid()->paintHeader(painter, header, header, left, nullptr);
+		painter->restore();
+	}
+
+	// Colonna dei nomi ripetuta
+	paintLabels(painter, layout, top, bottom, area);
+
+	// Piè di pagina
+	const QRectF footer(0., layout.HeaderHeight + layout.PageHeight, layout.LabelWidth + layout.PageWidth, layout.FooterHeight);
+	if (footer.intersects(area)) {
+		painter->setPen(Qt::black);
+		painter->drawText(footer, Qt::AlignRight | Qt::AlignVCenter, QString("%1 / %2").arg(page + 1).arg(layout.pages()));
+	}
+
+	painter->restore();
+}
+
+void RoadmapPrinter::paintLabels(QPainter* painter, const RoadmapPageLayout& layout, qreal top, qreal bottom, const QRectF& exposed) const
+{
+	KDGantt::AbstractRowController* rows = m_view->rowController();
+	const QAbstractItemModel* model = m_view->model();
+
+	painter->save();
+	painter->setClipRect(QRectF(0., layout.HeaderHeight, layout.LabelWidth, bottom - top));
+	painter->setPen(Qt::black);
+
+	QFont bold = painter->font();
+	bold.setBold(true);
+	const QFont normal = painter->font();
+
+	/*
+	 * Parto dalla prima riga esposta della fascia e scendo finché non esco,
+	 * le righe delle altre fasce (o fuori dall'area esposta) non vengono nemmeno visitate
+	 */
+	const qreal from = qMax(top, top + exposed.top() - layout.HeaderHeight);
+	const qreal to = qMin(bottom, top + exposed.bottom() - layout.HeaderHeight);
+	for (QModelIndex idx = rows->indexAt(from > top ? qFloor(from) : qCeil(top)); idx.isValid(); idx = rows->indexBelow(idx))
+	{
+		const KDGantt::Span row = rows->rowGeometry(idx);
+		if (row.start() >= to)
+			break;
+
+		const bool summary = model->data(idx, KDGantt::ItemTypeRole).toInt() == KDGantt::TypeSummary;
+		const qreal indent = summary ? 4. : 16.; // Gli elementi sono rientrati sotto il loro progetto
+		const QRectF r(indent, layout.HeaderHeight + row.start() - top, layout.LabelWidth - indent - 4., row.length());
+
+		painter->setFont(summary ? bold : normal);
+		painter->drawText(r, Qt::AlignLeft | Qt::AlignVCenter, painter->fontMetrics().elidedText(model->data(idx, Qt::DisplayRole).toString(), Qt::ElideRight, int(r.width())));
+	}
+
+	// Separatore tra i nomi e la chart
+	painter->setClipping(false);
+	painter->drawLine(QPointF(layout.LabelWidth - 0.5, 0.), QPointF(layout.LabelWidth - 0.5, layout.HeaderHeight + bottom - top));
+
+	painter->restore();
+}
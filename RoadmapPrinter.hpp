@@ -0,0 +1,144 @@
+#pragma once
+/*
+ * Questo file contiene la definizione di RoadmapPrinter
+ *
+ *  - RoadmapPrinter
+ *      -> esporta il Gantt su più pagine: la timeline e le righe vengono divise
+ *         in pagine come in un mosaico, ogni pagina ripete l'header della grid
+ *         e la colonna con i nomi delle righe.
+ *         Le pagine sono generate una alla volta (la scena disegna solo gli item
+ *         che cadono nella pagina), la memoria usata non dipende dal numero di righe.
+ *
+ *         Le righe non vengono mai tagliate tra due pagine: le fasce verticali
+ *         iniziano sempre all'inizio di una riga.
+ *
+ *         Esportazione raster: ogni pagina viene registrata in un QPicture sul thread
+ *         della GUI (registrare costa poco, nessun pixel viene disegnato) e poi
+ *         rasterizzata in un QImage sui thread del pool, più pagine alla volta.
+ *         Le immagini vengono consegnate al printer nell'ordine delle pagine,
+ *         con al massimo una pagina in volo per thread, la memoria resta limitata.
+ *         Le esportazioni PNG scrivono i file direttamente dai thread del pool.
+ *
+ *         Esportazione a fasce: un'immagine unica di qualsiasi dimensione viene disegnata
+ *         a fasce orizzontali di BANDHEIGHT pixel, ogni fascia viene passata all'encoder PNG
+ *         (RoadmapPngWriter) e poi riusata per la successiva: la memoria dipende solo
+ *         dalla larghezza dell'immagine, non dalla sua altezza.
+ */
+#include <QRectF>
+#include <QVector>
+#include <QImage>
+#include <functional>
+
+class QPainter;
+class QPrinter;
+
+namespace KDGantt {
+    class GraphicsView;
+}
+
+/*
+ * Impaginazione del Gantt, le misure sono in coordinate della chart
+ */
+struct RoadmapPageLayout
+{
+    qreal Scale = 1.; // Pixel del device per unità della chart
+    QRectF Chart; // Area della chart da esportare
+    qreal HeaderHeight = 0.; // Altezza dell'header ripetuto
+    qreal LabelWidth = 0.; // Larghezza della colonna dei nomi
+    qreal FooterHeight = 0.; // Altezza del piè di pagina
+    qreal PageWidth = 0.; // Larghezza della chart in una pagina
+    qreal PageHeight = 0.; // Altezza massima della chart in una pagina
+    int Columns = 0; // Pagine in orizzontale
+    QVector<qreal> Bands; // Inizio di ogni fascia verticale, l'ultimo valore è la fine della chart
+
+    int rows() const { return Bands.count() - 1; }
+    int pages() const { return Columns * rows(); }
+};
+
+class RoadmapPrinter
+{
+public:
+    enum
+    {
+        BANDHEIGHT = 256 // Righe di pixel di una fascia dell'esportazione a flusso
+    };
+
+private:
+    KDGantt::GraphicsView* m_view; // View del Gantt da esportare
+    int m_rasterdpi = 0; // Risoluzione delle pagine rasterizzate, 0 per l'esportazione vettoriale
+    qreal m_rangeleft = 0.; // Intervallo orizzontale da esportare, vuoto per tutta la chart
+    qreal m_rangeright = 0.;
+
+public:
+    /*
+     * La callback di avanzamento riceve la pagina appena terminata e il totale,
+     * se ritorna false l'esportazione si interrompe
+     */
+    typedef std::function<bool(int page, int pages)> Progress;
+
+    /*
+     * Riceve una pagina rasterizzata, ritorna false per interrompere
+     */
+    typedef std::function<bool(int page, const QImage& image)> PageSink;
+
+	explicit RoadmapPrinter(KDGantt::GraphicsView* view);
+
+    /*
+     * Imposta la risoluzione con cui print() rasterizza le pagine in parallelo,
+     * 0 (predefinito) esporta le pagine in vettoriale una alla volta
+     */
+	void setRasterResolution(int dpi);
+	int rasterResolution() const;
+
+    /*
+     * Limita l'esportazione ad un intervallo orizzontale della chart (ad esempio
+     * una finestra di date mappata dalla grid), left >= right esporta tutta la chart
+     */
+	void setRange(qreal left, qreal right);
+
+    /*
+     * Calcola l'impaginazione per la pagina del printer, o per una pagina
+     * di una certa dimensione in pixel del device con la risoluzione indicata
+     */
+	RoadmapPageLayout layout(QPrinter* printer) const;
+	RoadmapPageLayout layout(const QSizeF& page, qreal resolution) const;
+
+    /*
+     * Impaginazione su una sola pagina grande quanto tutta l'area da esportare
+     */
+	RoadmapPageLayout fit(qreal resolution) const;
+
+    /*
+     * Esporta tutte le pagine, ritorna false se l'esportazione è stata interrotta
+     */
+	bool print(QPrinter* printer, Progress progress = Progress());
+
+    /*
+     * Esporta le pagine come immagini PNG, path contiene %1 che viene sostituito
+     * dal numero della pagina, page è la dimensione di una pagina in millimetri
+     */
+	bool exportImages(const QString& path, const QSizeF& page, int dpi, Progress progress = Progress());
+
+    /*
+     * Esporta tutta l'area in un'unica immagine PNG a dpi punti per pollice,
+     * disegnata e compressa una fascia alla volta
+     */
+	bool exportStream(const QString& path, int dpi, Progress progress = Progress());
+
+    /*
+     * Disegna una pagina, il painter deve essere all'origine dell'area stampabile.
+     * Se exposed è valido (coordinate della pagina prima della scala) vengono disegnati
+     * solo scena, header, nomi e piè di pagina che lo toccano
+     */
+	void paintPage(QPainter* painter, const RoadmapPageLayout& layout, int page, const QRectF& exposed = QRectF()) const;
+
+private:
+    /*
+     * Pipeline raster: registra le pagine sul thread della GUI, le rasterizza sul pool
+     * e consegna le immagini a sink nell'ordine delle pagine (sul thread della GUI).
+     * Se save è impostata viene chiamata direttamente dai thread del pool e sink riceve immagini vuote
+     */
+	bool rasterize(const RoadmapPageLayout& layout, int dpi, PageSink save, PageSink sink, Progress progress);
+
+	void paintLabels(QPainter* painter, const RoadmapPageLayout& layout, qreal top, qreal bottom, const QRectF& exposed) const;
+};
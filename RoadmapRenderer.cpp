@@ -0,0 +1,390 @@
+#include "RoadmapRenderer.hpp"
+#include <QPainter>
+#include <QApplication>
+#include <QGraphicsScene>
+#include <QItemSelectionModel>
+#include <QAbstractProxyModel>
+#include <QtConcurrent>
+#include <QtMath>
+#include <QSet>
+#include <KDGanttGraphicsView>
+#include <KDGanttDateTimeGrid>
+#include <KDGanttAbstractRowController>
+#include <KDGanttConstraintModel>
+#include <KDGanttStyleOptionGanttItem>
+#include <algorithm>
+#include "Utility.hpp"
+
+#define RouteMargin 32. // Ingombro massimo delle curve delle frecce oltre gli estremi
+
+/*
+ * Puntatore all'elemento della Roadmap dietro un indice, risalendo i proxy di KDGantt,
+ * serve per agganciare le frecce (i link conoscono gli indici del modello sorgente)
+ */
+static void* sourcePointer(QModelIndex index)
+{
+	while (auto proxy = qobject_cast<const QAbstractProxyModel*>(index.model()))
+		index = proxy->mapToSource(index);
+
+	return index.internalPointer();
+}
+
+/*
+ * Rettangolo dell'item di una riga nella chart, come lo calcola la scena di KDGantt:
+ * la x dalla grid e la y dal row controller. Falso per le righe senza item,
+ * nascoste o riassunte dall'involucro del progetto
+ */
+static bool itemRect(KDGantt::GraphicsView* view, const QModelIndex& idx, qreal dayWidth, QRectF& rect)
+{
+	const KDGantt::AbstractGrid* grid = view->grid();
+	KDGantt::AbstractRowController* rows = view->rowController();
+	auto roadmapDelegate = dynamic_cast<const RoadmapItemDelegate*>(view->itemDelegate());
+
+	if (static_cast<KDGantt::ItemType>(idx.data(KDGantt::ItemTypeRole).toInt()) == KDGantt::TypeNone || !rows->isRowVisible(idx))
+		return false;
+
+	const KDGantt::Span xs = grid->mapToChart(idx);
+	const KDGantt::Span ys = rows->rowGeometry(idx);
+	if (!xs.isValid() || !ys.isValid())
+		return false;
+
+    // Come in RoadmapItemDelegate::paintGanttItem le righe degli elementi sono riassunte dagli involucri
+	if (roadmapDelegate != nullptr && roadmapDelegate->isFolded(idx, dayWidth))
+		return false;
+
+	rect = QRectF(xs.start(), ys.start(), xs.length(), ys.length());
+	return true;
+}
+
+QSharedPointer<const RoadmapSnapshot> RoadmapSnapshot::capture(KDGantt::GraphicsView* view, const QRectF& area)
+{
+	QSharedPointer<RoadmapSnapshot> snapshot(new RoadmapSnapshot());
+
+	const KDGantt::DateTimeGrid* grid = dynamic_cast<const KDGantt::DateTimeGrid*>(view->grid());
+	KDGantt::AbstractRowController* rows = view->rowController();
+	const QAbstractItemModel* model = view->model();
+	KDGantt::ItemDelegate* delegate = view->itemDelegate();
+	auto roadmapDelegate = dynamic_cast<const RoadmapItemDelegate*>(delegate);
+	if (grid == nullptr || rows == nullptr || model == nullptr || delegate == nullptr)
+		return snapshot;
+
+	snapshot->DayWidth = grid->dayWidth();
+	snapshot->Area = area;
+	snapshot->GradientHeight = QApplication::fontMetrics().height();
+	snapshot->Font = view->scene() != nullptr ? view->scene()->font() : QApplication::font();
+
+	KDGantt::StyleOptionGanttItem opt;
+	opt.font = snapshot->Font;
+	opt.fontMetrics = QFontMetrics(opt.font);
+	opt.grid = const_cast<KDGantt::DateTimeGrid*>(grid);
+
+	QHash<void*, QRectF> rects; // Rettangoli degli item per elemento della Roadmap
+
+	/*
+	 * Parto dalla prima riga dell'area e scendo finché non esco, come RoadmapPrinter:
+	 * le righe sopra e sotto non vengono nemmeno visitate, quelle con l'item
+	 * fuori dall'area in orizzontale non chiedono testo, colore e milestone
+	 */
+	for (QModelIndex idx = rows->indexAt(qMax(0, qFloor(area.top()))); idx.isValid(); idx = rows->indexBelow(idx))
+	{
+		const KDGantt::Span ys = rows->rowGeometry(idx);
+		if (ys.isValid() && ys.start() >= area.bottom())
+			break;
+
+		if (!itemRect(view, idx, snapshot->DayWidth, opt.itemRect)
+			|| opt.itemRect.right() < area.left() || opt.itemRect.left() > area.right())
+			continue;
+
+		const KDGantt::ItemType typ = static_cast<KDGantt::ItemType>(model->data(idx, KDGantt::ItemTypeRole).toInt());
+		const QVariant position = model->data(idx, KDGantt::TextPositionRole);
+		opt.displayPosition = position.isValid()
+			? static_cast<KDGantt::StyleOptionGanttItem::Position>(position.toInt())
+			: KDGantt::StyleOptionGanttItem::Right;
+		const KDGantt::Span bs = delegate->itemBoundingSpan(opt, idx);
+
+		RoadmapPaintItem item;
+		item.Type = typ;
+		item.ItemRect = opt.itemRect;
+		item.BoundingRect = QRectF(bs.start(), opt.itemRect.top(), bs.length(), opt.itemRect.height());
+		item.Text = detachedString(model->data(idx, Qt::DisplayRole).toString()); // Lo snapshot sopravvive a Roadmap::unmap()
+		item.Color = model->data(idx, Qt::BackgroundRole).value<QColor>();
+		item.Selected = view->selectionModel() != nullptr && view->selectionModel()->isSelected(idx);
+
+		// Milestone del progetto per l'involucro, dalla cache del delegate come in RoadmapItemDelegate::paintGanttItem
+		if (typ == KDGantt::TypeSummary && roadmapDelegate != nullptr)
+			item.Milestones = roadmapDelegate->milestoneOffsets(idx, snapshot->DayWidth);
+
+		snapshot->MaxHeight = qMax(snapshot->MaxHeight, opt.itemRect.height());
+		rects.insert(sourcePointer(idx), item.ItemRect);
+		snapshot->Items.append(item);
+	}
+
+	std::sort(snapshot->Items.begin(), snapshot->Items.end(), [](const RoadmapPaintItem& a, const RoadmapPaintItem& b) {
+		return a.ItemRect.top() < b.ItemRect.top();
+	});
+
+	/*
+	 * Le frecce partono dalla fine dell'item di partenza e arrivano all'inizio
+	 * di quello di arrivo, a metà altezza, come i connettori di KDGantt.
+	 * Servono solo quelle con almeno un estremo nell'area, l'altro estremo se è fuori
+	 * viene calcolato a parte (solo la geometria, niente dati per il disegno).
+	 * Le frecce con entrambi gli estremi fuori dall'area non ci sono: il margine
+	 * intorno al viewport copre i link tra righe vicine
+	 */
+	if (view->constraintModel() != nullptr) {
+		QHash<void*, QRectF> outside; // Estremi fuori dall'area già calcolati, rettangolo nullo se senza item
+		auto endpoint = [&](const QModelIndex& idx, QRectF& rect) {
+			void* pointer = sourcePointer(idx);
+			auto it = rects.constFind(pointer);
+			if (it != rects.constEnd()) {
+				rect = *it;
+				return true;
+			}
+
+			it = outside.constFind(pointer);
+			if (it == outside.constEnd())
+				it = outside.insert(pointer, itemRect(view, idx, snapshot->DayWidth, rect) ? rect : QRectF());
+			rect = *it;
+			return !rect.isNull();
+		};
+
+		const QList<KDGantt::Constraint> constraints = view->constraintModel()->constraints();
+		for (const KDGantt::Constraint& c : constraints) {
+			if (!rects.contains(sourcePointer(c.startIndex())) && !rects.contains(sourcePointer(c.endIndex())))
+				continue;
+
+			QRectF from, to;
+			if (!endpoint(c.startIndex(), from) || !endpoint(c.endIndex(), to))
+				continue;
+
+			snapshot->Routes.append(qMakePair(QPointF(from.right(), from.center().y()), QPointF(to.left(), to.center().y())));
+		}
+	}
+
+	return snapshot;
+}
+
+QSharedPointer<const RoadmapSnapshot> RoadmapSnapshot::scaled(const RoadmapSnapshot& from, qreal scale)
+{
+	QSharedPointer<RoadmapSnapshot> snapshot(new RoadmapSnapshot(from));
+	snapshot->DayWidth = from.DayWidth * scale;
+	snapshot->Area = QRectF(from.Area.left() * scale, from.Area.top(), from.Area.width() * scale, from.Area.height());
+
+	for (RoadmapPaintItem& item : snapshot->Items)
+	{
+        // Lo spazio del testo a sinistra e a destra dell'item non dipende dallo zoom
+		const qreal before = item.ItemRect.left() - item.BoundingRect.left();
+		const qreal after = item.BoundingRect.right() - item.ItemRect.right();
+
+		item.ItemRect = QRectF(item.ItemRect.left() * scale, item.ItemRect.top(), item.ItemRect.width() * scale, item.ItemRect.height());
+		item.BoundingRect = QRectF(item.ItemRect.left() - before, item.BoundingRect.top(),
+			item.ItemRect.width() + before + after, item.BoundingRect.height());
+
+		for (qreal& x : item.Milestones)
+			x *= scale;
+	}
+
+	for (QPair<QPointF, QPointF>& route : snapshot->Routes) {
+		route.first.rx() *= scale;
+		route.second.rx() *= scale;
+	}
+
+	return snapshot;
+}
+
+RoadmapRenderer::RoadmapRenderer(const RoadmapItemDelegate* delegate) : m_delegate(delegate)
+{
+}
+
+RoadmapRenderer::~RoadmapRenderer()
+{
+	// I job leggono lo snapshot e il delegate, li aspetto prima di andarmene
+	for (QFutureWatcher<QImage>* job : m_jobs) {
+		job->waitForFinished();
+		delete job;
+	}
+}
+
+void RoadmapRenderer::setSnapshot(QSharedPointer<const RoadmapSnapshot> snapshot)
+{
+	// Con uno zoom diverso le tile vecchie non sono più allineate alla chart
+	if (m_snapshot.isNull() || snapshot.isNull() || !qFuzzyCompare(m_snapshot->DayWidth, snapshot->DayWidth))
+		clear();
+
+	m_snapshot = snapshot;
+	m_generation++;
+}
+
+QSharedPointer<const RoadmapSnapshot> RoadmapRenderer::snapshot() const
+{
+	return m_snapshot;
+}
+
+void RoadmapRenderer::setReady(std::function<void(const QRectF&)> callback)
+{
+	m_ready = callback;
+}
+
+void RoadmapRenderer::clear()
+{
+	m_tiles.clear();
+	m_epoch++;
+}
+
+quint64 RoadmapRenderer::tileKey(int x, int y)
+{
+	return (quint64(quint32(x)) << 32) | quint32(y);
+}
+
+QRect RoadmapRenderer::tileRange(const QRectF& exposed)
+{
+	return QRect(QPoint(qFloor(exposed.left() / TILESIZE), qFloor(exposed.top() / TILESIZE)),
+		QPoint(qFloor(exposed.right() / TILESIZE), qFloor(exposed.bottom() / TILESIZE)));
+}
+
+void RoadmapRenderer::prepare(const QRectF& exposed, qreal dpr)
+{
+	if (m_snapshot.isNull() || exposed.isEmpty())
+		return;
+
+	if (!qFuzzyCompare(dpr, m_dpr)) {
+		clear();
+		m_dpr = dpr;
+	}
+
+	const QRect range = tileRange(exposed);
+	for (int y = range.top(); y <= range.bottom(); y++) {
+		for (int x = range.left(); x <= range.right(); x++) {
+			auto it = m_tiles.constFind(tileKey(x, y));
+			if (it == m_tiles.constEnd() || (it->Generation != m_generation && !it->Pending))
+				schedule(x, y);
+		}
+	}
+}
+
+bool RoadmapRenderer::isReady(const QRectF& exposed, qreal dpr) const
+{
+	if (m_snapshot.isNull() || !qFuzzyCompare(dpr, m_dpr))
+		return false;
+
+	const QRect range = tileRange(exposed);
+	for (int y = range.top(); y <= range.bottom(); y++) {
+		for (int x = range.left(); x <= range.right(); x++) {
+			auto it = m_tiles.constFind(tileKey(x, y));
+			if (it == m_tiles.constEnd() || it->Image.isNull() || it->Generation != m_generation)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void RoadmapRenderer::paint(QPainter* painter, const QRectF& exposed, qreal dpr)
+{
+	if (m_snapshot.isNull() || exposed.isEmpty())
+		return;
+
+	/*
+	 * Chiedo il ridisegno delle tile che mancano o che non sono dell'ultimo snapshot
+	 * e copio quello che c'è, anche se vecchio
+	 */
+	prepare(exposed, dpr);
+
+	const QRect range = tileRange(exposed);
+	QSet<quint64> visible;
+	for (int y = range.top(); y <= range.bottom(); y++) {
+		for (int x = range.left(); x <= range.right(); x++) {
+			const quint64 key = tileKey(x, y);
+			visible.insert(key);
+
+			auto it = m_tiles.constFind(key);
+			if (it != m_tiles.constEnd() && !it->Image.isNull())
+				painter->drawImage(QPointF(x * TILESIZE, y * TILESIZE), it->Image);
+		}
+	}
+
+    // Tengo la cache limitata scartando le tile fuori dall'area esposta
+	if (m_tiles.count() > MAXTILES) {
+		for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+			if (!it->Pending && !visible.contains(it.key()))
+				it = m_tiles.erase(it);
+			else
+				++it;
+		}
+	}
+}
+
+void RoadmapRenderer::schedule(int x, int y)
+{
+	const quint64 key = tileKey(x, y);
+	const quint64 generation = m_generation;
+	const quint64 epoch = m_epoch;
+	const QRectF area(x * TILESIZE, y * TILESIZE, TILESIZE, TILESIZE);
+
+	m_tiles[key].Pending = true;
+
+	auto job = new QFutureWatcher<QImage>();
+	m_jobs.append(job);
+
+	QObject::connect(job, &QFutureWatcher<QImage>::finished, job, [=]() {
+		m_jobs.removeOne(job);
+		job->deleteLater();
+
+		if (epoch != m_epoch)
+			return; // Le tile sono state scartate mentre il job girava
+
+		auto it = m_tiles.find(key);
+		if (it == m_tiles.end())
+			return;
+
+		it->Pending = false;
+		if (generation >= it->Generation) {
+			it->Image = job->result();
+			it->Generation = generation;
+		}
+
+		if (m_ready)
+			m_ready(area);
+	});
+
+	job->setFuture(QtConcurrent::run(&RoadmapRenderer::renderTile, m_snapshot, m_delegate, area, m_dpr));
+}
+
+QImage RoadmapRenderer::renderTile(QSharedPointer<const RoadmapSnapshot> snapshot, const RoadmapItemDelegate* delegate, const QRectF& area, qreal dpr)
+{
+	static thread_local RoadmapPaintCache cache; // La cache non è thread safe, una per thread
+
+	QImage image(qCeil(TILESIZE * dpr), qCeil(TILESIZE * dpr), QImage::Format_ARGB32_Premultiplied);
+	image.setDevicePixelRatio(dpr);
+	image.fill(Qt::transparent);
+
+	QPainter painter(&image);
+	painter.translate(-area.topLeft());
+	painter.setClipRect(area);
+	painter.setFont(snapshot->Font);
+
+	/*
+	 * Gli item sono ordinati per riga, parto dal primo che può toccare la tile
+	 * e mi fermo al primo che inizia sotto
+	 */
+	const qreal from = area.top() - snapshot->MaxHeight * 2. - 2.;
+	auto it = std::lower_bound(snapshot->Items.constBegin(), snapshot->Items.constEnd(), from, [](const RoadmapPaintItem& item, qreal y) {
+		return item.ItemRect.top() < y;
+	});
+
+	for (; it != snapshot->Items.constEnd() && it->ItemRect.top() <= area.bottom() + 2.; ++it) {
+        // Le parentesi dei progetti e i rombi delle milestone escono dall'item
+		const qreal h = it->ItemRect.height();
+		if (!it->BoundingRect.united(it->ItemRect).adjusted(-h / 2. - 2., -2., 2., h + 2.).intersects(area))
+			continue;
+
+		delegate->paintItem(&painter, cache, *it, snapshot->DayWidth, snapshot->GradientHeight);
+	}
+
+	for (const QPair<QPointF, QPointF>& route : snapshot->Routes) {
+		if (QRectF(route.first, route.second).normalized().adjusted(-RouteMargin, -RouteMargin, RouteMargin, RouteMargin).intersects(area))
+			delegate->paintRoute(&painter, cache, route.first, route.second);
+	}
+
+	return image;
+}
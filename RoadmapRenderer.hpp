@@ -0,0 +1,136 @@
+#pragma once
+/*
+ * Questo file contiene le definizioni di:
+ *
+ *  - RoadmapSnapshot
+ *      -> è una fotografia immutabile del Gantt in coordinate della chart:
+ *         per ogni riga visibile nell'area catturata (il viewport più un margine) la geometria
+ *         dell'item (calcolata con la grid e il row controller di KDGantt, come fa la scena)
+ *         e i dati per disegnarlo, più gli estremi delle frecce dei link che toccano quelle righe.
+ *         Il costo di una cattura dipende dalle righe intorno al viewport, non dal file.
+ *         Viene catturata sul thread della GUI e poi letta dai thread di lavoro senza
+ *         toccare modello, scena o view.
+ *
+ *  - RoadmapRenderer
+ *      -> disegna il Gantt a tile di TILESIZE pixel in QImage sui thread del pool di QtConcurrent,
+ *         a partire dall'ultimo snapshot. La GUI si limita a copiare le tile pronte:
+ *         finché una tile aggiornata non arriva viene mostrata quella vecchia (double buffering),
+ *         così un repaint pesante non blocca mai l'input.
+ *         Ogni thread di lavoro usa la propria RoadmapPaintCache.
+ */
+#include <QHash>
+#include <QImage>
+#include <QFont>
+#include <QVector>
+#include <QPair>
+#include <QSharedPointer>
+#include <QFutureWatcher>
+#include <functional>
+#include "RoadmapItemDelegate.hpp"
+
+namespace KDGantt {
+    class GraphicsView;
+}
+
+struct RoadmapSnapshot
+{
+    QVector<RoadmapPaintItem> Items; // Item ordinati per ItemRect.top()
+    QVector<QPair<QPointF, QPointF>> Routes; // Estremi delle frecce dei link
+    QRectF Area; // Area della chart catturata, fuori non ci sono item
+    qreal DayWidth = 0.; // Zoom della grid al momento della cattura
+    int GradientHeight = 0; // Altezza dei gradienti
+    qreal MaxHeight = 0.; // Altezza massima di un item, per la ricerca per righe
+    QFont Font; // Font della scena
+
+    /*
+     * Cattura lo stato attuale della view nell'area indicata (coordinate della chart),
+     * va chiamata dal thread della GUI
+     */
+    static QSharedPointer<const RoadmapSnapshot> capture(KDGantt::GraphicsView* view, const QRectF& area);
+
+    /*
+     * Lo stesso snapshot con il dayWidth moltiplicato per scale, senza passare dal layout di KDGantt:
+     * la grid è lineare, quindi le x della chart si moltiplicano per scale, mentre le righe
+     * e lo spazio dei testi restano quelli di partenza. È un'approssimazione dello snapshot
+     * che verrà catturato dopo lo zoom vero, serve per l'anteprima dello zoom continuo
+     */
+    static QSharedPointer<const RoadmapSnapshot> scaled(const RoadmapSnapshot& from, qreal scale);
+};
+
+class RoadmapRenderer
+{
+    /*
+     * Una tile in cache, Generation è lo snapshot da cui è stata disegnata
+     */
+    struct Tile
+    {
+        QImage Image;
+        quint64 Generation = 0;
+        bool Pending = false; // C'è un job in corso per questa tile
+    };
+
+    const RoadmapItemDelegate* m_delegate; // Routine di disegno condivise con la scena
+    QSharedPointer<const RoadmapSnapshot> m_snapshot; // Ultimo snapshot
+    quint64 m_generation = 0; // Generazione dell'ultimo snapshot
+    quint64 m_epoch = 0; // Incrementato quando le tile vengono scartate, i job di epoche precedenti vengono ignorati
+    qreal m_dpr = 1.; // Device pixel ratio delle tile
+    QHash<quint64, Tile> m_tiles; // Tile per coordinate (x, y) impacchettate
+    QList<QFutureWatcher<QImage>*> m_jobs; // Job in corso
+    std::function<void(const QRectF&)> m_ready; // Chiamata quando una tile è pronta, con l'area in coordinate della chart
+
+public:
+    enum
+    {
+        TILESIZE = 256, // Lato di una tile in pixel
+        MAXTILES = 512 // Tile massime in cache
+    };
+
+    explicit RoadmapRenderer(const RoadmapItemDelegate* delegate);
+    ~RoadmapRenderer();
+
+    RoadmapRenderer(const RoadmapRenderer&) = delete;
+    RoadmapRenderer& operator=(const RoadmapRenderer&) = delete;
+
+    /*
+     * Imposta un nuovo snapshot, le tile esistenti diventano vecchie e vengono ridisegnate
+     * quando servono, se lo zoom è cambiato vengono scartate perché non più allineate
+     */
+    void setSnapshot(QSharedPointer<const RoadmapSnapshot> snapshot);
+    QSharedPointer<const RoadmapSnapshot> snapshot() const;
+
+    /*
+     * Disegna le tile che coprono exposed (coordinate della chart) e accoda
+     * il disegno di quelle mancanti o vecchie
+     */
+    void paint(QPainter* painter, const QRectF& exposed, qreal dpr);
+
+    /*
+     * Accoda il disegno delle tile mancanti o vecchie che coprono exposed, senza disegnare
+     */
+    void prepare(const QRectF& exposed, qreal dpr);
+
+    /*
+     * Indica se tutte le tile che coprono exposed sono pronte e disegnate dall'ultimo snapshot
+     */
+    bool isReady(const QRectF& exposed, qreal dpr) const;
+
+    /*
+     * Callback per le tile pronte, la view ridisegna l'area indicata
+     */
+    void setReady(std::function<void(const QRectF&)> callback);
+
+    /*
+     * Scarta tutte le tile
+     */
+    void clear();
+
+private:
+    static quint64 tileKey(int x, int y);
+    static QRect tileRange(const QRectF& exposed); // Tile (estremi inclusi) che coprono un'area
+    void schedule(int x, int y);
+
+    /*
+     * Disegna una tile, viene eseguita sui thread di lavoro
+     */
+    static QImage renderTile(QSharedPointer<const RoadmapSnapshot> snapshot, const RoadmapItemDelegate* delegate, const QRectF& area, qreal dpr);
+};
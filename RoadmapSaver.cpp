@@ -0,0 +1,178 @@
+#include "RoadmapSaver.hpp"
+#include "RoadmapFormat.hpp"
+#include "Roadmap.hpp"
+#include <QSaveFile>
+#include <QDataStream>
+#include <QtConcurrent>
+#include <QSharedPointer>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define PollInterval 100 // ms tra due letture dell'avanzamento
+
+/*
+ * Un file mappato può essere sostituito con un rename solo su POSIX, dove la mappatura
+ * resta sul file vecchio. Su Windows il rename fallisce finché il file è mappato
+ */
+#ifdef Q_OS_WIN
+#define ReplaceMapped false
+#else
+#define ReplaceMapped true
+#endif
+
+/*
+ * Porta su disco quello che è stato scritto nel file, così il commit sul thread della GUI non aspetta il disco
+ */
+static bool sync(QSaveFile& file)
+{
+	if (!file.flush())
+		return false;
+
+#ifdef Q_OS_WIN
+	return _commit(file.handle()) == 0;
+#else
+	return fsync(file.handle()) == 0;
+#endif
+}
+
+RoadmapSaver::RoadmapSaver()
+{
+	m_poll.setInterval(PollInterval);
+	QObject::connect(&m_poll, &QTimer::timeout, [this]()
+	{
+		if (m_progress)
+			m_progress(m_percent.load());
+	});
+
+	QObject::connect(&m_job, &QFutureWatcher<bool>::finished, [this]()
+	{
+		finish();
+	});
+}
+
+RoadmapSaver::~RoadmapSaver()
+{
+	m_job.waitForFinished(); // Il thread di lavoro scrive in m_percent
+}
+
+void RoadmapSaver::setProgress(Progress progress)
+{
+	m_progress = progress;
+}
+
+void RoadmapSaver::setCompressed(bool compressed)
+{
+	m_compressed = compressed;
+}
+
+bool RoadmapSaver::isCompressed() const
+{
+	return m_compressed;
+}
+
+void RoadmapSaver::save(const QString& path, Roadmap& rmap, Finished finished)
+{
+	wait();
+
+    /*
+     * La fotografia: da qui in poi il thread di lavoro non ha più bisogno della Roadmap,
+     * legge solo i record del file mappato (che resta aperto fino a finish())
+     */
+	const bool replace = !ReplaceMapped && rmap.isMappedFrom(path); // Il file da sostituire è quello mappato
+	QSharedPointer<const RoadmapCapture> capture(new RoadmapCapture(RoadmapTables::capture(rmap)));
+
+    // Oltre i 2 GB il contenuto mappato non entra in un QByteArray: resta il rilascio sincrono
+	if (replace && capture->Mapped.isNull()) {
+		rmap.unmap();
+		capture.reset(new RoadmapCapture(RoadmapTables::capture(rmap)));
+	}
+
+	m_file.reset(new QSaveFile(path));
+	m_roadmap = replace && rmap.isMappedFrom(path) ? &rmap : nullptr;
+	m_copy.clear();
+
+	m_finished = finished;
+	m_running = true;
+	m_percent.store(0);
+	m_poll.start();
+
+	QSaveFile* file = m_file.data();
+	QAtomicInt* percent = &m_percent;
+	QByteArray* copy = m_roadmap != nullptr ? &m_copy : nullptr;
+	const bool compressed = m_compressed;
+	m_job.setFuture(QtConcurrent::run([=]() { return write(file, *capture, percent, compressed, copy); }));
+}
+
+bool RoadmapSaver::isRunning() const
+{
+	return m_running;
+}
+
+bool RoadmapSaver::wait()
+{
+	if (!m_running)
+		return true;
+
+	m_job.waitForFinished();
+	return finish();
+}
+
+bool RoadmapSaver::finish()
+{
+	if (!m_running)
+		return true; // Già chiuso da wait(), arriva il segnale in coda
+
+	m_running = false;
+	m_poll.stop();
+
+	bool saved = m_job.result();
+
+    // Su Windows il file mappato va rilasciato prima che il nuovo prenda il suo posto
+	if (saved && m_roadmap != nullptr) {
+		m_roadmap->detachMapping(m_copy);
+		saved = m_file->commit();
+	}
+
+	m_file.reset();
+	m_roadmap = nullptr;
+	m_copy = QByteArray();
+	Finished finished = m_finished;
+	m_finished = nullptr;
+
+	if (finished)
+		finished(saved);
+
+	return saved;
+}
+
+bool RoadmapSaver::write(QSaveFile* file, const RoadmapCapture& capture, QAtomicInt* percent, bool compressed, QByteArray* copy)
+{
+    // QSaveFile scrive in un file temporaneo e lo rinomina sulla destinazione solo in commit()
+	if (!file->open(QIODevice::WriteOnly))
+		return false;
+
+	const RoadmapTables tables = RoadmapTables::build(capture);
+
+	QDataStream stream(file);
+	stream << FormatMagicV2; // Come operator <<
+
+	const bool written = tables.write(stream, [=](qint64 done, qint64 total)
+	{
+		percent->store(total > 0 ? int(done * 100 / total) : 100);
+	}, compressed);
+
+	if (!written || stream.status() != QDataStream::Ok) {
+		file->cancelWriting();
+		return false;
+	}
+
+	if (copy == nullptr)
+		return file->commit();
+
+    // Il commit lo fa il thread della GUI dopo aver spostato la Roadmap sulla copia
+	*copy = QByteArray(capture.Mapped.constData(), capture.Mapped.size());
+	return sync(*file);
+}
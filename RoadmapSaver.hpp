@@ -0,0 +1,95 @@
+#pragma once
+/*
+ * Questo file contiene la definizione di RoadmapSaver
+ *
+ *  - RoadmapSaver
+ *      -> salva la Roadmap in background: sul thread della GUI ne fa una fotografia
+ *         (RoadmapTables::capture), poi un thread del pool costruisce le tabelle del formato v2
+ *         e le scrive in un QSaveFile che sostituisce il file di destinazione solo quando è completo.
+ *         La fotografia costa quanto i progetti e gli elementi caricati, con i nomi e i link
+ *         condivisi implicitamente: i progetti mai espansi restano nel file mappato e vengono
+ *         copiati dal thread di lavoro, senza caricarli né rilasciare la mappatura.
+ *         Mentre il salvataggio è in corso la Roadmap può essere modificata liberamente:
+ *         il thread di lavoro non la tocca mai, le modifiche finiranno nel prossimo salvataggio.
+ *         Il file scritto è identico a quello di operator <<, oppure compresso a blocchi
+ *         (setCompressed, Vedi RoadmapFormat).
+ *
+ *         Sostituire il file mappato: su POSIX il rename lascia valida la mappatura del file
+ *         vecchio, che ha gli stessi record, e i progetti continuano a caricarsi da lì.
+ *         Su Windows un file mappato non può essere sostituito: il thread di lavoro copia anche
+ *         il contenuto mappato in memoria e il commit avviene sul thread della GUI, dopo
+ *         Roadmap::detachMapping (un costo proporzionale ai nomi caricati, non al file).
+ */
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QString>
+#include <QByteArray>
+#include <QScopedPointer>
+#include <functional>
+
+class Roadmap;
+class QSaveFile;
+struct RoadmapCapture;
+
+class RoadmapSaver
+{
+public:
+    /*
+     * Chiamata sul thread della GUI a salvataggio terminato
+     */
+    typedef std::function<void(bool saved)> Finished;
+
+    /*
+     * Chiamata sul thread della GUI durante il salvataggio, con l'avanzamento in percentuale
+     */
+    typedef std::function<void(int percent)> Progress;
+
+private:
+    QFutureWatcher<bool> m_job; // Scrittura in corso sul pool
+    QAtomicInt m_percent; // Avanzamento scritto dal thread di lavoro
+    QTimer m_poll; // Legge l'avanzamento dal thread della GUI
+    Finished m_finished;
+    Progress m_progress;
+    bool m_running = false;
+    bool m_compressed = false; // Scrive le tabelle compresse
+    QScopedPointer<QSaveFile> m_file; // File in scrittura
+    Roadmap* m_roadmap = nullptr; // Roadmap da staccare dal file prima del commit, nullptr se non serve
+    QByteArray m_copy; // Copia del file mappato, scritta dal thread di lavoro (Vedi Roadmap::detachMapping)
+
+public:
+	RoadmapSaver();
+	~RoadmapSaver();
+
+	RoadmapSaver(const RoadmapSaver&) = delete;
+	RoadmapSaver& operator=(const RoadmapSaver&) = delete;
+
+	void setProgress(Progress progress);
+	void setCompressed(bool compressed);
+	bool isCompressed() const;
+
+    /*
+     * Fotografa la Roadmap e avvia la scrittura su path, se c'è già un salvataggio
+     * in corso aspetta che finisca. La Roadmap deve restare viva (e mappata) fino alla fine
+     * del salvataggio (wait): chi la distrugge deve prima aspettarlo
+     */
+	void save(const QString& path, Roadmap& rmap, Finished finished);
+
+	bool isRunning() const;
+
+    /*
+     * Aspetta la fine del salvataggio in corso (chiamando la callback),
+     * ritorna false se il salvataggio è fallito
+     */
+	bool wait();
+
+    /*
+     * Costruisce le tabelle dalla fotografia e le scrive nel file, chiamata dal thread di lavoro.
+     * Se copy non è nullptr copia anche il contenuto del file mappato e lascia il commit
+     * al chiamante, altrimenti fa il commit (e il file sostituisce la destinazione)
+     */
+	static bool write(QSaveFile* file, const RoadmapCapture& capture, QAtomicInt* percent, bool compressed, QByteArray* copy);
+
+private:
+	bool finish();
+};
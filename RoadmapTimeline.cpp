@@ -0,0 +1,267 @@
+#include "RoadmapTimeline.hpp"
+#include "Roadmap.hpp"
+
+#include <functional>
+
+RoadmapTimeline::RoadmapTimeline() : Root(nullptr), Count(0), Seed(2463534242u)
+{
+}
+
+RoadmapTimeline::~RoadmapTimeline()
+{
+    clear(); // Libero tutti i nodi dallo Heap
+}
+
+void RoadmapTimeline::insert(RoadmapProjectElement* element)
+{
+    // Un elemento senza data non occupa nessun intervallo
+    if (element == nullptr || !element->date().isValid())
+        return;
+
+    Node* node = new Node();
+    node->Start = startOf(element);
+    node->End = endOf(element);
+    node->MaxEnd = node->End;
+    node->Priority = nextPriority();
+    node->Element = element;
+    node->Left = nullptr;
+    node->Right = nullptr;
+
+    Root = insertNode(Root, node);
+    Count++;
+}
+
+bool RoadmapTimeline::remove(RoadmapProjectElement* element)
+{
+    if (element == nullptr || !element->date().isValid())
+        return false;
+
+    bool removed = false;
+    Root = removeNode(Root, startOf(element), element, removed);
+
+    if (removed)
+        Count--;
+
+    return removed;
+}
+
+void RoadmapTimeline::clear()
+{
+    destroy(Root);
+    Root = nullptr;
+    Count = 0;
+}
+
+int RoadmapTimeline::count() const
+{
+    return Count;
+}
+
+QList<RoadmapProjectElement*> RoadmapTimeline::overlapping(const QDate& from, const QDate& to) const
+{
+    QList<RoadmapProjectElement*> result;
+
+    if (!from.isValid() || !to.isValid() || to < from)
+        return result;
+
+    collect(Root, from.toJulianDay(), to.toJulianDay(), result);
+    return result;
+}
+
+QList<RoadmapProjectElement*> RoadmapTimeline::at(const QDate& date) const
+{
+    return overlapping(date, date); // Una stabbing query è un intervallo di un giorno
+}
+
+QDate RoadmapTimeline::firstDate() const
+{
+    if (Root == nullptr)
+        return QDate();
+
+    // Il nodo più a sinistra è quello con la data di partenza più piccola
+    const Node* node = Root;
+    while (node->Left != nullptr)
+        node = node->Left;
+
+    return QDate::fromJulianDay(node->Start);
+}
+
+QDate RoadmapTimeline::lastDate() const
+{
+    if (Root == nullptr)
+        return QDate();
+
+    // La radice conosce la fine più grande di tutto l'albero
+    return QDate::fromJulianDay(Root->MaxEnd);
+}
+
+qint64 RoadmapTimeline::startOf(const RoadmapProjectElement* element)
+{
+    return element->date().toJulianDay();
+}
+
+qint64 RoadmapTimeline::endOf(const RoadmapProjectElement* element)
+{
+    // Solo i task hanno una durata, le milestone occupano un solo giorno
+    if (element->type() == PROJECT_TASK)
+        return static_cast<const RoadmapTask*>(element)->endDate().toJulianDay();
+
+    return startOf(element);
+}
+
+quint32 RoadmapTimeline::nextPriority()
+{
+    // Xorshift32, non serve un generatore migliore per bilanciare un treap
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    return Seed;
+}
+
+bool RoadmapTimeline::keyLess(qint64 start, const RoadmapProjectElement* element, const Node* node)
+{
+    /*
+     * La chiave è la coppia (Start, puntatore all'elemento),
+     * il puntatore rende la chiave univoca anche con date uguali
+     */
+    if (start != node->Start)
+        return start < node->Start;
+
+    return std::less<const RoadmapProjectElement*>()(element, node->Element);
+}
+
+void RoadmapTimeline::update(Node* node)
+{
+    node->MaxEnd = node->End;
+
+    if (node->Left != nullptr && node->Left->MaxEnd > node->MaxEnd)
+        node->MaxEnd = node->Left->MaxEnd;
+
+    if (node->Right != nullptr && node->Right->MaxEnd > node->MaxEnd)
+        node->MaxEnd = node->Right->MaxEnd;
+}
+
+RoadmapTimeline::Node* RoadmapTimeline::rotateLeft(Node* node)
+{
+    Node* right = node->Right;
+    node->Right = right->Left;
+    right->Left = node;
+    update(node); // Prima il nodo sceso, poi quello salito
+    update(right);
+    return right;
+}
+
+RoadmapTimeline::Node* RoadmapTimeline::rotateRight(Node* node)
+{
+    Node* left = node->Left;
+    node->Left = left->Right;
+    left->Right = node;
+    update(node);
+    update(left);
+    return left;
+}
+
+RoadmapTimeline::Node* RoadmapTimeline::insertNode(Node* root, Node* node)
+{
+    if (root == nullptr)
+        return node;
+
+    /*
+     * Inserimento come in un normale albero di ricerca,
+     * poi risalgo con le rotazioni finché la priorità del nuovo nodo
+     * non rispetta l'ordinamento a heap
+     */
+    if (keyLess(node->Start, node->Element, root))
+    {
+        root->Left = insertNode(root->Left, node);
+        if (root->Left->Priority > root->Priority)
+            return rotateRight(root);
+    }
+    else
+    {
+        root->Right = insertNode(root->Right, node);
+        if (root->Right->Priority > root->Priority)
+            return rotateLeft(root);
+    }
+
+    update(root);
+    return root;
+}
+
+RoadmapTimeline::Node* RoadmapTimeline::removeNode(Node* root, qint64 start, const RoadmapProjectElement* element, bool& removed)
+{
+    if (root == nullptr)
+        return nullptr; // Non trovato
+
+    if (root->Start == start && root->Element == element)
+    {
+        // Trovato, lo sostituisco con la fusione dei suoi due sotto alberi
+        Node* merged = merge(root->Left, root->Right);
+        delete root;
+        removed = true;
+        return merged;
+    }
+
+    if (keyLess(start, element, root))
+        root->Left = removeNode(root->Left, start, element, removed);
+    else
+        root->Right = removeNode(root->Right, start, element, removed);
+
+    update(root);
+    return root;
+}
+
+RoadmapTimeline::Node* RoadmapTimeline::merge(Node* left, Node* right)
+{
+    /*
+     * Tutte le chiavi di left sono minori di quelle di right,
+     * sale come radice il nodo con priorità più alta
+     */
+    if (left == nullptr)
+        return right;
+
+    if (right == nullptr)
+        return left;
+
+    if (left->Priority > right->Priority)
+    {
+        left->Right = merge(left->Right, right);
+        update(left);
+        return left;
+    }
+
+    right->Left = merge(left, right->Left);
+    update(right);
+    return right;
+}
+
+void RoadmapTimeline::collect(const Node* node, qint64 from, qint64 to, QList<RoadmapProjectElement*>& out)
+{
+    /*
+     * Se nessun elemento del sotto albero finisce dopo from
+     * posso scartare l'intero ramo
+     */
+    if (node == nullptr || node->MaxEnd < from)
+        return;
+
+    collect(node->Left, from, to, out);
+
+    // Il nodo e tutto il suo ramo destro iniziano dopo to
+    if (node->Start > to)
+        return;
+
+    if (node->End >= from)
+        out.append(node->Element);
+
+    collect(node->Right, from, to, out);
+}
+
+void RoadmapTimeline::destroy(Node* node)
+{
+    if (node == nullptr)
+        return;
+
+    destroy(node->Left);
+    destroy(node->Right);
+    delete node;
+}
@@ -0,0 +1,113 @@
+#pragma once
+/*
+ * Questo file contiene la definizione di RoadmapTimeline
+ *
+ *  - RoadmapTimeline
+ *      -> è l'indice temporale della Roadmap, un interval tree aumentato
+ *         sugli span dei project element:
+ *          - un Task occupa l'intervallo [date(), endDate()]
+ *          - una Milestone occupa il solo giorno date()
+ *         L'albero è un treap (albero binario di ricerca bilanciato in modo casuale)
+ *         ordinato per data di partenza, ogni nodo conosce inoltre la data di fine
+ *         più grande del proprio sotto albero, questo permette di scartare interi
+ *         rami durante le interrogazioni.
+ *         Inserimento e rimozione costano O(log N), una interrogazione O(log N + K)
+ *         dove K è il numero di elementi trovati.
+ *
+ * L'indice è posseduto dalla Roadmap e viene mantenuto dai project element stessi:
+ * setDate() e setDays() tolgono l'elemento con lo span vecchio e lo reinseriscono con quello nuovo.
+ * Gli elementi con una data non valida non vengono indicizzati.
+ */
+#include <QList>
+#include <QDate>
+
+class RoadmapProjectElement;
+
+class RoadmapTimeline
+{
+    /*
+     * Nodo del treap, le date sono memorizzate come Julian Day
+     */
+    struct Node
+    {
+        qint64 Start; // Inizio dello span (chiave di ordinamento)
+        qint64 End; // Fine dello span
+        qint64 MaxEnd; // Fine più grande del sotto albero (aumento dell'interval tree)
+        quint32 Priority; // Priorità casuale che mantiene l'albero bilanciato
+        RoadmapProjectElement* Element; // Elemento indicizzato (a parità di Start è la seconda chiave)
+        Node* Left;
+        Node* Right;
+    };
+
+    Node* Root; // Radice del treap
+    int Count; // Numero di elementi indicizzati
+    quint32 Seed; // Stato del generatore delle priorità
+
+public:
+    RoadmapTimeline();
+    ~RoadmapTimeline();
+
+    /*
+     * L'indice contiene puntatori agli elementi della Roadmap che lo possiede,
+     * non ha senso copiarlo
+     */
+    RoadmapTimeline(const RoadmapTimeline&) = delete;
+    RoadmapTimeline& operator=(const RoadmapTimeline&) = delete;
+
+    /*
+     * Indicizza l'elemento con il suo span attuale
+     */
+    void insert(RoadmapProjectElement* element);
+
+    /*
+     * Rimuove l'elemento, lo span attuale dell'elemento deve essere
+     * quello con cui è stato inserito, ritorna false se non era indicizzato
+     */
+    bool remove(RoadmapProjectElement* element);
+
+    /*
+     * Svuota l'indice
+     */
+    void clear();
+
+    /*
+     * Numero di elementi indicizzati
+     */
+    int count() const;
+
+    /*
+     * Elementi attivi tra from e to (estremi inclusi), ordinati per data di partenza
+     */
+    QList<RoadmapProjectElement*> overlapping(const QDate& from, const QDate& to) const;
+
+    /*
+     * Elementi attivi in un certo giorno (stabbing query)
+     */
+    QList<RoadmapProjectElement*> at(const QDate& date) const;
+
+    /*
+     * Primo giorno e ultimo giorno occupati da un elemento,
+     * QDate() se l'indice è vuoto
+     */
+    QDate firstDate() const;
+    QDate lastDate() const;
+
+    /*
+     * Calcolano lo span di un elemento come Julian Day
+     */
+    static qint64 startOf(const RoadmapProjectElement* element);
+    static qint64 endOf(const RoadmapProjectElement* element);
+
+private:
+    quint32 nextPriority();
+
+    static bool keyLess(qint64 start, const RoadmapProjectElement* element, const Node* node);
+    static void update(Node* node);
+    static Node* rotateLeft(Node* node);
+    static Node* rotateRight(Node* node);
+    static Node* insertNode(Node* root, Node* node);
+    static Node* removeNode(Node* root, qint64 start, const RoadmapProjectElement* element, bool& removed);
+    static Node* merge(Node* left, Node* right);
+    static void collect(const Node* node, qint64 from, qint64 to, QList<RoadmapProjectElement*>& out);
+    static void destroy(Node* node);
+};
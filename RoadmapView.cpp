@@ -1,9 +1,319 @@
 ﻿#include "RoadmapView.hpp"
 #include <QGraphicsItem>
+#include <QGraphicsScene>
+#include <QScrollBar>
+#include <QWheelEvent>
+#include <QNativeGestureEvent>
+#include <QtMath>
 #include "RoadmapModel.hpp"
+#include "RoadmapGrid.hpp"
+#include "RoadmapItemDelegate.hpp"
+#include "RoadmapRenderer.hpp"
 
 RoadmapView::RoadmapView(QWidget * parent) : KDGantt::GraphicsView(parent) {
+    /*
+     * Sostituisco il NoIndex impostato da KDGantt con un BSP tree,
+     * lo spostamento degli item durante il layout costa un aggiornamento dell'indice O(log N)
+     * ma ogni repaint e ogni scroll interrogano solo gli item che intersecano l'area esposta
+     */
+	if (scene() != nullptr) {
+		scene()->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
+		scene()->setBspTreeDepth(0); // Profondità calcolata dalla scena in base al numero di item
+	}
+
+	m_zoomtimer.setSingleShot(true);
+	m_zoomtimer.setInterval(ZOOMSETTLE);
+	QObject::connect(&m_zoomtimer, &QTimer::timeout, this, [=]() { commitZoom(); });
+
+	m_refinetimer.setSingleShot(true);
+	m_refinetimer.setInterval(ZOOMREFINE);
+	QObject::connect(&m_refinetimer, &QTimer::timeout, this, [=]() { refineZoom(); });
+
+	m_snapshottimer.setSingleShot(true);
+	m_snapshottimer.setInterval(30);
+	QObject::connect(&m_snapshottimer, &QTimer::timeout, this, [=]()
+	{
+		if (m_renderer == nullptr) return;
+
+		m_renderer->setSnapshot(RoadmapSnapshot::capture(this, captureArea()));
+		viewport()->update();
+	});
+}
+
+RoadmapView::~RoadmapView()
+{
+	setTiledRendering(false);
+	delete m_refine; // Creato dall'anteprima dello zoom anche senza tile
+}
+
+void RoadmapView::setTiledRendering(bool enabled)
+{
+	if (enabled == tiledRendering())
+		return;
+
+	RoadmapItemDelegate* delegate = dynamic_cast<RoadmapItemDelegate*>(itemDelegate());
+
+	if (!enabled) {
+		QObject::disconnect(m_scenechanged);
+		m_snapshottimer.stop();
+		m_refinetimer.stop();
+		delete m_renderer; // Aspetta i job in corso
+		m_renderer = nullptr;
+		delete m_refine;
+		m_refine = nullptr;
+		m_refined = false;
+
+		if (delegate != nullptr)
+			delegate->setWidgetPaintingSuppressed(false);
+
+		viewport()->update();
+		return;
+	}
+
+	if (delegate == nullptr || scene() == nullptr)
+		return; // Le tile usano le routine di disegno di RoadmapItemDelegate
+
+	m_renderer = new RoadmapRenderer(delegate);
+	if (m_refine == nullptr)
+		m_refine = new RoadmapRenderer(delegate);
+	m_refined = false; // Da qui gli item li disegnano le tile
+	connectRenderers();
+
+    // Qualsiasi cambiamento degli item (layout, modifiche, selezione, zoom) produce un nuovo snapshot
+	m_scenechanged = QObject::connect(scene(), &QGraphicsScene::changed, this, [=]() { m_snapshottimer.start(); });
+
+	delegate->setWidgetPaintingSuppressed(true);
+	m_renderer->setSnapshot(RoadmapSnapshot::capture(this, captureArea()));
+	viewport()->update();
+}
+
+bool RoadmapView::tiledRendering() const
+{
+	return m_renderer != nullptr;
+}
+
+void RoadmapView::drawForeground(QPainter* painter, const QRectF& rect)
+{
+	KDGantt::GraphicsView::drawForeground(painter, rect);
+
+	const qreal dpr = viewport()->devicePixelRatioF();
+	const QRectF visible = mapToScene(viewport()->rect()).boundingRect();
+
+    // Lo snapshot copre solo le righe intorno al viewport, quando lo scroll si avvicina al bordo ne catturo un altro
+	const QSharedPointer<const RoadmapSnapshot> current = m_renderer != nullptr ? m_renderer->snapshot() : QSharedPointer<const RoadmapSnapshot>();
+	if (!current.isNull() && !current->Area.contains(visible.adjusted(-visible.width() / 2., -visible.height() / 2., visible.width() / 2., visible.height() / 2.))
+		&& !m_snapshottimer.isActive())
+		m_snapshottimer.start();
+
+    /*
+     * Durante l'anteprima dello zoom le tile raffinate sono nelle coordinate della chart allo
+     * zoom di arrivo: tolgo la scala della trasformazione, così vengono copiate pixel per pixel.
+     * Finché non coprono tutta l'area resta il frame scalato, senza tile (m_refined) la scena
+     * non disegna più gli item e le tile vengono copiate comunque
+     */
+	if (!qFuzzyCompare(m_previewscale, 1.) && m_refine != nullptr && !m_refine->snapshot().isNull()) {
+		const QRectF target = previewRect(rect);
+
+        // Lo scroll durante l'anteprima può uscire dall'area raffinata
+		if (!m_refine->snapshot()->Area.contains(previewRect(visible)) && !m_refinetimer.isActive())
+			m_refinetimer.start();
+
+		if (m_refined || m_refine->isReady(target, dpr)) {
+			painter->save();
+			painter->scale(rect.width() / target.width(), 1.);
+			m_refine->paint(painter, target, dpr);
+			painter->restore();
+			return;
+		}
+
+		m_refine->prepare(target, dpr);
+	}
+
+	if (m_renderer != nullptr)
+		m_renderer->paint(painter, rect, dpr);
+}
+
+QRectF RoadmapView::previewRect(const QRectF& rect) const
+{
+    // Le tile sono allo zoom dello snapshot raffinato, il gesto nel frattempo può essere andato oltre
+	RoadmapGrid* rgrid = roadmapGrid();
+	const qreal scale = m_refine != nullptr && !m_refine->snapshot().isNull() && rgrid != nullptr
+		? m_refine->snapshot()->DayWidth / rgrid->dayWidth() : m_previewscale;
+
+	return QRectF(rect.left() * scale, rect.top(), rect.width() * scale, rect.height());
+}
+
+void RoadmapView::connectRenderers()
+{
+	if (m_renderer != nullptr) {
+		m_renderer->setReady([=](const QRectF& area)
+		{
+			viewport()->update(mapFromScene(area).boundingRect().adjusted(-1, -1, 1, 1));
+		});
+	}
+
+    // Le tile dell'anteprima sono in coordinate diverse dalla scena, le mostro tutte insieme
+	m_refine->setReady([=](const QRectF&)
+	{
+        /*
+         * Senza tile la scena disegna gli item stirati dalla trasformazione:
+         * quando le tile raffinate coprono tutto il viewport prendono il loro posto fino al layout
+         */
+		if (m_renderer == nullptr && !m_refined && !qFuzzyCompare(m_previewscale, 1.)
+			&& m_refine->isReady(previewRect(mapToScene(viewport()->rect()).boundingRect()), viewport()->devicePixelRatioF())) {
+			if (auto delegate = dynamic_cast<RoadmapItemDelegate*>(itemDelegate()))
+				delegate->setWidgetPaintingSuppressed(true);
+			m_refined = true;
+		}
+
+		viewport()->update();
+	});
+}
+
+void RoadmapView::refineZoom()
+{
+	if (qFuzzyCompare(m_previewscale, 1.))
+		return;
+
+	RoadmapItemDelegate* delegate = dynamic_cast<RoadmapItemDelegate*>(itemDelegate());
+	if (delegate == nullptr)
+		return; // Le tile usano le routine di disegno di RoadmapItemDelegate
+
+    // Senza rendering a tile il renderer dell'anteprima nasce alla prima pausa di un gesto
+	if (m_refine == nullptr) {
+		m_refine = new RoadmapRenderer(delegate);
+		connectRenderers();
+	}
+
+    /*
+     * Parto dallo snapshot del renderer principale se c'è, altrimenti (o se rimpicciolendo
+     * il viewport scopre parti della chart che non ha) catturo le righe intorno al viewport
+     */
+	QSharedPointer<const RoadmapSnapshot> from = m_renderer != nullptr ? m_renderer->snapshot() : QSharedPointer<const RoadmapSnapshot>();
+	if (from.isNull() || !from->Area.contains(mapToScene(viewport()->rect()).boundingRect()))
+		from = RoadmapSnapshot::capture(this, captureArea());
+
+	m_refine->setSnapshot(RoadmapSnapshot::scaled(*from, m_previewscale));
+	viewport()->update();
+}
+
+void RoadmapView::setZoomChanged(std::function<void()> callback)
+{
+	m_zoomchanged = callback;
+}
+
+void RoadmapView::wheelEvent(QWheelEvent* event)
+{
+    // Senza Ctrl la rotella continua a scorrere il Gantt
+	if (!(event->modifiers() & Qt::ControlModifier) || roadmapGrid() == nullptr) {
+		KDGantt::GraphicsView::wheelEvent(event);
+		return;
+	}
+
+    // Uno scatto della rotella (120) vale circa il 20%, i trackpad mandano delta più piccoli
+	previewZoom(qPow(1.0015, event->angleDelta().y()), event->pos());
+	event->accept();
+}
+
+bool RoadmapView::viewportEvent(QEvent* event)
+{
+	if (event->type() == QEvent::NativeGesture && roadmapGrid() != nullptr) {
+		auto gesture = static_cast<QNativeGestureEvent*>(event);
+		if (gesture->gestureType() == Qt::ZoomNativeGesture) {
+			previewZoom(1. + gesture->value(), viewport()->mapFromGlobal(gesture->globalPos()));
+			return true;
+		}
+	}
+
+	return KDGantt::GraphicsView::viewportEvent(event);
+}
+
+QRectF RoadmapView::captureArea() const
+{
+    // Un viewport in più per lato: lo scroll e i link tra righe vicine restano dentro lo snapshot
+	const QRectF visible = mapToScene(viewport()->rect()).boundingRect();
+	return visible.adjusted(-visible.width(), -visible.height(), visible.width(), visible.height());
+}
+
+RoadmapGrid* RoadmapView::roadmapGrid() const
+{
+	return dynamic_cast<RoadmapGrid*>(grid());
+}
+
+void RoadmapView::previewZoom(qreal factor, const QPoint& pos)
+{
+	RoadmapGrid* rgrid = roadmapGrid();
+	const qreal dayWidth = rgrid->dayWidth();
+
+    // L'anteprima non deve andare oltre i limiti che la grid applicherà
+	const qreal scale = qBound(RoadmapGrid::minimumDayWidth() / dayWidth,
+		m_previewscale * factor,
+		RoadmapGrid::maximumDayWidth() / dayWidth);
+
+	if (qFuzzyCompare(scale, m_previewscale))
+		return;
+
+	const QPointF anchor = mapToScene(pos); // Punto della scena sotto al mouse prima di scalare
+
+	m_previewscale = scale;
+	m_zoomanchor = pos;
+	setTransform(QTransform::fromScale(scale, 1.));
+
+    // Riporto il punto sotto al mouse
+	const QPoint moved = mapFromScene(anchor);
+	horizontalScrollBar()->setValue(horizontalScrollBar()->value() + moved.x() - pos.x());
+
+    /*
+     * Ripartono ad ogni evento: l'anteprima si raffina alle pause, lo zoom vero arriva a gesto fermo.
+     * Senza il delegate della Roadmap non c'è raffinamento e il layout arriva prima
+     */
+	const bool refine = dynamic_cast<RoadmapItemDelegate*>(itemDelegate()) != nullptr;
+	if (refine)
+		m_refinetimer.start();
+	m_zoomtimer.start(refine ? ZOOMCOMMIT : ZOOMSETTLE);
+}
+
+void RoadmapView::commitZoom()
+{
+    // Senza tile la scena torna a disegnare gli item, il prossimo frame è già allo zoom di arrivo
+	if (m_refined) {
+		if (auto delegate = dynamic_cast<RoadmapItemDelegate*>(itemDelegate()))
+			delegate->setWidgetPaintingSuppressed(false);
+		m_refined = false;
+	}
+
+	RoadmapGrid* rgrid = roadmapGrid();
+	if (rgrid == nullptr || qFuzzyCompare(m_previewscale, 1.)) {
+		m_previewscale = 1.;
+		resetTransform();
+		return;
+	}
+
+    // Data sotto il mouse calcolata con la scala dell'anteprima
+	const QDateTime anchor = rgrid->mapToDateTime(mapToScene(m_zoomanchor).x());
+	const qreal dayWidth = rgrid->dayWidth() * m_previewscale;
+
+	m_previewscale = 1.;
+	m_refinetimer.stop();
+	resetTransform();
+	rgrid->zoomTo(dayWidth); // Un solo layout di KDGantt per tutto il gesto, sincrono
+
+    /*
+     * La scena adesso è allo zoom di arrivo, le tile raffinate sono già allineate:
+     * diventano quelle del renderer principale finché lo snapshot esatto non le sostituisce
+     */
+	if (m_renderer != nullptr && !m_refine->snapshot().isNull() && qFuzzyCompare(m_refine->snapshot()->DayWidth, rgrid->dayWidth())) {
+		std::swap(m_renderer, m_refine);
+		connectRenderers();
+	}
+	if (m_refine != nullptr)
+		m_refine->setSnapshot(QSharedPointer<const RoadmapSnapshot>());
+
+	const QPoint moved = mapFromScene(QPointF(rgrid->mapFromDateTime(anchor), 0.));
+	horizontalScrollBar()->setValue(horizontalScrollBar()->value() + moved.x() - m_zoomanchor.x());
 
+	if (m_zoomchanged)
+		m_zoomchanged();
 }
 
 void RoadmapView::addConstraint(const QModelIndex& from, const QModelIndex& to, Qt::KeyboardModifiers modifiers)
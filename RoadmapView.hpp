@@ -1,16 +1,118 @@
 ﻿#pragma once
 #include <QGraphicsView>
 #include <QAbstractItemView>
+#include <QTimer>
+#include <functional>
 #include <kdganttgraphicsview.h>
 
+class RoadmapGrid;
+class RoadmapRenderer;
+
 /*
  * Overrido la GraphicsView di KDGantt per forzare le constraint solo tra gli elementi dei progetti
+ *
+ * La view attiva inoltre l'indice spaziale (BSP tree) della scena:
+ * KDGantt crea la scena senza indice, quindi ad ogni repaint la scena scorre tutti gli item
+ * per capire quali toccano l'area esposta. Con il BSP tree la scena interroga un indice
+ * tempo x riga e il costo di un frame dipende solo dagli item visibili.
+ *
+ * Zoom continuo (Ctrl + rotella o pinch sul trackpad): cambiare il dayWidth costringe
+ * KDGantt a ricalcolare il layout di tutti gli item, farlo ad ogni scatto della rotella
+ * blocca l'input sui file grandi. Durante il gesto la view scala orizzontalmente
+ * l'ultimo frame con una trasformazione (nessun layout, solo pittura), quando il gesto
+ * si ferma la scala accumulata diventa un unico zoomTo() sulla grid.
+ * La data sotto il mouse resta ferma sia durante l'anteprima che dopo il layout.
+ *
+ * L'anteprima viene raffinata in background: quando la rotella si ferma per ZOOMREFINE ms
+ * lo snapshot attuale (o, senza rendering a tile, uno catturato intorno al viewport) viene
+ * portato allo zoom di arrivo (RoadmapSnapshot::scaled, senza layout) e un secondo renderer
+ * ne disegna le tile sui thread di lavoro; appena coprono l'area esposta prendono il posto
+ * del frame scalato, senza tile la scena smette di disegnare gli item finché dura l'anteprima.
+ * Il layout di KDGantt resta sincrono sul thread della GUI, ma viene rimandato finché il gesto
+ * non è fermo per ZOOMCOMMIT ms (ZOOMSETTLE senza il delegate della Roadmap) e costa una volta
+ * per gesto, non una per scatto: su file grandi quel singolo layout blocca ancora l'input per un momento.
+ * Con le tile, dopo il layout le tile raffinate diventano quelle del renderer principale,
+ * che le sostituisce man mano con quelle dello snapshot esatto.
+ *
+ * Rendering a tile (opzionale): item e frecce non vengono più disegnati dalla scena
+ * sul thread della GUI ma da RoadmapRenderer sui thread di lavoro, a partire da uno
+ * snapshot catturato quando la scena cambia. La view copia solo le tile pronte.
+ * Lo snapshot copre solo le righe intorno al viewport, così ogni modifica costa
+ * quanto le righe visibili: quando lo scroll si avvicina al bordo dell'area ne viene
+ * catturato un altro.
  */
 class RoadmapView : public KDGantt::GraphicsView {
+	QTimer m_zoomtimer; // Attende la fine del gesto prima di applicare lo zoom alla grid
+	qreal m_previewscale = 1.; // Scala orizzontale dell'anteprima rispetto al dayWidth attuale
+	QPoint m_zoomanchor; // Posizione del mouse durante il gesto, nel viewport
+	std::function<void()> m_zoomchanged; // Callback chiamata dopo aver applicato lo zoom
+
+	RoadmapRenderer* m_renderer = nullptr; // Renderer a tile, nullptr se disattivato
+	RoadmapRenderer* m_refine = nullptr; // Tile dell'anteprima dello zoom allo zoom di arrivo, anche senza tile
+	bool m_refined = false; // Senza tile: le tile dell'anteprima hanno preso il posto degli item della scena
+	QTimer m_refinetimer; // Attende una pausa del gesto prima di raffinare l'anteprima
+	QTimer m_snapshottimer; // Raggruppa i cambiamenti della scena in un solo snapshot
+	QMetaObject::Connection m_scenechanged; // Aggancio ai cambiamenti della scena
 
 public:
+	static constexpr int ZOOMSETTLE = 150; // Attesa prima del layout quando l'anteprima non può essere raffinata
+	static constexpr int ZOOMREFINE = 60; // Pausa del gesto dopo cui l'anteprima viene raffinata
+	static constexpr int ZOOMCOMMIT = 600; // Attesa prima del layout con l'anteprima raffinata
+
 	explicit RoadmapView(QWidget* parent = nullptr);
+	~RoadmapView();
 
     // Override necessario
 	void addConstraint(const QModelIndex& from, const QModelIndex& to, Qt::KeyboardModifiers modifiers) override;
+
+    /*
+     * Callback chiamata quando lo zoom continuo cambia il dayWidth della grid,
+     * serve alla finestra per aggiornare lo stato dei bottoni di zoom
+     */
+	void setZoomChanged(std::function<void()> callback);
+
+    /*
+     * Attiva o disattiva il rendering a tile sui thread di lavoro
+     */
+	void setTiledRendering(bool enabled);
+	bool tiledRendering() const;
+
+protected:
+	void wheelEvent(QWheelEvent* event) override;
+	bool viewportEvent(QEvent* event) override;
+	void drawForeground(QPainter* painter, const QRectF& rect) override;
+
+private:
+	RoadmapGrid* roadmapGrid() const;
+
+    /*
+     * Area della chart catturata negli snapshot: il viewport più un margine
+     */
+	QRectF captureArea() const;
+
+    /*
+     * Un'area della scena durante l'anteprima nelle coordinate delle tile raffinate
+     * (la chart allo zoom dell'ultimo raffinamento)
+     */
+	QRectF previewRect(const QRectF& rect) const;
+
+    /*
+     * Moltiplica la scala dell'anteprima per factor tenendo fermo il punto pos
+     */
+	void previewZoom(qreal factor, const QPoint& pos);
+
+    /*
+     * Applica la scala dell'anteprima alla grid ed elimina la trasformazione
+     */
+	void commitZoom();
+
+    /*
+     * Porta lo snapshot allo zoom dell'anteprima e ne accoda le tile (Vedi RoadmapSnapshot::scaled)
+     */
+	void refineZoom();
+
+    /*
+     * Imposta le callback delle tile pronte dei due renderer
+     */
+	void connectRenderers();
 };
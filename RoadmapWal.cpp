@@ -0,0 +1,205 @@
+#include "RoadmapWal.hpp"
+#include "RoadmapJournal.hpp"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QCoreApplication>
+#include <QtConcurrent>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define WalFileName "session-%1.wal" // %1 = pid del processo
+#define WalFilePattern "session-*.wal"
+#define WalLockSuffix ".lock"
+
+/*
+ * Porta su disco quello che è stato scritto nel file
+ */
+static bool sync(QFile& file)
+{
+	if (!file.flush())
+		return false;
+
+#ifdef Q_OS_WIN
+	return _commit(file.handle()) == 0;
+#else
+	return fsync(file.handle()) == 0;
+#endif
+}
+
+RoadmapWalHeader RoadmapWalHeader::of(const QString& base)
+{
+	RoadmapWalHeader header;
+	header.Base = base;
+
+	if (!base.isEmpty()) {
+		const QFileInfo info(base);
+		header.BaseSize = info.exists() ? info.size() : -1;
+		header.BaseModified = info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+		header.JournalSize = QFileInfo(RoadmapJournal::pathOf(base)).size(); // 0 se non esiste
+	}
+
+	return header;
+}
+
+bool RoadmapWalHeader::matches() const
+{
+	const RoadmapWalHeader current = of(Base);
+	return current.BaseSize == BaseSize && current.BaseModified == BaseModified && current.JournalSize == JournalSize;
+}
+
+RoadmapWal::RoadmapWal(const QString& path) : m_path(path), m_lock(lockPathOf(path))
+{
+    // Nessuna scadenza: il lock di un processo vivo non diventa mai stale
+	m_lock.setStaleLockTime(0);
+	m_lock.tryLock(0);
+
+	m_pool.setMaxThreadCount(1);
+	m_writer = QtConcurrent::run(&m_pool, [this]() { run(); });
+}
+
+RoadmapWal::~RoadmapWal()
+{
+	{
+		QMutexLocker lock(&m_mutex);
+		m_stop = true;
+		m_wake.wakeOne();
+	}
+
+	m_writer.waitForFinished(); // Scrive quello che è ancora in coda
+	m_lock.unlock();
+}
+
+QString RoadmapWal::path() const
+{
+	return m_path;
+}
+
+QString RoadmapWal::defaultPath()
+{
+	const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+	QDir().mkpath(dir);
+	return QDir(dir).filePath(QString(WalFileName).arg(QCoreApplication::applicationPid()));
+}
+
+QStringList RoadmapWal::logs()
+{
+	const QDir dir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+
+	QStringList paths;
+	for (const QString& name : dir.entryList(QStringList() << WalFilePattern, QDir::Files))
+		paths.append(dir.filePath(name));
+	return paths;
+}
+
+QString RoadmapWal::lockPathOf(const QString& path)
+{
+	return path + WalLockSuffix;
+}
+
+void RoadmapWal::start(const RoadmapWalHeader& header, const QByteArray& records)
+{
+	QByteArray data;
+	QDataStream out(&data, QIODevice::WriteOnly);
+	out << WalMagic << header.Base << header.BaseSize << header.BaseModified << header.JournalSize;
+	data.append(records);
+
+	QMutexLocker lock(&m_mutex);
+	m_header = data;
+	m_queue.clear(); // Sono nel salvataggio o tra i record passati
+	m_reset = true;
+	m_wake.wakeOne();
+}
+
+void RoadmapWal::append(const QByteArray& record)
+{
+	QMutexLocker lock(&m_mutex);
+	m_queue.append(record);
+
+    // Se il thread sta raccogliendo un batch non lo sveglio, scriverà tutto insieme
+	if (m_idle)
+		m_wake.wakeOne();
+}
+
+void RoadmapWal::discard()
+{
+	QMutexLocker lock(&m_mutex);
+	m_queue.clear();
+	m_reset = false;
+	m_discard = true;
+	m_wake.wakeOne();
+}
+
+void RoadmapWal::run()
+{
+	QFile file(m_path);
+
+	QMutexLocker lock(&m_mutex);
+	while (true)
+	{
+		while (!m_stop && !m_reset && !m_discard && m_queue.isEmpty()) {
+			m_idle = true;
+			m_wake.wait(&m_mutex);
+		}
+		m_idle = false;
+
+		if (!m_reset && !m_discard && m_queue.isEmpty())
+			break; // Stop senza altro da scrivere
+
+		const bool discard = m_discard;
+		const bool reset = m_reset;
+		const QByteArray header = m_header;
+		const QByteArray batch = m_queue;
+		m_discard = false;
+		m_reset = false;
+		m_queue.clear();
+
+        // Il file si tocca fuori dal lock, la GUI può continuare ad accodare
+		lock.unlock();
+
+		if (discard) {
+			file.close();
+			file.remove();
+		}
+
+		if (reset) {
+			file.close();
+			if (file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+				file.write(header);
+		}
+
+		if (!batch.isEmpty() && file.isOpen())
+			file.write(batch);
+
+		if (file.isOpen())
+			sync(file);
+
+		lock.relock();
+
+        // Raccolgo le modifiche dei prossimi BATCHINTERVAL ms per un solo fsync (lo stop sveglia subito)
+		if (!m_stop)
+			m_wake.wait(&m_mutex, BATCHINTERVAL);
+	}
+}
+
+bool RoadmapWal::read(const QString& path, RoadmapWalHeader* header, QByteArray* records)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream in(&file);
+	QByteArray magic;
+	in >> magic >> header->Base >> header->BaseSize >> header->BaseModified >> header->JournalSize;
+	if (in.status() != QDataStream::Ok || qstrcmp(magic.constData(), WalMagic) != 0)
+		return false;
+
+	*records = file.readAll(); // Un eventuale record troncato viene scartato da RoadmapJournal::apply
+	return true;
+}
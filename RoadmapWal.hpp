@@ -0,0 +1,125 @@
+#pragma once
+/*
+ * Questo file contiene la definizione di RoadmapWal
+ *
+ *  - RoadmapWal
+ *      -> write-ahead log della sessione: ogni modifica registrata dal RoadmapJournal
+ *         (stesso formato dei record) viene accodata anche qui e scritta su disco da un
+ *         thread dedicato, che raccoglie le modifiche per BATCHINTERVAL ms e poi le scrive
+ *         con un solo fsync. Sul thread della GUI append() costa un lock e una copia.
+ *
+ *         Il log contiene le modifiche fatte dall'ultimo salvataggio: viene riscritto
+ *         (start) quando un documento viene aperto o salvato ed eliminato (discard) quando
+ *         il documento viene chiuso normalmente. Se al prossimo avvio il log esiste ancora
+ *         la sessione è terminata male e le modifiche possono essere riapplicate sull'ultimo
+ *         salvataggio, che l'intestazione identifica (file, dimensioni e date come il journal).
+ *
+ *         Ogni processo ha il suo log (session-<pid>.wal) e lo tiene con un QLockFile per
+ *         tutta la vita: più istanze non si toccano i log a vicenda, e un log è di una
+ *         sessione interrotta solo se il suo lock è stale (il processo non esiste più).
+ *
+ * Formato del file: intestazione serializzata con QDataStream (magic string, percorso
+ * della base, dimensione e data di modifica della base, dimensione del suo journal)
+ * seguita dai record come in RoadmapJournal.
+ */
+#include <QString>
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QFuture>
+#include <QLockFile>
+#include <QStringList>
+
+#define WalMagic "RoadmapWal01"
+
+/*
+ * Ultimo salvataggio su cui vanno riapplicati i record del log
+ */
+struct RoadmapWalHeader
+{
+    QString Base; // File della Roadmap, vuoto per una Roadmap mai salvata
+    qint64 BaseSize = -1;
+    qint64 BaseModified = -1;
+    qint64 JournalSize = 0; // Dimensione del journal della base (0 se non c'è)
+
+    /*
+     * Identità attuale di base e journal su disco
+     */
+    static RoadmapWalHeader of(const QString& base);
+
+    /*
+     * Indica se base e journal su disco sono ancora quelli dell'intestazione
+     */
+    bool matches() const;
+};
+
+class RoadmapWal
+{
+public:
+    enum
+    {
+        BATCHINTERVAL = 250 // ms in cui le modifiche vengono raccolte prima di un fsync
+    };
+
+private:
+    QString m_path; // File del log
+    QLockFile m_lock; // Tenuto finché il processo vive, segna il log come in uso
+    QThreadPool m_pool; // Un solo thread, quello di scrittura
+    QFuture<void> m_writer;
+
+    QMutex m_mutex; // Protegge i campi sotto, condivisi con il thread di scrittura
+    QWaitCondition m_wake;
+    QByteArray m_queue; // Record in attesa di essere scritti
+    QByteArray m_header; // Intestazione con cui riscrivere il file
+    bool m_reset = false; // Il file va riscritto con m_header
+    bool m_discard = false; // Il file va eliminato
+    bool m_idle = false; // Il thread aspetta lavoro
+    bool m_stop = false;
+
+public:
+	explicit RoadmapWal(const QString& path = defaultPath());
+	~RoadmapWal();
+
+	RoadmapWal(const RoadmapWal&) = delete;
+	RoadmapWal& operator=(const RoadmapWal&) = delete;
+
+	QString path() const;
+
+    /*
+     * Riscrive il log con una nuova intestazione e i record (già incorniciati)
+     * non ancora contenuti nel salvataggio, scartando quelli in coda
+     */
+	void start(const RoadmapWalHeader& header, const QByteArray& records = QByteArray());
+
+    /*
+     * Accoda un record, chiamata dal thread della GUI ad ogni modifica
+     */
+	void append(const QByteArray& record);
+
+    /*
+     * Elimina il log, il documento è stato chiuso normalmente
+     */
+	void discard();
+
+    /*
+     * Legge un log lasciato da una sessione precedente
+     */
+	static bool read(const QString& path, RoadmapWalHeader* header, QByteArray* records);
+
+    /*
+     * Log della sessione nella cartella dei dati dell'applicazione, uno per processo
+     */
+	static QString defaultPath();
+
+    /*
+     * Tutti i log nella cartella dei dati, anche quelli di istanze ancora in esecuzione:
+     * si possono recuperare solo quelli di cui si riesce a prendere il lock (lockPathOf)
+     */
+	static QStringList logs();
+
+	static QString lockPathOf(const QString& path);
+
+private:
+	void run(); // Ciclo del thread di scrittura
+};
@@ -72,5 +72,15 @@ inline QColor getLighter(QColor color, float n) {
 	return QColor::fromHsl(h, s, v * n, a);
 }
 
+/*
+ * Copia vera di una stringa: i nomi caricati da un file mappato sono viste nel file
+ * (QString::fromRawData) e le loro copie condividono il puntatore, chi li conserva
+ * oltre Roadmap::unmap() deve staccarli così
+ */
+inline QString detachedString(const QString& value)
+{
+	return QString(value.constData(), value.length());
+}
+
 inline qint64 minJd() { return -784350574879L; }
 inline qint64 maxJd() { return 784354017364L; }
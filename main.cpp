@@ -7,5 +7,6 @@ int main(int argc, char *argv[])
     RoadmapMainWnd w; // Dichiaro la finestra di entry point
     w.show(); // La mostro
     w.resize(800, 600); // La ridimensiono
+    w.recover(); // Propongo di recuperare le modifiche di una sessione interrotta
     return a.exec(); // Avvio il render loop
 }